@@ -0,0 +1,216 @@
+/*
+ * Micro-benchmarks of mod_dialer's hot paths, built against the stubbed core in switch_stub.c.
+ *
+ * The module is compiled into this file so that its static functions can be called directly. Every benchmark times
+ * each operation on its own and reports the throughput and the 50th and 99th percentile latencies:
+ *
+ *   selection   dialer_queue_pop() on a SEQUENTIAL campaign, the refill thread leasing from the fake table
+ *   pacing      dialer_pace(): picking the gateway, then the campaign, route, gateway and global token buckets
+ *   originate   dialer_originate_job() up to a failed originate, including the release of the number
+ *   reporting   dialer_call_register() plus dialer_on_reporting() for an answered call
+ *   randnorm    randnorm_r(), the gaussian call durations
+ *
+ * usage: dialer_bench [iterations]
+ */
+#include "../mod_dialer.c"
+
+#define BENCH_DEFAULT_ITERATIONS 200000
+
+struct switch_directories SWITCH_GLOBAL_dirs;
+
+typedef void (*bench_op_t)( void *arg, int i );
+
+static uint64_t bench_now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_compare( const void *a, const void *b )
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*!\brief Run `op` `iterations` times and print ops/sec, p50 and p99
+ */
+static void bench_run( const char *name, bench_op_t op, void *arg, int iterations )
+{
+    uint64_t *samples = malloc( sizeof( uint64_t ) * iterations );
+    uint64_t started, total, before;
+
+    started = bench_now_ns();
+    for ( int i=0; i<iterations; i++ ) {
+        before = bench_now_ns();
+        op( arg, i );
+        samples[i] = bench_now_ns() - before;
+    }
+    total = bench_now_ns() - started;
+
+    qsort( samples, iterations, sizeof( uint64_t ), bench_compare );
+    printf( "%-12s %10d ops %14.0f ops/sec   p50 %8" PRIu64 " ns   p99 %8" PRIu64 " ns\n", name, iterations,
+            (double) iterations * 1000000000.0 / (double) total, samples[ iterations / 2 ], samples[ (int) ( iterations * 0.99 ) ] );
+    free( samples );
+}
+
+static void bench_selection( void *arg, int i )
+{
+    struct db_campaign_config *campaign = arg;
+    struct dialer_destination destination;
+
+    if ( dialer_queue_pop( campaign, &destination ) != SWITCH_STATUS_SUCCESS ) {
+        fprintf( stderr, "selection: the queue ran dry\n" );
+        exit( 1 );
+    }
+}
+
+static void bench_pacing( void *arg, int i )
+{
+    dialer_pace( (struct db_campaign_config *) arg );
+}
+
+/* the accounting dialer_dial_destination() does before it queues a job for the workers */
+static struct dialer_dial_job *bench_job( struct db_campaign_config *campaign, int i )
+{
+    struct dialer_dial_job *dial_job = dialer_call_alloc();
+
+    dial_job->campaign = campaign;
+    dial_job->route = &campaign->routes[0];
+    dial_job->state = DIALER_CALL_QUEUED;
+    dial_job->destination.id = i;
+    dial_job->destination.calls = campaign->attempts_per_number;
+    snprintf( dial_job->destination.number, sizeof( dial_job->destination.number ), "346%08d", i );
+
+    dialer_stats_write_begin( campaign );
+    switch_atomic_inc( &campaign->stats.calls_made );
+    switch_atomic_inc( &campaign->stats.current_calls );
+    dialer_stats_write_end( campaign );
+    switch_atomic_inc( &dial_job->route->outstanding );
+    dialer_inflight_add( campaign, dial_job->route );
+    return dial_job;
+}
+
+static void bench_originate( void *arg, int i )
+{
+    static char dial_string[DIALER_DIAL_STRING_SIZE];
+
+    dialer_originate_job( bench_job( (struct db_campaign_config *) arg, i ), dial_string, sizeof( dial_string ) );
+}
+
+static void bench_reporting( void *arg, int i )
+{
+    struct db_campaign_config *campaign = arg;
+    struct dialer_dial_job *dial_job = bench_job( campaign, i );
+    switch_core_session_t session;
+    switch_time_t now = switch_micro_time_now();
+
+    memset( &session, 0, sizeof( session ) );
+    switch_uuid_str( session.uuid, sizeof( session.uuid ) );
+    session.times.created = now - 30000000;
+    session.times.progress = now - 29000000;
+    session.times.answered = now - 25000000;
+    session.times.hungup = now;
+
+    switch_copy_string( dial_job->uuid, session.uuid, sizeof( dial_job->uuid ) );
+    /* the channel reports from its own thread, but the answer was counted by the worker */
+    dialer_stats_write_begin( campaign );
+    switch_atomic_inc( &campaign->stats.answered );
+    dialer_stats_write_end( campaign );
+    dialer_inflight_done( campaign, dial_job->route );
+    dialer_call_register( dial_job );
+    dialer_on_reporting( &session );
+}
+
+static volatile float bench_sink;
+
+static void bench_randnorm( void *arg, int i )
+{
+    bench_sink = randnorm_r( (struct randnorm_state *) arg, 60, 15 );
+}
+
+static struct db_campaign_config *bench_campaign( void )
+{
+    struct db_campaign_config *campaign = dialer_campaign_create( "bench", NULL );
+
+    switch_copy_string( campaign->name, "bench", sizeof( campaign->name ) );
+    switch_copy_string( campaign->destination_list, "bench_numbers", sizeof( campaign->destination_list ) );
+    switch_copy_string( campaign->codec_list, "PCMA,PCMU", sizeof( campaign->codec_list ) );
+    switch_copy_string( campaign->global_caller_id, "34600000000", sizeof( campaign->global_caller_id ) );
+    switch_copy_string( campaign->action_on_anwser, "park", sizeof( campaign->action_on_anwser ) );
+    campaign->calling_strategy = SEQUENTIAL;
+    campaign->calling_mode = PROGRESSIVE;
+    campaign->attempts_per_number = 1;
+    campaign->time_between_retries = 60;
+    campaign->originate_timeout = 30;
+    campaign->call_min_duration = 10;
+    campaign->call_max_duration = 60;
+    campaign->lease_batch_size = DEFAULT_LEASE_BATCH_SIZE;
+    campaign->queue_low_watermark = DEFAULT_QUEUE_LOW_WATERMARK;
+    campaign->queue_high_watermark = DEFAULT_QUEUE_HIGH_WATERMARK;
+    /* rates no benchmark can reach: pacing costs the bookkeeping only, never a wait */
+    campaign->cps = 1e9;
+    campaign->cps_burst = 1e9;
+    dialer_bucket_init( &campaign->bucket, campaign->cps, campaign->cps_burst, campaign->pool );
+    dialer_param_gateways( campaign, "bench_gateway" );
+    dialer_predictive_init( campaign );
+    dialer_dial_template_init( campaign );
+
+    return campaign;
+}
+
+int main( int argc, char *argv[] )
+{
+    int iterations = argc > 1 ? atoi( argv[1] ) : BENCH_DEFAULT_ITERATIONS;
+    struct db_campaign_config *campaign;
+    struct randnorm_state rs;
+
+    if ( iterations <= 0 ) {
+        fprintf( stderr, "usage: %s [iterations]\n", argv[0] );
+        return 1;
+    }
+
+    memset( &globals, 0, sizeof( globals ) );
+    switch_core_new_memory_pool( &globals.pool );
+    switch_mutex_init( &globals.mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_mutex_init( &globals.calls_mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_mutex_init( &globals.gateways_mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_mutex_init( &globals.loads_mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_core_hash_init( &globals.calls );
+    switch_core_hash_init( &globals.campaigns_by_name );
+    switch_core_hash_init( &globals.campaigns_by_uuid );
+    switch_core_hash_init( &globals.gateways );
+    globals.dbname = "bench";
+    globals.dialect = dialer_sql_dialect_select( NULL );
+    globals.db_flush_interval = DEFAULT_DB_FLUSH_INTERVAL;
+    globals.db_flush_batch = DEFAULT_DB_FLUSH_BATCH;
+    globals.db_queue_size = DEFAULT_DB_QUEUE_SIZE;
+    globals.lease_seconds = DEFAULT_LEASE_SECONDS;
+    globals.gateway_cps = 1e9;
+    globals.gateway_cps_burst = 1e9;
+    dialer_bucket_init( &globals.bucket, 1e9, 1e9, globals.pool );
+    globals.running = SWITCH_TRUE;
+    if ( dialer_start_db_writer() == SWITCH_FALSE ) {
+        fprintf( stderr, "couldn't start the DB writer\n" );
+        return 1;
+    }
+
+    campaign = bench_campaign();
+
+    dialer_queue_start( campaign );
+    bench_run( "selection", bench_selection, campaign, iterations );
+    dialer_queue_stop( campaign );
+
+    bench_run( "pacing", bench_pacing, campaign, iterations );
+    bench_run( "originate", bench_originate, campaign, iterations );
+    bench_run( "reporting", bench_reporting, campaign, iterations );
+
+    randnorm_init( &rs, 1 );
+    bench_run( "randnorm", bench_randnorm, &rs, iterations );
+
+    dialer_db_flush( campaign );
+    dialer_stop_db_writer();
+    return 0;
+}
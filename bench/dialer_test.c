@@ -0,0 +1,146 @@
+/*
+ * Behaviour checks of mod_dialer against the stubbed core in switch_stub.c, where every originate fails right away.
+ *
+ * The module is compiled into this file, like in dialer_bench.c, so that the dial loop can be driven step by step:
+ *
+ *   retries   a number that never answers is dialed attempts_per_number times, then the campaign runs out of numbers
+ *
+ * usage: dialer_test
+ */
+#include "../mod_dialer.c"
+
+#define TEST_ATTEMPTS 3
+/* a retry is due every second at most, leave room for all of them */
+#define TEST_DEADLINE 30000000
+
+struct switch_directories SWITCH_GLOBAL_dirs;
+
+static int test_failures;
+
+#define TEST_CHECK( cond, ... ) do { \
+        if ( !( cond ) ) { \
+            fprintf( stderr, "FAIL %s:%d: ", __FILE__, __LINE__ ); \
+            fprintf( stderr, __VA_ARGS__ ); \
+            fprintf( stderr, "\n" ); \
+            test_failures++; \
+        } \
+    } while ( 0 )
+
+/*!\brief A file campaign over `path` that retries right away and dials through one gateway with no limits
+ */
+static struct db_campaign_config *test_campaign( const char *name, const char *path )
+{
+    struct db_campaign_config *campaign = dialer_campaign_create( name, NULL );
+    char source[ sizeof( campaign->file->path ) + 8 ];
+
+    switch_copy_string( campaign->name, name, sizeof( campaign->name ) );
+    switch_copy_string( campaign->destination_list, name, sizeof( campaign->destination_list ) );
+    switch_copy_string( campaign->codec_list, "PCMA,PCMU", sizeof( campaign->codec_list ) );
+    switch_copy_string( campaign->global_caller_id, "34600000000", sizeof( campaign->global_caller_id ) );
+    switch_copy_string( campaign->action_on_anwser, "park", sizeof( campaign->action_on_anwser ) );
+    switch_snprintf( source, sizeof( source ), "file:%s", path );
+    dialer_param_destination_source( campaign, source );
+    campaign->calling_strategy = SEQUENTIAL;
+    campaign->calling_mode = PROGRESSIVE;
+    campaign->attempts_per_number = TEST_ATTEMPTS;
+    campaign->time_between_retries = 0;
+    campaign->originate_timeout = 30;
+    campaign->lease_batch_size = DEFAULT_LEASE_BATCH_SIZE;
+    campaign->queue_low_watermark = DEFAULT_QUEUE_LOW_WATERMARK;
+    campaign->queue_high_watermark = DEFAULT_QUEUE_HIGH_WATERMARK;
+    dialer_bucket_init( &campaign->bucket, 0, 1, campaign->pool );
+    dialer_param_gateways( campaign, "test_gateway" );
+    dialer_predictive_init( campaign );
+    dialer_dial_template_init( campaign );
+
+    return campaign;
+}
+
+/*!\brief Dial a number that always fails the way the dial loop does, with the workers' part run right here
+ */
+static void test_retries( void )
+{
+    char path[] = "/tmp/dialer_test_XXXXXX", state_path[ sizeof( path ) + 8 ];
+    char dial_string[DIALER_DIAL_STRING_SIZE];
+    struct db_campaign_config *campaign;
+    struct dialer_destination destination;
+    struct dialer_route *route;
+    switch_status_t status = SWITCH_STATUS_TIMEOUT;
+    switch_time_t deadline = switch_micro_time_now() + TEST_DEADLINE;
+    void *pop = NULL;
+    int fd, attempts = 0;
+
+    if ( ( fd = mkstemp( path ) ) < 0 || write( fd, "34600000001\n", 12 ) != 12 ) {
+        fprintf( stderr, "retries: couldn't write %s\n", path );
+        exit( 1 );
+    }
+    close( fd );
+
+    campaign = test_campaign( "test_retries", path );
+    TEST_CHECK( dialer_file_open( campaign ) == SWITCH_TRUE, "retries: couldn't open the number file" );
+    TEST_CHECK( dialer_queue_start( campaign ) == SWITCH_TRUE, "retries: couldn't start the queue" );
+
+    while ( switch_micro_time_now() < deadline && attempts <= TEST_ATTEMPTS ) {
+        if ( ( status = dialer_queue_pop( campaign, &destination ) ) == SWITCH_STATUS_TIMEOUT ) {
+            continue;
+        }
+        if ( status != SWITCH_STATUS_SUCCESS ) {
+            break;
+        }
+        attempts++;
+        if ( !( route = dialer_pace( campaign ) ) || dialer_dial_destination( campaign, &destination, route ) == SWITCH_FALSE ||
+             switch_queue_trypop( globals.dial_queue, &pop ) != SWITCH_STATUS_SUCCESS ) {
+            TEST_CHECK( 0, "retries: attempt %d was never queued", attempts );
+            break;
+        }
+        dialer_originate_job( (struct dialer_dial_job *) pop, dial_string, sizeof( dial_string ) );
+    }
+
+    TEST_CHECK( status == SWITCH_STATUS_FALSE, "retries: the campaign didn't run out of numbers (pop returned %d)", (int) status );
+    TEST_CHECK( attempts == TEST_ATTEMPTS, "retries: %d attempts, expected %d", attempts, TEST_ATTEMPTS );
+    TEST_CHECK( campaign->file->rows[0].calls == TEST_ATTEMPTS, "retries: the sidecar counts %u calls, expected %d", campaign->file->rows[0].calls, TEST_ATTEMPTS );
+    TEST_CHECK( switch_atomic_read( &campaign->stats.current_calls ) == 0, "retries: %u calls still in progress", switch_atomic_read( &campaign->stats.current_calls ) );
+    TEST_CHECK( campaign->retries.count + campaign->retries.due_count == 0, "retries: %d retries still pending", campaign->retries.count + campaign->retries.due_count );
+
+    dialer_queue_stop( campaign );
+    dialer_file_close( campaign->file );
+    switch_snprintf( state_path, sizeof( state_path ), "%s.state", path );
+    unlink( state_path );
+    unlink( path );
+}
+
+int main( int argc, char *argv[] )
+{
+    memset( &globals, 0, sizeof( globals ) );
+    switch_core_new_memory_pool( &globals.pool );
+    switch_mutex_init( &globals.mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_mutex_init( &globals.calls_mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_mutex_init( &globals.gateways_mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_mutex_init( &globals.loads_mutex, SWITCH_MUTEX_NESTED, globals.pool );
+    switch_core_hash_init( &globals.calls );
+    switch_core_hash_init( &globals.campaigns_by_name );
+    switch_core_hash_init( &globals.campaigns_by_uuid );
+    switch_core_hash_init( &globals.gateways );
+    globals.dbname = "test";
+    globals.dialect = dialer_sql_dialect_select( NULL );
+    globals.db_flush_interval = DEFAULT_DB_FLUSH_INTERVAL;
+    globals.db_flush_batch = DEFAULT_DB_FLUSH_BATCH;
+    globals.db_queue_size = DEFAULT_DB_QUEUE_SIZE;
+    globals.lease_seconds = DEFAULT_LEASE_SECONDS;
+    dialer_bucket_init( &globals.bucket, 0, 1, globals.pool );
+    globals.running = SWITCH_TRUE;
+    if ( dialer_start_db_writer() == SWITCH_FALSE || switch_queue_create( &globals.dial_queue, 16, globals.pool ) != SWITCH_STATUS_SUCCESS ) {
+        fprintf( stderr, "couldn't start the DB writer or the dial queue\n" );
+        return 1;
+    }
+
+    test_retries();
+
+    dialer_stop_db_writer();
+    if ( test_failures ) {
+        fprintf( stderr, "%d check(s) failed\n", test_failures );
+        return 1;
+    }
+    printf( "all checks passed\n" );
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * switch.h stand-in for the mod_dialer benchmarks: just enough of the FreeSWITCH API for mod_dialer.c to build,
+ * with the same signatures. The implementations are in switch_stub.c.
+ */
+#ifndef DIALER_BENCH_SWITCH_H
+#define DIALER_BENCH_SWITCH_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <strings.h>
+#include <inttypes.h>
+typedef enum { SWITCH_FALSE = 0, SWITCH_TRUE = 1 } switch_bool_t;
+typedef enum { SWITCH_STATUS_SUCCESS=0, SWITCH_STATUS_FALSE, SWITCH_STATUS_TIMEOUT, SWITCH_STATUS_RESTART, SWITCH_STATUS_INTR, SWITCH_STATUS_NOTIMPL, SWITCH_STATUS_MEMERR, SWITCH_STATUS_NOOP, SWITCH_STATUS_RESAMPLE, SWITCH_STATUS_GENERR, SWITCH_STATUS_INUSE, SWITCH_STATUS_BREAK, SWITCH_STATUS_TERM, SWITCH_STATUS_NOTFOUND } switch_status_t;
+typedef enum { SWITCH_LOG_DEBUG=7, SWITCH_LOG_INFO=6, SWITCH_LOG_NOTICE=5, SWITCH_LOG_WARNING=4, SWITCH_LOG_ERROR=3, SWITCH_LOG_CRIT=2, SWITCH_LOG_ALERT=1, SWITCH_LOG_CONSOLE=0 } switch_log_level_t;
+#define SWITCH_CHANNEL_LOG 0, __FILE__, __func__, __LINE__, NULL
+#define SWITCH_CHANNEL_SESSION_LOG(s) 0, __FILE__, __func__, __LINE__, (const char*)(s)
+void switch_log_printf(int channel, const char *file, const char *func, int line, const char *userdata, switch_log_level_t level, const char *fmt, ...);
+#define SWITCH_UUID_FORMATTED_LENGTH 36
+typedef struct { unsigned char data[16]; } switch_uuid_t;
+void switch_uuid_get(switch_uuid_t *uuid);
+void switch_uuid_format(char *buffer, const switch_uuid_t *uuid);
+void switch_uuid_str(char *buf, size_t len);
+typedef struct switch_memory_pool switch_memory_pool_t;
+typedef struct switch_mutex switch_mutex_t;
+typedef struct switch_thread_rwlock switch_thread_rwlock_t;
+typedef struct switch_thread_cond switch_thread_cond_t;
+typedef struct switch_thread switch_thread_t;
+typedef struct switch_threadattr switch_threadattr_t;
+typedef struct switch_queue switch_queue_t;
+typedef struct switch_hash switch_hash_t;
+typedef struct switch_hashtable_iterator switch_hash_index_t;
+typedef struct switch_xml *switch_xml_t;
+struct switch_xml { char *name; char **attr; char *txt; switch_xml_t next; };
+typedef struct switch_core_session switch_core_session_t;
+typedef struct switch_channel switch_channel_t;
+typedef struct switch_event switch_event_t;
+typedef struct switch_cache_db_handle switch_cache_db_handle_t;
+typedef struct switch_stream_handle switch_stream_handle_t;
+typedef struct switch_loadable_module_interface switch_loadable_module_interface_t;
+typedef struct switch_api_interface switch_api_interface_t;
+typedef int64_t switch_time_t;
+typedef int64_t switch_interval_time_t;
+typedef size_t switch_size_t;
+typedef uint32_t switch_call_cause_t;
+typedef int (*switch_core_db_callback_func_t)(void *pArg, int argc, char **argv, char **columnNames);
+typedef void *(*switch_thread_start_t)(switch_thread_t *, void *);
+#define SWITCH_THREAD_FUNC
+#define SWITCH_THREAD_STACKSIZE 240*1024
+#define SWITCH_MUTEX_NESTED 1
+#define SWITCH_MUTEX_DEFAULT 0
+#define SWITCH_HASH_KEY_STRING -1
+typedef volatile uint32_t switch_atomic_t;
+void switch_atomic_set(volatile switch_atomic_t *mem, uint32_t val);
+uint32_t switch_atomic_read(volatile switch_atomic_t *mem);
+void switch_atomic_add(volatile switch_atomic_t *mem, uint32_t val);
+void switch_atomic_inc(volatile switch_atomic_t *mem);
+int switch_atomic_dec(volatile switch_atomic_t *mem);
+switch_status_t switch_mutex_init(switch_mutex_t **lock, unsigned int flags, switch_memory_pool_t *pool);
+switch_status_t switch_mutex_destroy(switch_mutex_t *lock);
+switch_status_t switch_mutex_lock(switch_mutex_t *lock);
+switch_status_t switch_mutex_unlock(switch_mutex_t *lock);
+switch_status_t switch_mutex_trylock(switch_mutex_t *lock);
+switch_status_t switch_thread_rwlock_create(switch_thread_rwlock_t **rwlock, switch_memory_pool_t *pool);
+switch_status_t switch_thread_rwlock_rdlock(switch_thread_rwlock_t *rwlock);
+switch_status_t switch_thread_rwlock_wrlock(switch_thread_rwlock_t *rwlock);
+switch_status_t switch_thread_rwlock_unlock(switch_thread_rwlock_t *rwlock);
+switch_status_t switch_thread_cond_create(switch_thread_cond_t **cond, switch_memory_pool_t *pool);
+switch_status_t switch_thread_cond_wait(switch_thread_cond_t *cond, switch_mutex_t *mutex);
+switch_status_t switch_thread_cond_timedwait(switch_thread_cond_t *cond, switch_mutex_t *mutex, switch_interval_time_t timeout);
+switch_status_t switch_thread_cond_signal(switch_thread_cond_t *cond);
+switch_status_t switch_thread_cond_broadcast(switch_thread_cond_t *cond);
+switch_status_t switch_threadattr_create(switch_threadattr_t **new_attr, switch_memory_pool_t *pool);
+switch_status_t switch_threadattr_detach_set(switch_threadattr_t *attr, int32_t on);
+switch_status_t switch_threadattr_stacksize_set(switch_threadattr_t *attr, switch_size_t stacksize);
+switch_status_t switch_thread_create(switch_thread_t **new_thread, switch_threadattr_t *attr, switch_thread_start_t func, void *data, switch_memory_pool_t *cont);
+switch_status_t switch_thread_join(switch_status_t *retval, switch_thread_t *thd);
+switch_status_t switch_queue_create(switch_queue_t **queue, unsigned int queue_capacity, switch_memory_pool_t *pool);
+switch_status_t switch_queue_push(switch_queue_t *queue, void *data);
+switch_status_t switch_queue_trypush(switch_queue_t *queue, void *data);
+switch_status_t switch_queue_pop(switch_queue_t *queue, void **data);
+switch_status_t switch_queue_pop_timeout(switch_queue_t *queue, void **data, switch_interval_time_t timeout);
+switch_status_t switch_queue_trypop(switch_queue_t *queue, void **data);
+unsigned int switch_queue_size(switch_queue_t *queue);
+switch_status_t switch_queue_interrupt_all(switch_queue_t *queue);
+switch_status_t switch_queue_term(switch_queue_t *queue);
+#define switch_core_new_memory_pool(p) switch_core_perform_new_memory_pool(p, __FILE__, __func__, __LINE__)
+switch_status_t switch_core_perform_new_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line);
+#define switch_core_destroy_memory_pool(p) switch_core_perform_destroy_memory_pool(p, __FILE__, __func__, __LINE__)
+switch_status_t switch_core_perform_destroy_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line);
+void *switch_core_alloc(switch_memory_pool_t *pool, switch_size_t memory);
+char *switch_core_strdup(switch_memory_pool_t *pool, const char *todup);
+char *switch_core_sprintf(switch_memory_pool_t *pool, const char *fmt, ...);
+char *switch_mprintf(const char *zFormat, ...);
+int switch_snprintf(char *buf, switch_size_t len, const char *format, ...);
+#define switch_zmalloc(ptr, len) (void)((ptr = calloc(1, (len))))
+#define switch_safe_free(it) if (it) {free(it);it=NULL;}
+#define zstr(x) (!(x) || !*(x))
+#define switch_strlen_zero(x) zstr(x)
+#define switch_yield(ms) switch_sleep(ms)
+void switch_sleep(switch_interval_time_t t);
+switch_time_t switch_micro_time_now(void);
+switch_time_t switch_time_now(void);
+time_t switch_epoch_time_now(time_t *t);
+#define switch_test_flag(obj, flag) ((obj)->flags & flag)
+#define switch_set_flag(obj, flag) (obj)->flags |= (flag)
+#define switch_clear_flag(obj, flag) (obj)->flags &= ~(flag)
+#define switch_true(x) ((x) && (!strcasecmp(x,"yes")||!strcasecmp(x,"on")||!strcasecmp(x,"true")||atoi(x)))
+#define switch_min(a,b) ((a)<(b)?(a):(b))
+#define switch_max(a,b) ((a)>(b)?(a):(b))
+int switch_separate_string(char *buf, char delim, char **array, unsigned int arraylen);
+int switch_is_number(const char *str);
+switch_xml_t switch_xml_open_cfg(const char *file_path, switch_xml_t *node, switch_event_t *params);
+switch_xml_t switch_xml_child(switch_xml_t xml, const char *name);
+const char *switch_xml_attr(switch_xml_t xml, const char *attr);
+const char *switch_xml_attr_soft(switch_xml_t xml, const char *attr);
+void switch_xml_free(switch_xml_t xml);
+switch_status_t switch_cache_db_get_db_handle_dsn(switch_cache_db_handle_t **dbh, const char *dsn);
+void switch_cache_db_release_db_handle(switch_cache_db_handle_t **dbh);
+switch_bool_t switch_cache_db_test_reactive(switch_cache_db_handle_t *dbh, const char *test_sql, const char *drop_sql, const char *reactive_sql);
+switch_status_t switch_cache_db_execute_sql(switch_cache_db_handle_t *dbh, char *sql, char **err);
+switch_status_t switch_cache_db_execute_sql_callback(switch_cache_db_handle_t *dbh, const char *sql, switch_core_db_callback_func_t callback, void *pdata, char **err);
+char *switch_cache_db_execute_sql2str(switch_cache_db_handle_t *dbh, char *sql, char *str, size_t len, char **err);
+int switch_cache_db_affected_rows(switch_cache_db_handle_t *dbh);
+switch_status_t switch_cache_db_persistant_execute_trans(switch_cache_db_handle_t *dbh, char *sql, uint32_t retries);
+typedef enum { SCDB_TYPE_CORE_DB, SCDB_TYPE_ODBC, SCDB_TYPE_DATABASE_INTERFACE } switch_cache_db_handle_type_t;
+switch_cache_db_handle_type_t switch_cache_db_get_type(switch_cache_db_handle_t *dbh);
+struct switch_stream_handle { switch_status_t (*write_function)(switch_stream_handle_t *handle, const char *fmt, ...); void *data; };
+#define SWITCH_STANDARD_API(name) static switch_status_t name (const char *cmd, switch_core_session_t *session, switch_stream_handle_t *stream)
+#define SWITCH_MODULE_LOAD_FUNCTION(name) switch_status_t name (switch_loadable_module_interface_t **module_interface, switch_memory_pool_t *pool)
+#define SWITCH_MODULE_SHUTDOWN_FUNCTION(name) switch_status_t name (void)
+#define SWITCH_MODULE_RUNTIME_FUNCTION(name) switch_status_t name (void)
+#define SWITCH_MODULE_DEFINITION(name, load, shutdown, runtime) static const char modname[] = #name
+switch_loadable_module_interface_t *switch_loadable_module_create_module_interface(switch_memory_pool_t *pool, const char *name);
+void *switch_loadable_module_create_interface(switch_loadable_module_interface_t *mod, int iname);
+#define SWITCH_API_INTERFACE 1
+typedef switch_status_t (*switch_api_function_t)(const char *cmd, switch_core_session_t *session, switch_stream_handle_t *stream);
+struct switch_api_interface { const char *interface_name; const char *desc; switch_api_function_t function; const char *syntax; };
+#define SWITCH_ADD_API(api_int, int_name, descript, funcptr, syntax_string) \
+	for (;;) { api_int = (switch_api_interface_t *)switch_loadable_module_create_interface(*module_interface, SWITCH_API_INTERFACE); \
+	api_int->interface_name = int_name; api_int->desc = descript; api_int->function = funcptr; api_int->syntax = syntax_string; break; }
+void switch_console_set_complete(const char *string);
+typedef enum { SWITCH_EVENT_CUSTOM, SWITCH_EVENT_HEARTBEAT, SWITCH_EVENT_CHANNEL_ANSWER, SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE, SWITCH_EVENT_RELOADXML, SWITCH_EVENT_ALL } switch_event_types_t;
+#define SWITCH_EVENT_SUBCLASS_ANY NULL
+typedef struct switch_event_header { char *name; char *value; struct switch_event_header *next; } switch_event_header_t;
+struct switch_event { switch_event_types_t event_id; switch_event_header_t *headers; };
+typedef void (*switch_event_callback_t)(switch_event_t *);
+switch_status_t switch_event_bind(const char *id, switch_event_types_t event, const char *subclass_name, switch_event_callback_t callback, void *user_data);
+switch_status_t switch_event_unbind_callback(switch_event_callback_t callback);
+char *switch_event_get_header(switch_event_t *event, const char *header_name);
+const char *switch_event_name(switch_event_types_t event);
+const char *switch_core_get_variable(const char *varname);
+const char *switch_core_get_switchname(void);
+typedef struct { switch_time_t profile_created, created, answered, progress, progress_media, hungup, transferred, resurrected, bridged, last_hold, hold_accum; } switch_channel_timetable_t;
+/* the benchmarks build their own sessions, which are also their channels */
+struct switch_core_session { char uuid[SWITCH_UUID_FORMATTED_LENGTH + 1]; switch_channel_timetable_t times; };
+typedef enum { CS_NEW, CS_INIT, CS_ROUTING, CS_SOFT_EXECUTE, CS_EXECUTE, CS_EXCHANGE_MEDIA, CS_PARK, CS_CONSUME_MEDIA, CS_HIBERNATE, CS_RESET, CS_HANGUP, CS_REPORTING, CS_DESTROY, CS_NONE } switch_channel_state_t;
+typedef switch_status_t (*switch_state_handler_t) (switch_core_session_t *);
+typedef struct { switch_state_handler_t on_init, on_routing, on_execute, on_hangup, on_exchange_media, on_soft_execute, on_consume_media, on_hibernate, on_reset, on_park, on_reporting, on_destroy; int flags; void *padding[10]; } switch_state_handler_table_t;
+switch_channel_t *switch_core_session_get_channel(switch_core_session_t *session);
+char *switch_core_session_get_uuid(switch_core_session_t *session);
+void switch_core_session_rwunlock(switch_core_session_t *session);
+switch_status_t switch_channel_set_private(switch_channel_t *channel, const char *key, const void *private_info);
+void *switch_channel_get_private(switch_channel_t *channel, const char *key);
+switch_channel_timetable_t *switch_channel_get_timetable(switch_channel_t *channel);
+switch_call_cause_t switch_channel_get_cause(switch_channel_t *channel);
+const char *switch_channel_cause2str(switch_call_cause_t cause);
+switch_call_cause_t switch_channel_str2cause(const char *str);
+const char *switch_channel_get_variable(switch_channel_t *channel, const char *varname);
+#define switch_channel_set_variable(c,v,val) switch_channel_set_variable_var_check(c,v,val,SWITCH_TRUE)
+switch_status_t switch_channel_set_variable_var_check(switch_channel_t *channel, const char *varname, const char *value, switch_bool_t var_check);
+#define switch_channel_hangup(c,cause) switch_channel_perform_hangup(c, __FILE__, __func__, __LINE__, cause)
+switch_channel_state_t switch_channel_perform_hangup(switch_channel_t *channel, const char *file, const char *func, int line, switch_call_cause_t hangup_cause);
+#define SWITCH_CAUSE_NONE 0
+#define SWITCH_CAUSE_NORMAL_CLEARING 16
+#define SWITCH_CAUSE_USER_BUSY 17
+#define SWITCH_CAUSE_NO_ANSWER 19
+#define SWITCH_CAUSE_NO_USER_RESPONSE 18
+#define SWITCH_CAUSE_CALL_REJECTED 21
+#define SWITCH_CAUSE_NORMAL_CIRCUIT_CONGESTION 34
+#define SWITCH_CAUSE_NETWORK_OUT_OF_ORDER 38
+#define SWITCH_CAUSE_NORMAL_TEMPORARY_FAILURE 41
+#define SWITCH_CAUSE_SWITCH_CONGESTION 42
+#define SWITCH_CAUSE_GATEWAY_DOWN 609
+#define SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER 27
+#define SWITCH_CAUSE_ORIGINATOR_CANCEL 487
+#define SWITCH_CAUSE_RECOVERY_ON_TIMER_EXPIRE 102
+#define SWITCH_CAUSE_ALLOTTED_TIMEOUT 602
+#define SWITCH_CAUSE_UNALLOCATED_NUMBER 1
+#define SWITCH_CAUSE_INVALID_NUMBER_FORMAT 28
+#define SWITCH_CAUSE_SERVICE_UNAVAILABLE 63
+typedef struct switch_caller_profile switch_caller_profile_t;
+typedef uint32_t switch_originate_flag_t;
+#define SOF_NONE 0
+typedef struct switch_dial_handle switch_dial_handle_t;
+switch_status_t switch_ivr_originate(switch_core_session_t *session, switch_core_session_t **bleg, switch_call_cause_t *cause, const char *bridgeto, uint32_t timelimit_sec, const switch_state_handler_table_t *table, const char *cid_name_override, const char *cid_num_override, switch_caller_profile_t *caller_profile_override, switch_event_t *ovars, switch_originate_flag_t flags, switch_call_cause_t *cancel_cause, switch_dial_handle_t *dh);
+switch_status_t switch_ivr_session_transfer(switch_core_session_t *session, const char *extension, const char *dialplan, const char *context);
+switch_status_t switch_api_execute(const char *cmd, const char *arg, switch_core_session_t *session, switch_stream_handle_t *stream);
+#define SWITCH_STANDARD_STREAM(s) memset(&s, 0, sizeof(s))
+struct switch_directories { char *base_dir, *mod_dir, *conf_dir, *log_dir, *run_dir, *db_dir, *script_dir, *temp_dir, *htdocs_dir, *grammar_dir, *storage_dir, *cache_dir, *recordings_dir, *sounds_dir, *lib_dir, *certs_dir, *fonts_dir, *images_dir, *data_dir, *localstate_dir; };
+extern struct switch_directories SWITCH_GLOBAL_dirs;
+#define SWITCH_PATH_SEPARATOR "/"
+switch_status_t switch_core_hash_init(switch_hash_t **hash);
+switch_status_t switch_core_hash_destroy(switch_hash_t **hash);
+switch_status_t switch_core_hash_insert(switch_hash_t *hash, const char *key, const void *data);
+void *switch_core_hash_delete(switch_hash_t *hash, const char *key);
+void *switch_core_hash_find(switch_hash_t *hash, const char *key);
+switch_hash_index_t *switch_core_hash_first(switch_hash_t *hash);
+switch_hash_index_t *switch_core_hash_next(switch_hash_index_t **hi);
+void switch_core_hash_this(switch_hash_index_t *hi, const void **key, switch_size_t *klen, void **val);
+#define switch_assert(x) ((void)0)
+#define SWITCH_DECLARE(t) t
+char *switch_escape_string(const char *in, char *out, switch_size_t outlen);
+char *switch_sanitize_number(char *number);
+switch_status_t switch_dir_make_recursive(const char *path, int perm, switch_memory_pool_t *pool);
+
+char *switch_copy_string(char *dst, const char *src, switch_size_t dst_size);
+
+#define SWITCH_UINT64_T_FMT PRIu64
+#endif
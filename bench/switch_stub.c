@@ -0,0 +1,820 @@
+/*
+ * Minimal FreeSWITCH core for the mod_dialer benchmarks: pthread backed mutexes, conditions, threads and queues,
+ * a chained string hash, pools that are plain malloc() lists and an in-memory stand-in for the destination table.
+ * Logging is dropped, originate fails right away and API commands return "0".
+ */
+#define _GNU_SOURCE
+#include <switch.h>
+#include <pthread.h>
+#include <errno.h>
+
+/* Atomics */
+
+void switch_atomic_set(volatile switch_atomic_t *mem, uint32_t val)
+{
+    __sync_lock_test_and_set( mem, val );
+}
+
+uint32_t switch_atomic_read(volatile switch_atomic_t *mem)
+{
+    return __sync_fetch_and_add( mem, 0 );
+}
+
+void switch_atomic_add(volatile switch_atomic_t *mem, uint32_t val)
+{
+    __sync_fetch_and_add( mem, val );
+}
+
+void switch_atomic_inc(volatile switch_atomic_t *mem)
+{
+    __sync_fetch_and_add( mem, 1 );
+}
+
+int switch_atomic_dec(volatile switch_atomic_t *mem)
+{
+    return __sync_sub_and_fetch( mem, 1 ) != 0;
+}
+
+/* Memory pools: every allocation is remembered and freed with the pool */
+
+struct pool_block {
+    struct pool_block *next;
+};
+
+struct switch_memory_pool {
+    pthread_mutex_t mutex;
+    struct pool_block *blocks;
+};
+
+switch_status_t switch_core_perform_new_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line)
+{
+    *pool = calloc( 1, sizeof( switch_memory_pool_t ) );
+    pthread_mutex_init( &(*pool)->mutex, NULL );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_perform_destroy_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line)
+{
+    struct pool_block *block, *next;
+
+    for ( block = (*pool)->blocks; block; block = next ) {
+        next = block->next;
+        free( block );
+    }
+    pthread_mutex_destroy( &(*pool)->mutex );
+    free( *pool );
+    *pool = NULL;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void *switch_core_alloc(switch_memory_pool_t *pool, switch_size_t memory)
+{
+    /* keep the payload aligned like the real pool does */
+    struct pool_block *block = calloc( 1, sizeof( struct pool_block ) + 16 + memory );
+
+    if ( pool ) {
+        pthread_mutex_lock( &pool->mutex );
+        block->next = pool->blocks;
+        pool->blocks = block;
+        pthread_mutex_unlock( &pool->mutex );
+    }
+    return (char *) block + 16;
+}
+
+char *switch_core_strdup(switch_memory_pool_t *pool, const char *todup)
+{
+    char *copy = switch_core_alloc( pool, strlen( todup ) + 1 );
+
+    return strcpy( copy, todup );
+}
+
+/* Strings */
+
+/* %q is %s without the quoting, the benchmarks only feed it trusted strings */
+static char *stub_format( const char *format )
+{
+    char *copy = strdup( format ), *p;
+
+    for ( p = copy; ( p = strstr( p, "%q" ) ); p += 2 ) {
+        p[1] = 's';
+    }
+    return copy;
+}
+
+char *switch_mprintf(const char *zFormat, ...)
+{
+    char *format = stub_format( zFormat ), *out = NULL;
+    va_list ap;
+
+    va_start( ap, zFormat );
+    if ( vasprintf( &out, format, ap ) < 0 ) {
+        out = NULL;
+    }
+    va_end( ap );
+    free( format );
+    return out;
+}
+
+char *switch_core_sprintf(switch_memory_pool_t *pool, const char *fmt, ...)
+{
+    char *format = stub_format( fmt ), *out = NULL, *copy;
+    va_list ap;
+
+    va_start( ap, fmt );
+    if ( vasprintf( &out, format, ap ) < 0 ) {
+        out = NULL;
+    }
+    va_end( ap );
+    free( format );
+    if ( !out ) {
+        return NULL;
+    }
+    copy = switch_core_strdup( pool, out );
+    free( out );
+    return copy;
+}
+
+int switch_snprintf(char *buf, switch_size_t len, const char *format, ...)
+{
+    char *fmt = stub_format( format );
+    va_list ap;
+    int ret;
+
+    va_start( ap, format );
+    ret = vsnprintf( buf, len, fmt, ap );
+    va_end( ap );
+    free( fmt );
+    return ret;
+}
+
+char *switch_copy_string(char *dst, const char *src, switch_size_t dst_size)
+{
+    if ( !dst_size ) {
+        return dst;
+    }
+    strncpy( dst, src ? src : "", dst_size - 1 );
+    dst[ dst_size - 1 ] = '\0';
+    return dst;
+}
+
+int switch_separate_string(char *buf, char delim, char **array, unsigned int arraylen)
+{
+    unsigned int count = 0;
+    char *p = buf;
+
+    while ( p && *p && count < arraylen ) {
+        array[ count++ ] = p;
+        if ( ( p = strchr( p, delim ) ) ) {
+            *p++ = '\0';
+        }
+    }
+    return (int) count;
+}
+
+int switch_is_number(const char *str)
+{
+    for ( ; str && *str; str++ ) {
+        if ( !isdigit( (unsigned char) *str ) && *str != '.' && *str != '-' ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void switch_uuid_str(char *buf, size_t len)
+{
+    static volatile uint32_t counter;
+    uint32_t n = __sync_add_and_fetch( &counter, 1 );
+
+    snprintf( buf, len, "%08x-0000-4000-8000-%012x", (unsigned) rand(), n );
+}
+
+/* Time */
+
+switch_time_t switch_micro_time_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_REALTIME, &ts );
+    return (switch_time_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+switch_time_t switch_time_now(void)
+{
+    return switch_micro_time_now();
+}
+
+time_t switch_epoch_time_now(time_t *t)
+{
+    return time( t );
+}
+
+void switch_sleep(switch_interval_time_t t)
+{
+    struct timespec ts = { t / 1000000, ( t % 1000000 ) * 1000 };
+
+    nanosleep( &ts, NULL );
+}
+
+/* Logging */
+
+void switch_log_printf(int channel, const char *file, const char *func, int line, const char *userdata, switch_log_level_t level, const char *fmt, ...)
+{
+}
+
+/* Locks, conditions and threads */
+
+struct switch_mutex {
+    pthread_mutex_t mutex;
+};
+
+struct switch_thread_cond {
+    pthread_cond_t cond;
+};
+
+struct switch_threadattr {
+    pthread_attr_t attr;
+};
+
+struct switch_thread {
+    pthread_t thread;
+    switch_thread_start_t func;
+    void *data;
+};
+
+switch_status_t switch_mutex_init(switch_mutex_t **lock, unsigned int flags, switch_memory_pool_t *pool)
+{
+    pthread_mutexattr_t attr;
+
+    *lock = switch_core_alloc( pool, sizeof( switch_mutex_t ) );
+    pthread_mutexattr_init( &attr );
+    if ( flags & SWITCH_MUTEX_NESTED ) {
+        pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+    }
+    pthread_mutex_init( &(*lock)->mutex, &attr );
+    pthread_mutexattr_destroy( &attr );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_destroy(switch_mutex_t *lock)
+{
+    pthread_mutex_destroy( &lock->mutex );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_lock(switch_mutex_t *lock)
+{
+    pthread_mutex_lock( &lock->mutex );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_unlock(switch_mutex_t *lock)
+{
+    pthread_mutex_unlock( &lock->mutex );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_trylock(switch_mutex_t *lock)
+{
+    return pthread_mutex_trylock( &lock->mutex ) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_create(switch_thread_cond_t **cond, switch_memory_pool_t *pool)
+{
+    *cond = switch_core_alloc( pool, sizeof( switch_thread_cond_t ) );
+    pthread_cond_init( &(*cond)->cond, NULL );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_wait(switch_thread_cond_t *cond, switch_mutex_t *mutex)
+{
+    pthread_cond_wait( &cond->cond, &mutex->mutex );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_timedwait(switch_thread_cond_t *cond, switch_mutex_t *mutex, switch_interval_time_t timeout)
+{
+    switch_time_t until = switch_micro_time_now() + timeout;
+    struct timespec ts = { until / 1000000, ( until % 1000000 ) * 1000 };
+
+    return pthread_cond_timedwait( &cond->cond, &mutex->mutex, &ts ) == ETIMEDOUT ? SWITCH_STATUS_TIMEOUT : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_signal(switch_thread_cond_t *cond)
+{
+    pthread_cond_signal( &cond->cond );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_broadcast(switch_thread_cond_t *cond)
+{
+    pthread_cond_broadcast( &cond->cond );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_create(switch_threadattr_t **new_attr, switch_memory_pool_t *pool)
+{
+    *new_attr = switch_core_alloc( pool, sizeof( switch_threadattr_t ) );
+    pthread_attr_init( &(*new_attr)->attr );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_detach_set(switch_threadattr_t *attr, int32_t on)
+{
+    pthread_attr_setdetachstate( &attr->attr, on ? PTHREAD_CREATE_DETACHED : PTHREAD_CREATE_JOINABLE );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_stacksize_set(switch_threadattr_t *attr, switch_size_t stacksize)
+{
+    pthread_attr_setstacksize( &attr->attr, stacksize );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static void *stub_thread_main( void *obj )
+{
+    switch_thread_t *thread = (switch_thread_t *) obj;
+
+    return thread->func( thread, thread->data );
+}
+
+switch_status_t switch_thread_create(switch_thread_t **new_thread, switch_threadattr_t *attr, switch_thread_start_t func, void *data, switch_memory_pool_t *cont)
+{
+    switch_thread_t *thread = switch_core_alloc( cont, sizeof( switch_thread_t ) );
+
+    thread->func = func;
+    thread->data = data;
+    if ( pthread_create( &thread->thread, attr ? &attr->attr : NULL, stub_thread_main, thread ) ) {
+        return SWITCH_STATUS_FALSE;
+    }
+    *new_thread = thread;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_join(switch_status_t *retval, switch_thread_t *thd)
+{
+    pthread_join( thd->thread, NULL );
+    *retval = SWITCH_STATUS_SUCCESS;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Bounded blocking queue */
+
+struct switch_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    void **data;
+    unsigned int capacity;
+    unsigned int head;
+    unsigned int count;
+};
+
+switch_status_t switch_queue_create(switch_queue_t **queue, unsigned int queue_capacity, switch_memory_pool_t *pool)
+{
+    switch_queue_t *q = switch_core_alloc( pool, sizeof( switch_queue_t ) );
+
+    q->data = switch_core_alloc( pool, sizeof( void * ) * queue_capacity );
+    q->capacity = queue_capacity;
+    pthread_mutex_init( &q->mutex, NULL );
+    pthread_cond_init( &q->not_empty, NULL );
+    pthread_cond_init( &q->not_full, NULL );
+    *queue = q;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t stub_queue_push( switch_queue_t *queue, void *data, int block )
+{
+    pthread_mutex_lock( &queue->mutex );
+    while ( queue->count == queue->capacity ) {
+        if ( !block ) {
+            pthread_mutex_unlock( &queue->mutex );
+            return SWITCH_STATUS_FALSE;
+        }
+        pthread_cond_wait( &queue->not_full, &queue->mutex );
+    }
+    queue->data[ ( queue->head + queue->count++ ) % queue->capacity ] = data;
+    pthread_cond_signal( &queue->not_empty );
+    pthread_mutex_unlock( &queue->mutex );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t stub_queue_pop( switch_queue_t *queue, void **data, switch_interval_time_t timeout )
+{
+    switch_time_t until = switch_micro_time_now() + timeout;
+    struct timespec ts = { until / 1000000, ( until % 1000000 ) * 1000 };
+
+    pthread_mutex_lock( &queue->mutex );
+    while ( queue->count == 0 ) {
+        if ( timeout == 0 || ( timeout > 0 && pthread_cond_timedwait( &queue->not_empty, &queue->mutex, &ts ) == ETIMEDOUT ) ) {
+            pthread_mutex_unlock( &queue->mutex );
+            return timeout ? SWITCH_STATUS_TIMEOUT : SWITCH_STATUS_FALSE;
+        }
+        if ( timeout < 0 ) {
+            pthread_cond_wait( &queue->not_empty, &queue->mutex );
+        }
+    }
+    *data = queue->data[ queue->head ];
+    queue->head = ( queue->head + 1 ) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal( &queue->not_full );
+    pthread_mutex_unlock( &queue->mutex );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_queue_push(switch_queue_t *queue, void *data)
+{
+    return stub_queue_push( queue, data, 1 );
+}
+
+switch_status_t switch_queue_trypush(switch_queue_t *queue, void *data)
+{
+    return stub_queue_push( queue, data, 0 );
+}
+
+switch_status_t switch_queue_pop(switch_queue_t *queue, void **data)
+{
+    return stub_queue_pop( queue, data, -1 );
+}
+
+switch_status_t switch_queue_pop_timeout(switch_queue_t *queue, void **data, switch_interval_time_t timeout)
+{
+    return stub_queue_pop( queue, data, timeout > 0 ? timeout : 1 );
+}
+
+switch_status_t switch_queue_trypop(switch_queue_t *queue, void **data)
+{
+    return stub_queue_pop( queue, data, 0 );
+}
+
+unsigned int switch_queue_size(switch_queue_t *queue)
+{
+    unsigned int count;
+
+    pthread_mutex_lock( &queue->mutex );
+    count = queue->count;
+    pthread_mutex_unlock( &queue->mutex );
+    return count;
+}
+
+switch_status_t switch_queue_interrupt_all(switch_queue_t *queue)
+{
+    pthread_mutex_lock( &queue->mutex );
+    pthread_cond_broadcast( &queue->not_empty );
+    pthread_cond_broadcast( &queue->not_full );
+    pthread_mutex_unlock( &queue->mutex );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_queue_term(switch_queue_t *queue)
+{
+    return switch_queue_interrupt_all( queue );
+}
+
+/* String hash, the callers do their own locking like with the real one */
+
+#define STUB_HASH_BUCKETS 4096
+
+struct stub_hash_entry {
+    struct stub_hash_entry *next;
+    char *key;
+    void *data;
+};
+
+struct switch_hash {
+    struct stub_hash_entry *buckets[STUB_HASH_BUCKETS];
+};
+
+static unsigned int stub_hash_key( const char *key )
+{
+    unsigned int hash = 5381;
+
+    while ( *key ) {
+        hash = hash * 33 + (unsigned char) *key++;
+    }
+    return hash % STUB_HASH_BUCKETS;
+}
+
+switch_status_t switch_core_hash_init(switch_hash_t **hash)
+{
+    *hash = calloc( 1, sizeof( switch_hash_t ) );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_hash_destroy(switch_hash_t **hash)
+{
+    for ( int i=0; i<STUB_HASH_BUCKETS; i++ ) {
+        struct stub_hash_entry *entry, *next;
+
+        for ( entry = (*hash)->buckets[i]; entry; entry = next ) {
+            next = entry->next;
+            free( entry->key );
+            free( entry );
+        }
+    }
+    free( *hash );
+    *hash = NULL;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_hash_insert(switch_hash_t *hash, const char *key, const void *data)
+{
+    unsigned int bucket = stub_hash_key( key );
+    struct stub_hash_entry *entry;
+
+    for ( entry = hash->buckets[bucket]; entry; entry = entry->next ) {
+        if ( !strcmp( entry->key, key ) ) {
+            entry->data = (void *) data;
+            return SWITCH_STATUS_SUCCESS;
+        }
+    }
+    entry = calloc( 1, sizeof( *entry ) );
+    entry->key = strdup( key );
+    entry->data = (void *) data;
+    entry->next = hash->buckets[bucket];
+    hash->buckets[bucket] = entry;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void *switch_core_hash_delete(switch_hash_t *hash, const char *key)
+{
+    struct stub_hash_entry **link, *entry;
+    void *data;
+
+    for ( link = &hash->buckets[ stub_hash_key( key ) ]; ( entry = *link ); link = &entry->next ) {
+        if ( !strcmp( entry->key, key ) ) {
+            *link = entry->next;
+            data = entry->data;
+            free( entry->key );
+            free( entry );
+            return data;
+        }
+    }
+    return NULL;
+}
+
+void *switch_core_hash_find(switch_hash_t *hash, const char *key)
+{
+    struct stub_hash_entry *entry;
+
+    for ( entry = hash->buckets[ stub_hash_key( key ) ]; entry; entry = entry->next ) {
+        if ( !strcmp( entry->key, key ) ) {
+            return entry->data;
+        }
+    }
+    return NULL;
+}
+
+switch_hash_index_t *switch_core_hash_first(switch_hash_t *hash)
+{
+    return NULL;
+}
+
+switch_hash_index_t *switch_core_hash_next(switch_hash_index_t **hi)
+{
+    return NULL;
+}
+
+void switch_core_hash_this(switch_hash_index_t *hi, const void **key, switch_size_t *klen, void **val)
+{
+}
+
+/*
+ * In-memory destination table. Every claim hands out fresh rows: the claim's LIMIT (or the size of its id list) is
+ * remembered and the following select returns that many generated numbers.
+ */
+
+static volatile uint32_t stub_db_next_row;
+static __thread int stub_db_claimed;
+
+struct switch_cache_db_handle {
+    int unused;
+};
+
+static switch_cache_db_handle_t stub_dbh;
+
+switch_status_t switch_cache_db_get_db_handle_dsn(switch_cache_db_handle_t **dbh, const char *dsn)
+{
+    *dbh = &stub_dbh;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_cache_db_release_db_handle(switch_cache_db_handle_t **dbh)
+{
+    *dbh = NULL;
+}
+
+switch_bool_t switch_cache_db_test_reactive(switch_cache_db_handle_t *dbh, const char *test_sql, const char *drop_sql, const char *reactive_sql)
+{
+    return SWITCH_TRUE;
+}
+
+switch_status_t switch_cache_db_execute_sql(switch_cache_db_handle_t *dbh, char *sql, char **err)
+{
+    const char *limit;
+
+    if ( !strncmp( sql, "update", 6 ) && strstr( sql, "in_use = 2" ) ) {
+        if ( ( limit = strstr( sql, "LIMIT " ) ) ) {
+            stub_db_claimed = atoi( limit + 6 );
+        } else if ( ( limit = strstr( sql, "id in (" ) ) ) {
+            stub_db_claimed = 1;
+            for ( ; *limit && *limit != ')'; limit++ ) {
+                stub_db_claimed += *limit == ',';
+            }
+        }
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_cache_db_execute_sql_callback(switch_cache_db_handle_t *dbh, const char *sql, switch_core_db_callback_func_t callback, void *pdata, char **err)
+{
+    char number[32], id[16];
+    char *argv[5] = { number, "", "0", id, "0" };
+
+    if ( !strncmp( sql, "select number", 13 ) ) {
+        for ( ; stub_db_claimed > 0; stub_db_claimed-- ) {
+            uint32_t row = __sync_add_and_fetch( &stub_db_next_row, 1 );
+
+            snprintf( number, sizeof( number ), "346%08u", row );
+            snprintf( id, sizeof( id ), "%u", row );
+            if ( callback( pdata, 5, argv, NULL ) ) {
+                break;
+            }
+        }
+        stub_db_claimed = 0;
+    } else if ( !strncmp( sql, "select max(id)", 14 ) ) {
+        char *max[1] = { "1000000" };
+
+        callback( pdata, 1, max, NULL );
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+char *switch_cache_db_execute_sql2str(switch_cache_db_handle_t *dbh, char *sql, char *str, size_t len, char **err)
+{
+    return NULL;
+}
+
+int switch_cache_db_affected_rows(switch_cache_db_handle_t *dbh)
+{
+    return 0;
+}
+
+switch_status_t switch_cache_db_persistant_execute_trans(switch_cache_db_handle_t *dbh, char *sql, uint32_t retries)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_cache_db_handle_type_t switch_cache_db_get_type(switch_cache_db_handle_t *dbh)
+{
+    return SCDB_TYPE_ODBC;
+}
+
+/* XML config: the benchmarks set campaigns up by hand */
+
+switch_xml_t switch_xml_open_cfg(const char *file_path, switch_xml_t *node, switch_event_t *params)
+{
+    return NULL;
+}
+
+switch_xml_t switch_xml_child(switch_xml_t xml, const char *name)
+{
+    return NULL;
+}
+
+const char *switch_xml_attr(switch_xml_t xml, const char *attr)
+{
+    return NULL;
+}
+
+const char *switch_xml_attr_soft(switch_xml_t xml, const char *attr)
+{
+    return "";
+}
+
+void switch_xml_free(switch_xml_t xml)
+{
+}
+
+/* Events: nothing is ever fired */
+
+switch_status_t switch_event_bind(const char *id, switch_event_types_t event, const char *subclass_name, switch_event_callback_t callback, void *user_data)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_unbind_callback(switch_event_callback_t callback)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Sessions and channels: a session is its channel, whose uuid and timetable the benchmark fills in */
+
+switch_channel_t *switch_core_session_get_channel(switch_core_session_t *session)
+{
+    return (switch_channel_t *) session;
+}
+
+char *switch_core_session_get_uuid(switch_core_session_t *session)
+{
+    return session->uuid;
+}
+
+void switch_core_session_rwunlock(switch_core_session_t *session)
+{
+}
+
+switch_status_t switch_channel_set_private(switch_channel_t *channel, const char *key, const void *private_info)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void *switch_channel_get_private(switch_channel_t *channel, const char *key)
+{
+    return NULL;
+}
+
+switch_channel_timetable_t *switch_channel_get_timetable(switch_channel_t *channel)
+{
+    return &( (switch_core_session_t *) channel )->times;
+}
+
+switch_call_cause_t switch_channel_get_cause(switch_channel_t *channel)
+{
+    return SWITCH_CAUSE_NORMAL_CLEARING;
+}
+
+const char *switch_channel_cause2str(switch_call_cause_t cause)
+{
+    return cause == SWITCH_CAUSE_NO_ANSWER ? "NO_ANSWER" : "UNKNOWN";
+}
+
+switch_call_cause_t switch_channel_str2cause(const char *str)
+{
+    return SWITCH_CAUSE_NONE;
+}
+
+const char *switch_channel_get_variable(switch_channel_t *channel, const char *varname)
+{
+    return NULL;
+}
+
+switch_status_t switch_channel_set_variable_var_check(switch_channel_t *channel, const char *varname, const char *value, switch_bool_t var_check)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_channel_state_t switch_channel_perform_hangup(switch_channel_t *channel, const char *file, const char *func, int line, switch_call_cause_t hangup_cause)
+{
+    return CS_HANGUP;
+}
+
+switch_status_t switch_ivr_originate(switch_core_session_t *session, switch_core_session_t **bleg, switch_call_cause_t *cause, const char *bridgeto, uint32_t timelimit_sec,
+                                     const switch_state_handler_table_t *table, const char *cid_name_override, const char *cid_num_override,
+                                     switch_caller_profile_t *caller_profile_override, switch_event_t *ovars, switch_originate_flag_t flags,
+                                     switch_call_cause_t *cancel_cause, switch_dial_handle_t *dh)
+{
+    *cause = SWITCH_CAUSE_NO_ANSWER;
+    return SWITCH_STATUS_FALSE;
+}
+
+switch_status_t switch_ivr_session_transfer(switch_core_session_t *session, const char *extension, const char *dialplan, const char *context)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_api_execute(const char *cmd, const char *arg, switch_core_session_t *session, switch_stream_handle_t *stream)
+{
+    if ( stream ) {
+        stream->data = strdup( "0" );
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Module plumbing, never called by the benchmarks */
+
+const char *switch_core_get_variable(const char *varname)
+{
+    return NULL;
+}
+
+const char *switch_core_get_switchname(void)
+{
+    return "bench";
+}
+
+switch_loadable_module_interface_t *switch_loadable_module_create_module_interface(switch_memory_pool_t *pool, const char *name)
+{
+    return NULL;
+}
+
+void *switch_loadable_module_create_interface(switch_loadable_module_interface_t *mod, int iname)
+{
+    static struct switch_api_interface api;
+
+    return &api;
+}
+
+void switch_console_set_complete(const char *string)
+{
+}
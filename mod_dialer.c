@@ -41,6 +41,11 @@
  */
 #include <switch.h>
 #include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 static const char *global_cf = "dialer.conf";
@@ -50,8 +55,415 @@ typedef enum {
     SEQUENTIAL = 2
 } calling_strategy;
 
+typedef enum {
+    PROGRESSIVE = 1,
+    PREDICTIVE = 2
+} calling_mode;
+
 /* Defines */
-#define MAX_CAMPAIGNS 10
+#define MAX_ORIGINATE_WORKERS 256
+#define DEFAULT_ORIGINATE_WORKERS 16
+#define DEFAULT_ORIGINATE_QUEUE_SIZE 1024
+#define DEFAULT_LEASE_BATCH_SIZE 500
+#define DEFAULT_QUEUE_LOW_WATERMARK 100
+#define DEFAULT_QUEUE_HIGH_WATERMARK 1000
+#define DIALER_CACHE_LINE 64
+#define DIALER_NUMBER_SIZE 31
+#define DEFAULT_DB_FLUSH_INTERVAL 200
+#define DEFAULT_DB_FLUSH_BATCH 500
+#define DEFAULT_DB_QUEUE_SIZE 10000
+#define DEFAULT_LEASE_SECONDS 300
+#define DEFAULT_LEASE_RENEW_INTERVAL 60
+#define DEFAULT_CHECKPOINT_INTERVAL 5
+/* gateway health, only with gateway-breaker-threshold set: the failure percentage used for an out of range one, calls it
+ * needs to see, window and cooldown in seconds */
+#define DEFAULT_BREAKER_THRESHOLD 50
+#define DEFAULT_BREAKER_MIN_CALLS 20
+#define DEFAULT_BREAKER_WINDOW 30
+#define DEFAULT_BREAKER_COOLDOWN 30
+/* AIMD: cps added back every second and the floor a gateway is never throttled below; a failure halves the rate at most once a second */
+#define DEFAULT_AIMD_INCREASE 1
+#define DEFAULT_AIMD_MIN_CPS 0.1
+#define DIALER_AIMD_DECREASE 0.5
+#define DIALER_HEALTH_SLOTS 10
+/* call result journal: records queued per campaign, records the writer takes per write() and how often it is compacted */
+#define DEFAULT_JOURNAL_QUEUE_SIZE 4096
+#define DIALER_JOURNAL_BATCH 256
+#define DEFAULT_JOURNAL_COMPACT_INTERVAL 60
+/* how often the dial loop looks again when it is waiting for a free call slot or originate */
+#define DIALER_PACING_POLL 20000
+/* predictive: how often free agents are polled, weight of each new sample and how many answers to see before predicting */
+#define DIALER_PREDICTIVE_INTERVAL 1000000
+#define DIALER_PREDICTIVE_ALPHA 0.05
+#define DIALER_PREDICTIVE_WARMUP 20
+#define DEFAULT_ABANDON_RATE 3
+/* bulk loads: rows per INSERT (and transaction), read buffer and how often progress is logged */
+#define DIALER_LOAD_BATCH 1000
+#define DIALER_LOAD_BUFFER ( 1024 * 1024 )
+#define DIALER_LOAD_PROGRESS 100000
+/* scratch every origination worker renders its dial strings into */
+#define DIALER_DIAL_STRING_SIZE 2048
+#define DIALER_STR_(x) #x
+#define DIALER_STR(x) DIALER_STR_(x)
+/* call records are carved out of the slab this many at a time */
+#define DIALER_CALL_SLAB_SIZE 256
+
+#if defined(__GNUC__)
+#define dialer_memory_barrier() __sync_synchronize()
+#define dialer_atomic_add64(ptr, value) __sync_fetch_and_add( (ptr), (value) )
+#define dialer_atomic_cas32(ptr, old, value) __sync_bool_compare_and_swap( (ptr), (old), (value) )
+#define DIALER_THREAD_LOCAL __thread
+#else
+#define dialer_memory_barrier()
+#define dialer_atomic_add64(ptr, value) ( *(ptr) += (value) )
+#define dialer_atomic_cas32(ptr, old, value) ( *(ptr) == (old) ? ( *(ptr) = (value), 1 ) : 0 )
+#define DIALER_THREAD_LOCAL
+#endif
+
+/*
+ * Metrics for `dialer metrics`. Every thread bumps its own shard (see dialer_metrics_shard()), on its own cache line,
+ * so the dial path never shares a counter with another thread; a scrape adds the shards up without taking any lock.
+ */
+#define DIALER_METRIC_SHARDS 16
+#define DIALER_HISTOGRAM_BUCKETS 13
+#define DIALER_CAUSES 1024
+
+struct dialer_counter_shard {
+    switch_atomic_t attempts;
+    switch_atomic_t answers;
+    switch_atomic_t failures;
+    char pad[DIALER_CACHE_LINE - 3 * sizeof(switch_atomic_t)];
+};
+
+struct dialer_metrics {
+    struct dialer_counter_shard shards[DIALER_METRIC_SHARDS];
+    /* failed originates by hangup cause, failures are rare enough to share */
+    switch_atomic_t causes[DIALER_CAUSES];
+};
+
+/* counts[i] is the number of samples in bucket i (not cumulative), the last bucket is +Inf. Samples are in microseconds */
+struct dialer_histogram_shard {
+    switch_atomic_t counts[DIALER_HISTOGRAM_BUCKETS];
+    uint64_t sum;
+};
+
+struct dialer_histogram {
+    struct dialer_histogram_shard shards[DIALER_METRIC_SHARDS];
+};
+
+/*
+ * Counters bumped on every call. They live on their own cache line(s) so that the dial loop, the origination
+ * workers and the hangup path don't keep invalidating the campaign's configuration.
+ * Single counters can be read at any time, multi-counter updates are bracketed by `seq` (odd while a write is in
+ * progress) so that readers can take a consistent snapshot without locking, see dialer_stats_snapshot().
+ */
+struct dialer_campaign_stats {
+    char pad_head[DIALER_CACHE_LINE];
+    switch_atomic_t seq;
+    switch_atomic_t current_calls;
+    switch_atomic_t calls_made;
+    switch_atomic_t answered;
+    switch_atomic_t total_seconds;
+    char pad_tail[DIALER_CACHE_LINE - 5 * sizeof(switch_atomic_t)];
+};
+
+struct dialer_stats_snapshot {
+    uint32_t current_calls;
+    uint32_t calls_made;
+    uint32_t answered;
+    uint32_t total_seconds;
+};
+
+/* Row updates waiting for the DB writer, only ever touched by the writer thread */
+struct dialer_db_pending {
+    char (*called)[DIALER_NUMBER_SIZE];
+    int called_count;
+    char (*released)[DIALER_NUMBER_SIZE];
+    int released_count;
+    char (*retried)[DIALER_NUMBER_SIZE];
+    int retried_count;
+    switch_bool_t listed;
+};
+
+typedef enum {
+    DIALER_DB_OP_CALLED = 1,
+    DIALER_DB_OP_RELEASED = 2,
+    DIALER_DB_OP_FLUSH = 3,
+    DIALER_DB_OP_RETRIED = 4
+} dialer_db_op_type_t;
+
+/* A row leased from the campaign's destination_list */
+struct dialer_destination {
+    uint32_t id;
+    char number[DIALER_NUMBER_SIZE];
+    char callerid[26];
+    int duration;
+    int calls;
+};
+
+/*
+ * Hierarchical timing wheel of numbers waiting for their next attempt, ticking once a second. Level n has
+ * DIALER_WHEEL_SLOTS slots of DIALER_WHEEL_SLOTS^n ticks each; entries cascade down a level as their time comes
+ * closer and land on `due` once they are due. Guarded by the campaign's queue_mutex.
+ */
+#define DIALER_WHEEL_BITS 6
+#define DIALER_WHEEL_SLOTS ( 1 << DIALER_WHEEL_BITS )
+#define DIALER_WHEEL_LEVELS 3
+
+struct dialer_retry {
+    struct dialer_retry *next;
+    uint64_t due;
+    struct dialer_destination destination;
+};
+
+struct dialer_timing_wheel {
+    struct dialer_retry *slots[DIALER_WHEEL_LEVELS][DIALER_WHEEL_SLOTS];
+    uint64_t now;
+    int count;
+    struct dialer_retry *due;
+    struct dialer_retry *due_tail;
+    int due_count;
+};
+
+/* Token bucket: `rate` tokens per second, at most `burst` of them saved up. A rate of 0 means no limit */
+struct dialer_token_bucket {
+    switch_mutex_t *mutex;
+    double rate;
+    double burst;
+    double tokens;
+    switch_time_t last;
+};
+
+typedef enum {
+    DIALER_BREAKER_CLOSED = 0,
+    DIALER_BREAKER_OPEN = 1,
+    DIALER_BREAKER_HALF_OPEN = 2
+} dialer_breaker_state_t;
+
+/*
+ * How a gateway has been doing: calls and gateway failures over the last breaker-window seconds, in DIALER_HEALTH_SLOTS
+ * slots. The breaker opens when too many of them failed, no call goes to the gateway until the cooldown is over, then
+ * a single probe call decides whether it closes again. The gateway's cps is throttled the AIMD way meanwhile
+ */
+struct dialer_gateway_health {
+    switch_mutex_t *mutex;
+    uint32_t attempts[DIALER_HEALTH_SLOTS];
+    uint32_t failures[DIALER_HEALTH_SLOTS];
+    /* which slot of time each of them counts, in window / DIALER_HEALTH_SLOTS units since the epoch */
+    uint64_t ticks[DIALER_HEALTH_SLOTS];
+    volatile dialer_breaker_state_t state;
+    volatile switch_time_t open_until;
+    volatile switch_time_t probe_started;
+    /* configured cps, what AIMD grows back to (0: none, the limit is lifted again past `lift`) */
+    double ceiling;
+    double lift;
+    switch_time_t last_decrease;
+    switch_time_t last_increase;
+};
+
+/* State shared by every campaign dialing through the same gateway, lives as long as the module */
+struct dialer_gateway {
+    char name[50];
+    struct dialer_token_bucket bucket;
+    struct dialer_metrics metrics;
+    switch_atomic_t inflight;
+    struct dialer_gateway_health health;
+    struct dialer_gateway *next;
+};
+
+#define DIALER_MAX_ROUTES 32
+
+/* One of the gateways a campaign dials through, profile/gateway=<name>[:<weight>[:<max_calls>[:<cps>]]],... */
+struct dialer_route {
+    struct dialer_gateway *gateway;
+    int weight;
+    /* calls of this campaign through the gateway at once, 0 for no limit */
+    int max_calls;
+    /* this campaign's cps through the gateway, on top of the gateway's own gateway-cps */
+    struct dialer_token_bucket bucket;
+    /* calls in progress through it, from queueing until the call is over */
+    switch_atomic_t outstanding;
+    /* "}sofia/gateway/<name>/", the end of the dial string */
+    char *dial_tail;
+};
+
+/*
+ * destination_source=file:<path>, dialing straight from a number file with no database. The file is mapped read-only
+ * and its rows are indexed in a sidecar, <path>.state, mapped read-write: a header, then one dialer_file_row per line.
+ * The sidecar holds everything the destination_list columns would (calls, lastcall, leased), plus the SEQUENTIAL
+ * cursor, so a restarted campaign picks up where it was without reading the number file again
+ */
+#define DIALER_FILE_MAGIC 0x31464444
+#define DIALER_FILE_ROW_LEASED 0x1
+#define DIALER_FILE_ROW_INVALID 0x2
+
+struct dialer_file_header {
+    uint32_t magic;
+    uint32_t rows;
+    uint64_t file_size;
+    int64_t file_mtime;
+    /* SEQUENTIAL: next row to look at */
+    uint32_t cursor;
+    uint32_t reserved;
+};
+
+struct dialer_file_row {
+    /* where the line starts in the number file */
+    uint64_t offset;
+    /* epoch of the last attempt, 0 if never called */
+    uint32_t lastcall;
+    uint16_t calls;
+    uint16_t flags;
+};
+
+struct dialer_file_source {
+    char path[512];
+    int fd;
+    const char *data;
+    switch_size_t size;
+    int state_fd;
+    struct dialer_file_header *header;
+    struct dialer_file_row *rows;
+    switch_size_t state_size;
+    /* guards the rows and the cursor: leases, call results and releases come from different threads */
+    switch_mutex_t *mutex;
+};
+
+/*
+ * Checkpoint of a campaign run, <db_dir>/dialer_<campaign>.checkpoint: this header, then `retry_count` dialer_checkpoint_retry.
+ * Rewritten (to a temporary file, then renamed over the old one) every checkpoint-interval seconds and when the campaign
+ * stops, read back by `dialer resume`
+ */
+#define DIALER_CHECKPOINT_MAGIC 0x31504b43
+#define DIALER_CHECKPOINT_VERSION 1
+
+struct dialer_checkpoint {
+    uint32_t magic;
+    uint32_t version;
+    /* the run's uuid: the numbers it leased are still owned by it */
+    char uuid[SWITCH_UUID_FORMATTED_LENGTH + 1];
+    /* destination_list or the number file's path, a checkpoint of another list is of no use */
+    char source[512];
+    int32_t calling_strategy;
+    uint32_t calls_made;
+    uint32_t answered;
+    uint32_t total_seconds;
+    /* SEQUENTIAL: last number handed to the dial loop. RANDOM: the permutation and the position after the last row dialed */
+    char last_dialed[DIALER_NUMBER_SIZE];
+    uint32_t perm_seed;
+    uint32_t perm_size;
+    uint32_t perm_pos;
+    int64_t saved;
+    uint32_t retry_count;
+};
+
+struct dialer_checkpoint_retry {
+    uint64_t due;
+    struct dialer_destination destination;
+};
+
+/*
+ * Call result journal of a campaign, <db_dir>/dialer_<campaign>.journal: this header, then one dialer_journal_record per
+ * attempt, appended as calls end and never rewritten, only cut back to the header once a destination table holds all of
+ * them. `compacted` counts the records already summarized into the destination table's lastresult column
+ */
+#define DIALER_JOURNAL_MAGIC 0x314c4e4a
+#define DIALER_JOURNAL_ANSWERED 0x1
+
+struct dialer_journal_header {
+    uint32_t magic;
+    uint32_t record_size;
+    uint64_t compacted;
+};
+
+struct dialer_journal_record {
+    /* when the attempt ended, microseconds since the epoch */
+    int64_t ended;
+    uint32_t id;
+    uint32_t cause;
+    /* talk time, and the time to the first ringing or early media in milliseconds (0 if there was none) */
+    uint32_t seconds;
+    uint32_t post_dial_delay;
+    /* the number's calls count after this attempt */
+    uint16_t calls;
+    uint16_t flags;
+    char number[DIALER_NUMBER_SIZE + 1];
+    char gateway[52];
+};
+
+/* one slot of the ring: `sequence` says whether it is free for the producer of that turn or filled for the writer */
+struct dialer_journal_slot {
+    volatile uint32_t sequence;
+    struct dialer_journal_record record;
+};
+
+/*
+ * A campaign's open journal. Calls ending on any thread claim a slot of the ring with a compare-and-swap on `head`, the
+ * campaign's journal thread is the only reader. It appends whatever is queued with one write(), syncs the file once
+ * per db-flush-interval-ms for all of them, and every journal-compact-interval seconds compacts the new records
+ */
+struct dialer_journal {
+    char pad_head[DIALER_CACHE_LINE];
+    volatile uint32_t head;
+    char pad_tail[DIALER_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t tail;
+    uint32_t size;
+    struct dialer_journal_slot *slots;
+    int fd;
+    char path[1024];
+    /* records in the file, and how many of them the compactor has seen */
+    uint64_t records;
+    uint64_t compacted;
+    switch_thread_t *thread;
+    volatile switch_bool_t running;
+};
+
+struct db_campaign_config;
+
+/* Where a predictive campaign learns how many agents are free, configured as agent_source=<name>:<argument>.
+ * Returns the number of free agents or -1 if it couldn't tell
+ */
+typedef int (*dialer_agent_source_func_t)( struct db_campaign_config *campaign, const char *arg );
+
+struct dialer_agent_source {
+    const char *name;
+    dialer_agent_source_func_t free_agents;
+};
+
+/* Predictive pacing. The rolling figures are exponentially weighted averages written under the campaign's mutex,
+ * the dial loop only reads `target`
+ */
+struct dialer_predictive {
+    const struct dialer_agent_source *source;
+    char source_arg[255];
+    double abandon_target;
+    double answer_rate;
+    double ring_time;
+    double talk_time;
+    double abandon_rate;
+    double gain;
+    uint32_t samples;
+    /* agents free at the last poll, plus the ones already talking to our calls */
+    int capacity;
+    /* answered calls that hung up, stats.answered minus this is how many are still talking */
+    switch_atomic_t answered_done;
+    /* free agents reported by the static (stub) source */
+    switch_atomic_t static_agents;
+    /* how many originates should be outstanding right now */
+    switch_atomic_t target;
+    switch_time_t next_update;
+};
+
+#define DIALER_FEISTEL_ROUNDS 4
+
+/* Keyed bijection over [0, size), the RANDOM calling order of one campaign run */
+struct dialer_permutation {
+    uint32_t seed;
+    uint32_t size;
+    uint32_t half_bits;
+    uint32_t half_mask;
+    uint32_t keys[DIALER_FEISTEL_ROUNDS];
+};
 
 struct db_campaign_config {
     char campaign_requested[50];
@@ -78,28 +490,268 @@ struct db_campaign_config {
     char global_caller_id[50];
     char action_on_anwser[255];
     char destination_list[50];
+    /* destination_source=file:<path>, NULL when dialing from destination_list */
+    struct dialer_file_source *file;
     char codec_list[50];
-    char profile_gateway[50];
+    char profile_gateway[255];
+    /* the gateways of profile/gateway, calls that fail on one are sent through another when gateway_failover is on */
+    struct dialer_route *routes;
+    int route_count;
+    int gateway_failover;
+    /* dial string template rendered once the config is loaded: everything before the per-call variables (the gateway prefix is the route's) */
+    char *dial_head;
     int calling_strategy;
+    int calling_mode;
+    struct dialer_predictive predictive;
     char my_local_ip[16];
     char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
-    int current_calls;
     int finish_on;
-    unsigned long int calls_made;
-    unsigned long int answered;
-    unsigned long int total_seconds;
+    struct dialer_campaign_stats stats;
+    int lease_batch_size;
+    int queue_low_watermark;
+    int queue_high_watermark;
+    /* pacing: calls per second and burst, plus a cap on originates that haven't been answered yet */
+    double cps;
+    double cps_burst;
+    int max_inflight_originates;
+    struct dialer_token_bucket bucket;
+    switch_atomic_t inflight;
+    /* calls per second actually sent, measured by the dial loop about once a second */
+    double current_cps;
+    uint32_t cps_calls;
+    switch_time_t cps_since;
+    /* `dialer metrics`: originate counters and latency histograms of this campaign run */
+    struct dialer_metrics metrics;
+    struct dialer_histogram post_dial_delay;
+    struct dialer_histogram originate_latency;
+    struct dialer_histogram pick_latency;
+    struct dialer_histogram call_duration;
+    /* Leased destinations waiting to be dialed, refilled in the background */
+    struct dialer_destination *queue;
+    int queue_head;
+    int queue_count;
+    switch_bool_t queue_running;
+    switch_bool_t queue_exhausted;
+    /* SEQUENTIAL keyset cursors: last number leased (refill thread) and last number handed to the dial loop */
+    char cursor[DIALER_NUMBER_SIZE];
+    char last_dialed[DIALER_NUMBER_SIZE];
+    /* RANDOM: permutation of the row ids, the next position to visit and how many positions in a row yielded nothing */
+    int random_seed;
+    struct dialer_permutation perm;
+    uint32_t perm_pos;
+    uint32_t perm_misses;
+    /* id of the last leased row handed to the dial loop, a RANDOM checkpoint resumes right after it */
+    uint32_t last_dialed_id;
+    /* checkpoints: the retries seen by the last one taken while the queue ran, when the next one is due,
+     * and the checkpoint `dialer resume` restores from until the queue has started
+     */
+    struct dialer_checkpoint_retry *checkpoint_retries;
+    uint32_t checkpoint_retry_count;
+    uint32_t checkpoint_retry_size;
+    switch_time_t checkpoint_next;
+    struct dialer_checkpoint *resume;
+    /* where every attempt's result goes, NULL with journal off */
+    struct dialer_journal *journal;
+    /* numbers with attempts left, still leased to us, waiting for time_between_retries */
+    struct dialer_timing_wheel retries;
+    switch_mutex_t *queue_mutex;
+    switch_thread_cond_t *queue_refill_cond;
+    switch_thread_cond_t *queue_avail_cond;
+    switch_thread_t *queue_thread;
+    struct dialer_db_pending db_pending;
     switch_memory_pool_t *pool;
+    /* Per-campaign lock: serializes stats writers and the campaign's run state, never held across SQL or originate */
     switch_mutex_t *mutex;
+    /* registry linkage; refs and registered are guarded by globals.mutex, the campaign is freed with its pool on the last release */
+    struct db_campaign_config *next;
+    int refs;
+    switch_bool_t registered;
+};
+
+/* A row update queued for the DB writer */
+struct dialer_db_op {
+    dialer_db_op_type_t type;
+    struct db_campaign_config *campaign;
+    char number[DIALER_NUMBER_SIZE];
+    switch_atomic_t *done;
+};
+
+typedef enum {
+    DIALER_CALL_FREE = 0,
+    DIALER_CALL_QUEUED = 1,
+    DIALER_CALL_ORIGINATING = 2
+} dialer_call_state_t;
+
+/*
+ * A number picked from the destination list. It waits in the dial queue for an origination worker and, once the
+ * call is sent, is tracked in globals.calls by its channel uuid until the channel reports (see dialer_on_reporting).
+ * Records come from the call slab (dialer_call_alloc) and go back to it once the call is finished
+ */
+struct dialer_dial_job {
+    struct db_campaign_config *campaign;
+    struct dialer_destination destination;
+    /* the gateway it goes through, and the routes (bit per index) it already failed on */
+    struct dialer_route *route;
+    uint32_t routes_tried;
+    char uuid[SWITCH_UUID_FORMATTED_LENGTH + 1];
+    dialer_call_state_t state;
+    switch_time_t queued;
+    switch_time_t originated;
+    /* how the attempt ended, for the journal */
+    switch_call_cause_t hangup_cause;
+    switch_interval_time_t post_dial_delay;
+    switch_bool_t answered;
+    /* free list linkage while the record sits in the slab */
+    struct dialer_dial_job *next_free;
+};
+
+struct dialer_call_chunk {
+    struct dialer_call_chunk *next;
+    struct dialer_dial_job records[DIALER_CALL_SLAB_SIZE];
+};
+
+/*
+ * What differs between the databases we run on. Everything that builds SQL takes its schema, time arithmetic and
+ * upserts from here; the rest is plain SQL all of them understand
+ */
+struct dialer_sql_dialect {
+    const char *name;
+    /* CREATE TABLE of a destination_list, every %s is the table name */
+    const char *destinations_create;
+    /* upgrades of destination_lists created by older versions, NULL where no such tables can exist */
+    const char *destinations_id_add;
+    const char *destinations_lease_add;
+    const char *campaign_state_create;
+    /* the current time, and a printf format for the current time plus %d seconds */
+    const char *now;
+    const char *now_offset;
+    /* insert or replace a dialer_campaign_state row, %q campaign and %q last_number */
+    const char *cursor_save;
+    /* INSERT that skips rows whose number is already in the table: the statement's start and its end */
+    const char *insert_ignore;
+    const char *insert_ignore_tail;
+    /* UPDATE accepts ORDER BY and LIMIT, otherwise the rows to claim are picked by a subselect, followed by `claim_lock`.
+     * PostgreSQL rechecks only `number in (...)` against a row another node updated meanwhile, with the subselect's old
+     * snapshot of it, so without locking the subselect's rows both nodes would claim (and dial) the same numbers */
+    switch_bool_t update_limit;
+    const char *claim_lock;
+    /* run once when the module loads */
+    const char *setup;
+};
+
+/* A `dialer load` in progress. Counters are written by the loader thread only */
+struct dialer_load {
+    char campaign[50];
+    char table[50];
+    char path[512];
+    switch_atomic_t lines;
+    switch_atomic_t loaded;
+    switch_atomic_t invalid;
+    switch_time_t started;
+    switch_bool_t stop;
+    switch_memory_pool_t *pool;
+    struct dialer_load *next;
+};
+
+/* How a campaign parameter is stored, see dialer_params */
+typedef enum {
+    DIALER_PARAM_INT,
+    DIALER_PARAM_ULONG,
+    DIALER_PARAM_DOUBLE,
+    DIALER_PARAM_STRING,
+    DIALER_PARAM_CUSTOM
+} dialer_param_type_t;
+
+#define DIALER_PARAM_REQUIRED 0x1
+#define DIALER_PARAM_LIVE 0x2
+
+struct dialer_param {
+    const char *name;
+    dialer_param_type_t type;
+    /* the campaign field it ends up in */
+    size_t offset;
+    size_t size;
+    int flags;
+    /* applied when the campaign doesn't set it, NULL for none */
+    const char *default_value;
+    /* DIALER_PARAM_CUSTOM: parse and store the value */
+    switch_bool_t (*set)( struct db_campaign_config *campaign, const char *value );
+};
+
+/* A <campaign> of dialer.conf as it was parsed at load or on the last reloadxml */
+struct dialer_campaign_def {
+    char name[50];
+    /* one value per entry of dialer_params, NULL where the campaign doesn't set it */
+    const char **values;
+    switch_bool_t complete;
 };
 
 static struct {
     int debug;
     char *odbc_dsn;
     char *dbname;
-    struct db_campaign_config campaigns[MAX_CAMPAIGNS];
+    const struct dialer_sql_dialect *dialect;
+    /* campaign registry, indexed by name and by campaign uuid, guarded by mutex */
+    switch_hash_t *campaigns_by_name;
+    switch_hash_t *campaigns_by_uuid;
+    struct db_campaign_config *campaign_list;
+    int campaign_count;
     switch_bool_t running;
     switch_mutex_t *mutex;
     switch_memory_pool_t *pool;
+    int originate_workers;
+    int originate_queue_size;
+    switch_queue_t *dial_queue;
+    switch_thread_t *workers[MAX_ORIGINATE_WORKERS];
+    /* write-behind row updates */
+    int db_flush_interval;
+    int db_flush_batch;
+    int db_queue_size;
+    switch_queue_t *db_queue;
+    switch_thread_t *db_writer;
+    switch_bool_t db_writer_running;
+    /* row leases: how long a claim is valid and how often running campaigns renew theirs */
+    int lease_seconds;
+    int lease_renew_interval;
+    switch_thread_t *lease_thread;
+    switch_bool_t lease_running;
+    /* seconds between campaign checkpoints, 0 disables them */
+    int checkpoint_interval;
+    /* call result journals: on or off, ring size in records and seconds between compactions (0: only when the campaign ends) */
+    switch_bool_t journal;
+    int journal_queue_size;
+    int journal_compact_interval;
+    /* gateway health, breaker_threshold 0 disables the breaker and aimd off leaves gateway cps alone */
+    int breaker_threshold;
+    int breaker_min_calls;
+    int breaker_window;
+    int breaker_cooldown;
+    switch_bool_t aimd;
+    double aimd_increase;
+    double aimd_min_cps;
+    /* global pacing, and the per-gateway buckets by gateway name */
+    double cps;
+    double cps_burst;
+    double gateway_cps;
+    double gateway_cps_burst;
+    int max_inflight_originates;
+    struct dialer_token_bucket bucket;
+    switch_atomic_t inflight;
+    switch_hash_t *gateways;
+    struct dialer_gateway *gateway_list;
+    switch_mutex_t *gateways_mutex;
+    /* calls in progress, by channel uuid, and the slab their records come from, all guarded by calls_mutex */
+    switch_hash_t *calls;
+    switch_mutex_t *calls_mutex;
+    struct dialer_call_chunk *call_chunks;
+    struct dialer_dial_job *call_free;
+    /* campaign definitions by name, replaced as a whole on reloadxml. definitions_mutex is never held while taking another lock */
+    switch_hash_t *definitions;
+    switch_memory_pool_t *definitions_pool;
+    switch_mutex_t *definitions_mutex;
+    /* bulk loads in progress. loads_mutex is never held while taking another lock */
+    struct dialer_load *load_list;
+    switch_mutex_t *loads_mutex;
 } globals;
 
 struct randnorm_state {
@@ -110,49 +762,221 @@ struct randnorm_state {
 
 /* Prototypes */
 static void *SWITCH_THREAD_FUNC dialer_start_campaign(switch_thread_t *thread, void *obj);
-static void dialer_event_handler(switch_event_t *event);
+static switch_status_t dialer_on_reporting(switch_core_session_t *session);
+static void dialer_show_campaign( struct db_campaign_config *campaign );
 static void dialer_show_campaigns( const char * campaign );
-
-static void dialer_clear_struct_slot(int index);
-static int dialer_is_campaign_running( char * campaign_name );
+static void dialer_stats_write_begin( struct db_campaign_config *campaign );
+static void dialer_stats_write_end( struct db_campaign_config *campaign );
+static void dialer_stats_snapshot( struct db_campaign_config *campaign, struct dialer_stats_snapshot *snapshot );
+static int dialer_metrics_shard( void );
+static void dialer_metrics_failure( struct dialer_metrics *metrics, switch_call_cause_t cause );
+static void dialer_histogram_observe( struct dialer_histogram *histogram, const double *bounds, switch_interval_time_t usec );
+static void dialer_metrics_write( switch_stream_handle_t *stream );
+static void dialer_status( switch_stream_handle_t *stream, const char *campaign, switch_bool_t json );
+
+static struct db_campaign_config *dialer_campaign_create( const char *campaign_requested, const char *uuid );
+static switch_bool_t dialer_campaign_spawn( struct db_campaign_config *campaign );
+static struct db_campaign_config *dialer_campaign_find( const char *name_or_uuid );
+static void dialer_campaign_release( struct db_campaign_config *campaign );
+static struct db_campaign_config **dialer_campaign_hold_all( int *count );
+static void dialer_campaign_release_all( struct db_campaign_config **campaigns, int count );
+static void dialer_campaign_unregister( struct db_campaign_config *campaign );
 static int dialer_dests_callback(void *pArg, int argc, char **argv, char **columnNames);
-static int dialer_get_empty_index(struct db_campaign_config ** found_campaign, const char * campaign_requested );
-static int dialer_get_campaign_by_uuid( const char * uuid );
-static int dialer_get_campaign_by_name( const char * campaign_requested );
+static void *SWITCH_THREAD_FUNC dialer_originate_worker(switch_thread_t *thread, void *obj);
+static void dialer_originate_job( struct dialer_dial_job *dial_job, char *dial_string, switch_size_t dial_string_len );
+static void dialer_dial_template_init( struct db_campaign_config *campaign );
+static struct dialer_dial_job *dialer_call_alloc( void );
+static void dialer_call_free( struct dialer_dial_job *dial_job );
+static void dialer_call_slab_destroy( void );
+static void dialer_call_register( struct dialer_dial_job *dial_job );
+static struct dialer_dial_job *dialer_call_claim( const char *uuid );
+static void dialer_call_finished( struct dialer_dial_job *dial_job, int seconds, switch_call_cause_t cause );
+static switch_bool_t dialer_start_originate_workers(void);
+static void dialer_stop_originate_workers(void);
+static switch_bool_t dialer_queue_start( struct db_campaign_config *campaign );
+static void dialer_queue_stop( struct db_campaign_config *campaign );
+static switch_status_t dialer_queue_pop( struct db_campaign_config *campaign, struct dialer_destination *destination );
+static void *SWITCH_THREAD_FUNC dialer_queue_refill_thread(switch_thread_t *thread, void *obj);
+static int dialer_lease_destinations( struct db_campaign_config *campaign, struct dialer_destination *destinations, int max );
+static void dialer_load_cursor( struct db_campaign_config *campaign );
+static void dialer_save_cursor( struct db_campaign_config *campaign );
+static switch_bool_t dialer_dial_destination( struct db_campaign_config *campaign, const struct dialer_destination *destination, struct dialer_route *route );
+static void dialer_bucket_init( struct dialer_token_bucket *bucket, double rate, double burst, switch_memory_pool_t *pool );
+static void dialer_bucket_set_limit( struct dialer_token_bucket *bucket, double rate, double burst );
+static struct dialer_route *dialer_pace( struct db_campaign_config *campaign );
+static switch_bool_t dialer_inflight_full( struct db_campaign_config *campaign );
+static void dialer_inflight_add( struct db_campaign_config *campaign, struct dialer_route *route );
+static void dialer_inflight_done( struct db_campaign_config *campaign, struct dialer_route *route );
+static switch_bool_t dialer_routes_full( struct db_campaign_config *campaign );
+static struct dialer_route *dialer_route_pick( struct db_campaign_config *campaign, uint32_t tried );
+static switch_bool_t dialer_route_failover( struct dialer_dial_job *dial_job, switch_call_cause_t cause );
+static struct dialer_gateway *dialer_gateway_get( const char *name );
+static void dialer_gateway_limit( struct dialer_gateway *gateway, double cps, double burst );
+static switch_bool_t dialer_gateway_usable( struct dialer_gateway *gateway );
+static switch_bool_t dialer_gateway_admit( struct dialer_gateway *gateway, switch_bool_t *probe );
+static void dialer_gateway_release_probe( struct dialer_gateway *gateway );
+static void dialer_gateway_outcome( struct dialer_gateway *gateway, switch_call_cause_t cause, switch_bool_t answered );
+static switch_bool_t dialer_agent_source_set( struct db_campaign_config *campaign, const char *value );
+static void dialer_predictive_init( struct db_campaign_config *campaign );
+static void dialer_predictive_update( struct db_campaign_config *campaign );
+static void dialer_predictive_originated( struct db_campaign_config *campaign, switch_bool_t answered, switch_interval_time_t ring );
+static void dialer_predictive_hungup( struct db_campaign_config *campaign, int seconds );
+static switch_bool_t dialer_set_agents( const char *name_or_uuid, int agents );
+static switch_bool_t dialer_definitions_load( void );
+static void dialer_reloadxml_handler( switch_event_t *event );
+static const char **dialer_definition_get( const char *name, switch_memory_pool_t *pool, switch_bool_t *complete );
+static switch_bool_t dialer_set_param( const char *name_or_uuid, const char *name, const char *value, switch_stream_handle_t *stream );
+static switch_bool_t dialer_release_numbers( struct db_campaign_config *campaign, const struct dialer_destination *destinations, int count );
 static switch_bool_t dialer_delete_campaign( const char * campaign_to_delete );
-static char * dialer_get_event_header( switch_event_t *event, const char * header_name );
-static switch_bool_t dialer_delete_all_campaigns();
 
 void randnorm_init(struct randnorm_state* rs, unsigned int seed);
 static float randnorm_r(struct randnorm_state* rs, float mean, float stddev);
 
-static switch_bool_t dialer_set_number_inuse( int campaign_index, const char *number, const char * status );
-static switch_bool_t dialer_increment_number_calls( int campaign_index, const char *number );
+static char *dialer_sql_in_list( const char *head, const char *numbers, switch_size_t stride, int count );
+static switch_bool_t dialer_execute_sql( char *sql );
+static void dialer_db_number_called( struct db_campaign_config *campaign, uint32_t id, const char *number );
+static void dialer_db_number_released( struct db_campaign_config *campaign, uint32_t id, const char *number );
+static void dialer_db_number_retried( struct db_campaign_config *campaign, uint32_t id, const char *number );
+static switch_bool_t dialer_retry_schedule( struct db_campaign_config *campaign, const struct dialer_destination *destination );
+static void dialer_wheel_insert( struct dialer_timing_wheel *wheel, struct dialer_retry *retry );
+static void dialer_wheel_advance( struct dialer_timing_wheel *wheel, uint64_t tick );
+static uint64_t dialer_wheel_next( struct dialer_timing_wheel *wheel );
+static int dialer_wheel_drain( struct dialer_timing_wheel *wheel, struct dialer_destination *destinations, int max );
+static uint32_t dialer_wheel_copy( struct dialer_timing_wheel *wheel, struct dialer_checkpoint_retry *retries, uint32_t max );
+static void dialer_checkpoint_save( struct db_campaign_config *campaign, switch_bool_t with_retries );
+static struct dialer_checkpoint *dialer_checkpoint_load( const char *name );
+static void dialer_checkpoint_restore( struct db_campaign_config *campaign );
+static switch_bool_t dialer_resume_campaign( const char *name, switch_stream_handle_t *stream );
+static void dialer_db_flush( struct db_campaign_config *campaign );
+static switch_bool_t dialer_start_db_writer(void);
+static void dialer_stop_db_writer(void);
+static void dialer_journal_open( struct db_campaign_config *campaign );
+static void dialer_journal_close( struct db_campaign_config *campaign );
+static void dialer_journal_append( struct db_campaign_config *campaign, const struct dialer_dial_job *dial_job, int seconds );
+static void dialer_journal_compact( struct db_campaign_config *campaign );
+static switch_bool_t dialer_start_lease_thread(void);
+static void dialer_stop_lease_thread(void);
 
 static switch_bool_t dialer_stop_campaign( const char * campaign_to_stop );
 static switch_cache_db_handle_t *dialer_get_db_handle(void);
+static switch_bool_t dialer_check_destinations_table( const char *table );
+static switch_bool_t dialer_load_start( const char *campaign, const char *path, switch_stream_handle_t *stream );
+static void dialer_load_list( switch_stream_handle_t *stream );
+static switch_bool_t dialer_load_running( const char *table );
+static switch_bool_t dialer_file_open( struct db_campaign_config *campaign );
+static void dialer_file_close( struct dialer_file_source *file );
+static int dialer_file_lease( struct db_campaign_config *campaign, struct dialer_destination *destinations, int max );
+static void dialer_file_update( struct db_campaign_config *campaign, uint32_t id, dialer_db_op_type_t type );
+static void dialer_file_release( struct db_campaign_config *campaign, const struct dialer_destination *destinations, int count );
+static const struct dialer_sql_dialect *dialer_sql_dialect_select( const char *name );
+static const char *dialer_sql_time( char *buf, switch_size_t len, int seconds );
 static switch_bool_t dialer_execute_sql_callback( switch_mutex_t *mutex, char *sql, switch_core_db_callback_func_t callback, void *pdata);
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_dialer_shutdown);
 SWITCH_MODULE_RUNTIME_FUNCTION(mod_dialer_runtime);
 SWITCH_MODULE_LOAD_FUNCTION(mod_dialer_load);
 
-char destinations_sql[512];
+/* MySQL (ODBC) */
 char destinations_sql_format[] = "CREATE TABLE %s (\n"
                                  "   number	     VARCHAR(30) NOT NULL  PRIMARY KEY,\n"
+                                 "   id          INT UNSIGNED NOT NULL AUTO_INCREMENT UNIQUE,\n"
                                  "   lastcall	     DATETIME,\n"
                                  "   lastresult     VARCHAR(30),\n"
                                  "   calls	     INT,\n"
                                  "   in_use		 INT,\n"
                                  "   duration    INT,\n"
                                  "   callerid    VARCHAR(25) NULL DEFAULT NULL,\n"
-                                 "INDEX by_last_called (lastcall)\n"
+                                 "   lease_owner   VARCHAR(64) NULL DEFAULT NULL,\n"
+                                 "   lease_expires DATETIME NULL DEFAULT NULL,\n"
+                                 "INDEX by_last_called (lastcall),\n"
+                                 "INDEX by_lease_owner (lease_owner),\n"
+                                 "INDEX by_lease_expires (lease_expires)\n"
                                  ") Engine=MyISAM ;\n";
 
-char destinations_check_sql[100];
+/* SQLite: the row id is the table's rowid, the number stays unique */
+char destinations_sqlite_format[] = "CREATE TABLE %s (\n"
+                                    "   id          INTEGER PRIMARY KEY,\n"
+                                    "   number      VARCHAR(30) NOT NULL UNIQUE,\n"
+                                    "   lastcall    DATETIME,\n"
+                                    "   lastresult  VARCHAR(30),\n"
+                                    "   calls       INT,\n"
+                                    "   in_use      INT,\n"
+                                    "   duration    INT,\n"
+                                    "   callerid    VARCHAR(25) NULL DEFAULT NULL,\n"
+                                    "   lease_owner   VARCHAR(64) NULL DEFAULT NULL,\n"
+                                    "   lease_expires DATETIME NULL DEFAULT NULL\n"
+                                    ");\n"
+                                    "CREATE INDEX %s_by_last_called ON %s (lastcall);\n"
+                                    "CREATE INDEX %s_by_lease_owner ON %s (lease_owner);\n"
+                                    "CREATE INDEX %s_by_lease_expires ON %s (lease_expires);\n";
+
+/* PostgreSQL */
+char destinations_pgsql_format[] = "CREATE TABLE %s (\n"
+                                   "   number      VARCHAR(30) NOT NULL PRIMARY KEY,\n"
+                                   "   id          SERIAL UNIQUE,\n"
+                                   "   lastcall    TIMESTAMP,\n"
+                                   "   lastresult  VARCHAR(30),\n"
+                                   "   calls       INT,\n"
+                                   "   in_use      INT,\n"
+                                   "   duration    INT,\n"
+                                   "   callerid    VARCHAR(25) NULL DEFAULT NULL,\n"
+                                   "   lease_owner   VARCHAR(64) NULL DEFAULT NULL,\n"
+                                   "   lease_expires TIMESTAMP NULL DEFAULT NULL\n"
+                                   ");\n"
+                                   "CREATE INDEX %s_by_last_called ON %s (lastcall);\n"
+                                   "CREATE INDEX %s_by_lease_owner ON %s (lease_owner);\n"
+                                   "CREATE INDEX %s_by_lease_expires ON %s (lease_expires);\n";
+
 char destinations_check_format[] = "select count(*) from %s;";
 
-char destinations_delete_sql[100];
+/* Tables created before the dense row id was introduced get the column added */
+char destinations_id_check_format[] = "select id from %s limit 1;";
+char destinations_id_format[] = "ALTER TABLE %s ADD id INT UNSIGNED NOT NULL AUTO_INCREMENT UNIQUE;";
+char destinations_lease_check_format[] = "select lease_owner, lease_expires from %s limit 1;";
+char destinations_lease_format[] = "ALTER TABLE %s ADD lease_owner VARCHAR(64) NULL DEFAULT NULL, ADD lease_expires DATETIME NULL DEFAULT NULL, "
+                                   "ADD INDEX by_lease_owner (lease_owner), ADD INDEX by_lease_expires (lease_expires);";
+
+/* Where each campaign is in its destination_list, so that a restarted campaign carries on from there */
+char campaign_state_sql[] = "CREATE TABLE dialer_campaign_state (\n"
+                            "   campaign    VARCHAR(50) NOT NULL  PRIMARY KEY,\n"
+                            "   last_number VARCHAR(30),\n"
+                            "   updated     DATETIME\n"
+                            ");\n";
+char campaign_state_pgsql[] = "CREATE TABLE dialer_campaign_state (\n"
+                              "   campaign    VARCHAR(50) NOT NULL  PRIMARY KEY,\n"
+                              "   last_number VARCHAR(30),\n"
+                              "   updated     TIMESTAMP\n"
+                              ");\n";
+char campaign_state_check_sql[] = "select count(*) from dialer_campaign_state;";
+
+static const struct dialer_sql_dialect dialer_sql_dialects[] = {
+    {
+        "mysql", destinations_sql_format, destinations_id_format, destinations_lease_format, campaign_state_sql,
+        "NOW()", "NOW() + INTERVAL %d SECOND",
+        "replace into dialer_campaign_state (campaign, last_number, updated) values ('%q', '%q', NOW())",
+        "insert ignore into", "",
+        SWITCH_TRUE, "", NULL
+    },
+    {
+        /* WAL lets the refill thread read while the DB writer commits */
+        "sqlite", destinations_sqlite_format, NULL, NULL, campaign_state_sql,
+        "datetime('now')", "datetime('now', '%d seconds')",
+        "replace into dialer_campaign_state (campaign, last_number, updated) values ('%q', '%q', datetime('now'))",
+        "insert or ignore into", "",
+        /* one writer at a time, the claim can't interleave with another one */
+        SWITCH_FALSE, "", "PRAGMA journal_mode=WAL;"
+    },
+    {
+        "pgsql", destinations_pgsql_format, NULL, NULL, campaign_state_pgsql,
+        "NOW()", "NOW() + INTERVAL '%d seconds'",
+        "insert into dialer_campaign_state (campaign, last_number, updated) values ('%q', '%q', NOW()) "
+        "on conflict (campaign) do update set last_number = excluded.last_number, updated = excluded.updated",
+        "insert into", " on conflict do nothing",
+        /* rows another node is claiming are left to it, and one it claimed since our snapshot fails the recheck */
+        SWITCH_FALSE, " for update skip locked", NULL
+    }
+};
+
 char destinations_delete_format[] = "drop table %s;";
 
 
@@ -161,485 +985,1054 @@ char destinations_delete_format[] = "drop table %s;";
  */
 SWITCH_MODULE_DEFINITION(mod_dialer, mod_dialer_load, mod_dialer_shutdown, NULL);
 
-static void *SWITCH_THREAD_FUNC dialer_start_campaign(switch_thread_t *thread, void *obj)
-{
-    int campaign_index = (intptr_t) obj;
-    struct db_campaign_config *job = &globals.campaigns[ campaign_index ];
-    switch_memory_pool_t *pool;
-    switch_bool_t campaign_found = SWITCH_FALSE;
-
-    /* Campaign-related vars */
-    switch_xml_t xml = NULL, cfg = NULL, x_campaigns = NULL, param = NULL, x_campaign = NULL;
-    int params_set = 0;
-    switch_cache_db_handle_t *dbh = NULL;
-
-    /* sql stuff */
-    char sql[1024];
-    int rows_affected;
-
-
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: start_camapign received index %d\n", campaign_index );
-    pool = job->pool;
-
-    /* We must lock the campaign */
-    switch_mutex_lock(globals.mutex);
-    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
-
-
-    job->running = 1;
-
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Attempting to load campaign %s\n", job->campaign_requested );
-
-    /* Try and load the cammpaign's from xml config file - Start */
+/* Installed on the channels we originate only, so that we never see anybody else's calls */
+static switch_state_handler_table_t dialer_state_handlers = {
+    /*.on_init */ NULL,
+    /*.on_routing */ NULL,
+    /*.on_execute */ NULL,
+    /*.on_hangup */ NULL,
+    /*.on_exchange_media */ NULL,
+    /*.on_soft_execute */ NULL,
+    /*.on_consume_media */ NULL,
+    /*.on_hibernate */ NULL,
+    /*.on_reset */ NULL,
+    /*.on_park */ NULL,
+    /*.on_reporting */ dialer_on_reporting,
+    /*.on_destroy */ NULL
+};
 
-    if (!(xml = switch_xml_open_cfg(global_cf, &cfg, NULL))) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't load config file\n" );
-        goto end;
+static switch_bool_t dialer_param_calling_strategy( struct db_campaign_config *campaign, const char *value )
+{
+    if ( !strcmp( value, "random" ) ) {
+        campaign->calling_strategy = RANDOM;
+    } else if ( !strcmp( value, "sequential" ) ) {
+        campaign->calling_strategy = SEQUENTIAL;
     } else {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Opened XML config file\n" );
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown calling_strategy value: <%s>, must be <random> or <sequential>\n", value );
+        return SWITCH_FALSE;
     }
+    return SWITCH_TRUE;
+}
 
-    if ( !(x_campaigns = switch_xml_child(cfg, "campaigns"))) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't find 'campaigns' section, exiting\n" );
-        goto end;
+static switch_bool_t dialer_param_calling_mode( struct db_campaign_config *campaign, const char *value )
+{
+    if ( !strcmp( value, "progressive" ) ) {
+        campaign->calling_mode = PROGRESSIVE;
+    } else if ( !strcmp( value, "predictive" ) ) {
+        campaign->calling_mode = PREDICTIVE;
     } else {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Found 'campaigns' section\n" );
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown calling_mode value: <%s>, must be <progressive> or <predictive>\n", value );
+        return SWITCH_FALSE;
     }
+    return SWITCH_TRUE;
+}
 
-    job->stop = SWITCH_FALSE;
+static switch_bool_t dialer_param_abandon_rate( struct db_campaign_config *campaign, const char *value )
+{
+    campaign->predictive.abandon_target = atof( value ) / 100.0;
+    return SWITCH_TRUE;
+}
 
-    for (x_campaign = switch_xml_child(x_campaigns, "campaign"); x_campaign; x_campaign = x_campaign->next) {
-        const char *campaign_name = switch_xml_attr(x_campaign, "name");
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: in config: %s, requested: %s...\n", campaign_name, job->campaign_requested );
-        if ( strcmp( job->campaign_requested, campaign_name) == 0 ) {
-        	campaign_found = SWITCH_TRUE;
-            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Found Campaign: %s, requested: %s ...\n", campaign_name, job->campaign_requested );
-            strncpy( job->name, campaign_name, sizeof(job->name) );
+static switch_bool_t dialer_param_agent_source( struct db_campaign_config *campaign, const char *value )
+{
+    if ( dialer_agent_source_set( campaign, value ) == SWITCH_FALSE ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown agent_source value: <%s>, must be <static:n>, <api:command args> or <callcenter:queue>\n", value );
+        return SWITCH_FALSE;
+    }
+    return SWITCH_TRUE;
+}
 
-            /* here we will actually load the campaign data, then initialize the db using the campaign's destination_list value */
-            for (param = switch_xml_child(x_campaign, "param"); param; param = param->next) {
-                char *name = (char *) switch_xml_attr_soft(param, "name");
-                char *value = (char *) switch_xml_attr_soft(param, "value");
+static switch_bool_t dialer_param_destination_source( struct db_campaign_config *campaign, const char *value )
+{
+    if ( !strncmp( value, "file:", 5 ) && !zstr( value + 5 ) ) {
+        campaign->file = switch_core_alloc( campaign->pool, sizeof( struct dialer_file_source ) );
+        switch_copy_string( campaign->file->path, value + 5, sizeof( campaign->file->path ) );
+        campaign->file->fd = -1;
+        campaign->file->state_fd = -1;
+    } else if ( strcmp( value, "db" ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown destination_source value: <%s>, must be <db> or <file:/path/to/numbers>\n", value );
+        return SWITCH_FALSE;
+    }
+    return SWITCH_TRUE;
+}
 
+/*!\brief profile/gateway: a gateway, or a comma separated list of <name>[:<weight>[:<max_calls>[:<cps>]]]. Weight defaults to 1,
+ * max_calls and cps to 0, no limit
+ */
+static switch_bool_t dialer_param_gateways( struct db_campaign_config *campaign, const char *value )
+{
+    char *list = switch_core_strdup( campaign->pool, value );
+    char *entries[DIALER_MAX_ROUTES + 1] = { 0 };
+    char *fields[4];
+    struct dialer_route *routes, *route;
+    char *name, *end;
+    int count, n;
+    double cps;
+
+    if ( ( count = switch_separate_string( list, ',', entries, DIALER_MAX_ROUTES + 1 ) ) > DIALER_MAX_ROUTES ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: profile/gateway lists more than %d gateways\n", DIALER_MAX_ROUTES );
+        return SWITCH_FALSE;
+    }
+    routes = switch_core_alloc( campaign->pool, sizeof( struct dialer_route ) * switch_max( count, 1 ) );
 
-                // Ignore empty/missing attributes
-                if (switch_strlen_zero(name)) {
-                    continue;
-                }
+    for ( int i=0; i<count; i++ ) {
+        route = &routes[i];
+        memset( fields, 0, sizeof( fields ) );
+        n = switch_separate_string( entries[i], ':', fields, 4 );
+        for ( name = fields[0]; name && *name == ' '; name++ );
+        for ( end = name ? name + strlen( name ) : NULL; end && end > name && end[-1] == ' '; *--end = '\0' );
 
-                if (!strcmp(name, "datetime_start")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: datetime_start is: %s\n", value );
-                    strncpy( job->datetime_start, value, sizeof(job->datetime_start) );
-                    params_set++;
-                } else if  (!strcmp(name, "context")) {
-                    strncpy( job->context, value, sizeof(job->context) );
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: context is: %s (%s)\n", value, job->context );
-                    params_set++;
-                } else if  (!strcmp(name, "max_concurrent_calls")) {
-                    job->max_concurrent_calls = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: max_concurrent_calls is: %i\n", job->max_concurrent_calls);
-                    params_set++;
-                } else if  (!strcmp(name, "add_custom_header_name")) {
-                    strncpy( job->custom_header_name, value, sizeof(job->custom_header_name) );
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: add_custom_header_value is: %s\n", job->custom_header_name);
-                    params_set++;
-                } else if  (!strcmp(name, "add_custom_header_value")) {
-                    strncpy( job->custom_header_value, value, sizeof(job->custom_header_value) );
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: add_custom_header_value is: %s\n", job->custom_header_value);
-                    params_set++;
-                } else if  (!strcmp(name, "time_between_calls")) {
-                    job->time_between_calls = atol(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: time_between_calls is: %lu\n", job->time_between_calls);
-                    params_set++;
-                } else if  (!strcmp(name, "attempts_per_number")) {
-                    job->attempts_per_number = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: attempts_per_number is: %i\n", job->attempts_per_number);
-                    params_set++;
-                } else if  (!strcmp(name, "time_between_retries")) {
-                    job->time_between_retries = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: time_between_retries is: %i\n", job->time_between_retries);
-                    params_set++;
-                } else if  (!strcmp(name, "gaussian_distribution")) {
-                    job->gaussian_distribution = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gaussian_distribution is: %i\n", job->gaussian_distribution);
-                    params_set++;
-                } else if  (!strcmp(name, "gaussian_distribution_mean")) {
-                    job->gaussian_distribution_mean = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gaussian_distribution_mean is: %i\n", job->gaussian_distribution_mean);
-                    params_set++;
-                } else if  (!strcmp(name, "gaussian_distribution_stdv")) {
-                    job->gaussian_distribution_stdv = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gaussian_distribution_stdv is: %i\n", job->gaussian_distribution_stdv);
-                    params_set++;
-                } else if  (!strcmp(name, "call_max_duration")) {
-                    job->call_max_duration = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: call_max_duration is: %i\n", job->call_max_duration);
-                    params_set++;
-                } else if  (!strcmp(name, "call_min_duration")) {
-                    job->call_min_duration = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: call_min_duration is: %i\n", job->call_min_duration);
-                    params_set++;
-                } else if  (!strcmp(name, "originate_timeout")) {
-                    job->originate_timeout = atoi(value);
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: originate_timeout is: %i\n", job->originate_timeout);
-                    params_set++;
-                } else if  (!strcmp(name, "global_caller_id")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: global_caller_id is: %s\n", value );
-                    strncpy( job->global_caller_id, value, sizeof(job->global_caller_id) );
-                    params_set++;
-                } else if  (!strcmp(name, "action_on_anwser")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: action_on_anwser is: %s\n", value );
-                    strncpy( job->action_on_anwser, value, sizeof(job->action_on_anwser) );
-                    params_set++;
-                } else if  (!strcmp(name, "destination_list")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: destination_list is: %s\n", value );
-                    strncpy( job->destination_list, value, sizeof(job->destination_list) );
-                    params_set++;
-                } else if  (!strcmp(name, "codec_list")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: codec_list is: %s\n", value );
-                    strncpy( job->codec_list, value, sizeof(job->codec_list) );
-                    params_set++;
-                } else if  (!strcmp(name, "profile/gateway")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: profile/gateway: %s\n", value );
-                    strncpy( job->profile_gateway, value, sizeof(job->profile_gateway) );
-                    params_set++;
-                } else if  (!strcmp(name, "dialplan_type")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: dialplan_type: %s\n", value );
-                    strncpy( job->dialplan_type, value, sizeof(job->dialplan_type) );
-                    params_set++;
-                } else if  (!strcmp(name, "transfer_on_answer")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: transfer_on_answer: %s\n", value );
-                    strncpy( job->transfer_on_answer, value, sizeof(job->transfer_on_answer) );
-                    params_set++;
-                } else if  (!strcmp(name, "finish_on")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: finish_on: %s\n", value );
-                    job->finish_on = atoi(value);
-                    params_set++;
-                } else if  (!strcmp(name, "custom_header_name")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: custom_header_name: %s\n", value );
-                    strncpy( job->custom_header_name, value, sizeof(job->custom_header_name) );
-                    params_set++;
-                } else if  (!strcmp(name, "custom_header_value")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: custom_header_value: %s\n", value );
-                    strncpy( job->custom_header_value, value, sizeof(job->custom_header_value) );
-                    params_set++;
-                } else if  (!strcmp(name, "cancel_ratio")) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: cancel_ratio: %s\n", value );
-                    job->cancel_ratio = atoi(value);
-                    params_set++;
-                } else if ( !strcmp(name, "calling_strategy") ) {
-                    if ( !strcmp(value, "random") ) {
-                        job->calling_strategy = RANDOM;
-                        params_set++;
-                    } else  if ( !strcmp(value, "sequential") ) {
-                        job->calling_strategy = SEQUENTIAL;
-                        params_set++;
-                    } else {
-                        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown calling_strategy value: <%s>, must be <random> or <sequential>\n", value );
-                        goto end;
-                    }
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: calling_strategy: %i (1=random/2=sequential)\n", job->calling_strategy);
-                }
-                else
-                {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown attribute '%s' found in campaign '%s'\n", name, job->campaign_requested);
-                }
+        if ( zstr( name ) || ( route->weight = n > 1 ? atoi( fields[1] ) : 1 ) <= 0 ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: bad gateway <%s> in profile/gateway, must be <name>[:<weight>[:<max_calls>[:<cps>]]] with a weight over 0\n", value );
+            return SWITCH_FALSE;
+        }
+        route->gateway = dialer_gateway_get( name );
+        route->max_calls = n > 2 ? atoi( fields[2] ) : 0;
+        cps = n > 3 ? atof( fields[3] ) : 0;
+        dialer_bucket_init( &route->bucket, cps, 1, campaign->pool );
+        route->dial_tail = switch_core_sprintf( campaign->pool, "}sofia/gateway/%s/", name );
+    }
+    if ( count == 0 ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: profile/gateway is empty\n" );
+        return SWITCH_FALSE;
+    }
 
-            }
-            if ( params_set != 24 ) {
-                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't find all parameters for campaign %s\n", campaign_name );
-                goto end;
-            }
+    switch_copy_string( campaign->profile_gateway, value, sizeof( campaign->profile_gateway ) );
+    campaign->routes = routes;
+    /* `dialer metrics` may be walking the routes already */
+    dialer_memory_barrier();
+    campaign->route_count = count;
+    return SWITCH_TRUE;
+}
 
+#define DIALER_PARAM_FIELD(field) offsetof( struct db_campaign_config, field ), sizeof( ( (struct db_campaign_config *) 0 )->field )
 
-            job->current_calls = 0;
-            job->calls_made = 0;
-            job->answered = 0;
+/*
+ * Every parameter a <campaign> takes. Entries sharing a field are aliases of each other, a required field is set by
+ * any of them. `dialer set` only accepts the DIALER_PARAM_LIVE ones
+ */
+static const struct dialer_param dialer_params[] = {
+    { "datetime_start", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( datetime_start ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "context", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( context ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "max_concurrent_calls", DIALER_PARAM_INT, DIALER_PARAM_FIELD( max_concurrent_calls ), DIALER_PARAM_REQUIRED | DIALER_PARAM_LIVE, NULL, NULL },
+    { "add_custom_header_name", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( custom_header_name ), 0, NULL, NULL },
+    { "add_custom_header_value", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( custom_header_value ), 0, NULL, NULL },
+    { "time_between_calls", DIALER_PARAM_ULONG, DIALER_PARAM_FIELD( time_between_calls ), DIALER_PARAM_REQUIRED | DIALER_PARAM_LIVE, NULL, NULL },
+    { "attempts_per_number", DIALER_PARAM_INT, DIALER_PARAM_FIELD( attempts_per_number ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "time_between_retries", DIALER_PARAM_INT, DIALER_PARAM_FIELD( time_between_retries ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "gaussian_distribution", DIALER_PARAM_INT, DIALER_PARAM_FIELD( gaussian_distribution ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "gaussian_distribution_mean", DIALER_PARAM_INT, DIALER_PARAM_FIELD( gaussian_distribution_mean ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "gaussian_distribution_stdv", DIALER_PARAM_INT, DIALER_PARAM_FIELD( gaussian_distribution_stdv ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "call_max_duration", DIALER_PARAM_INT, DIALER_PARAM_FIELD( call_max_duration ), DIALER_PARAM_REQUIRED | DIALER_PARAM_LIVE, NULL, NULL },
+    { "call_min_duration", DIALER_PARAM_INT, DIALER_PARAM_FIELD( call_min_duration ), DIALER_PARAM_REQUIRED | DIALER_PARAM_LIVE, NULL, NULL },
+    { "originate_timeout", DIALER_PARAM_INT, DIALER_PARAM_FIELD( originate_timeout ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "global_caller_id", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( global_caller_id ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "action_on_anwser", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( action_on_anwser ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "destination_list", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( destination_list ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "codec_list", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( codec_list ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "profile/gateway", DIALER_PARAM_CUSTOM, DIALER_PARAM_FIELD( profile_gateway ), DIALER_PARAM_REQUIRED, NULL, dialer_param_gateways },
+    { "dialplan_type", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( dialplan_type ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "transfer_on_answer", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( transfer_on_answer ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "finish_on", DIALER_PARAM_INT, DIALER_PARAM_FIELD( finish_on ), DIALER_PARAM_REQUIRED | DIALER_PARAM_LIVE, NULL, NULL },
+    { "custom_header_name", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( custom_header_name ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "custom_header_value", DIALER_PARAM_STRING, DIALER_PARAM_FIELD( custom_header_value ), DIALER_PARAM_REQUIRED, NULL, NULL },
+    { "cancel_ratio", DIALER_PARAM_INT, DIALER_PARAM_FIELD( cancel_ratio ), DIALER_PARAM_REQUIRED | DIALER_PARAM_LIVE, NULL, NULL },
+    { "calling_strategy", DIALER_PARAM_CUSTOM, DIALER_PARAM_FIELD( calling_strategy ), DIALER_PARAM_REQUIRED, NULL, dialer_param_calling_strategy },
+    /* optional */
+    { "destination_source", DIALER_PARAM_CUSTOM, DIALER_PARAM_FIELD( file ), 0, NULL, dialer_param_destination_source },
+    { "lease_batch_size", DIALER_PARAM_INT, DIALER_PARAM_FIELD( lease_batch_size ), 0, DIALER_STR( DEFAULT_LEASE_BATCH_SIZE ), NULL },
+    { "queue_low_watermark", DIALER_PARAM_INT, DIALER_PARAM_FIELD( queue_low_watermark ), 0, DIALER_STR( DEFAULT_QUEUE_LOW_WATERMARK ), NULL },
+    { "queue_high_watermark", DIALER_PARAM_INT, DIALER_PARAM_FIELD( queue_high_watermark ), 0, DIALER_STR( DEFAULT_QUEUE_HIGH_WATERMARK ), NULL },
+    { "cps", DIALER_PARAM_DOUBLE, DIALER_PARAM_FIELD( cps ), DIALER_PARAM_LIVE, "0", NULL },
+    { "cps_burst", DIALER_PARAM_DOUBLE, DIALER_PARAM_FIELD( cps_burst ), DIALER_PARAM_LIVE, "1", NULL },
+    { "max_inflight_originates", DIALER_PARAM_INT, DIALER_PARAM_FIELD( max_inflight_originates ), DIALER_PARAM_LIVE, "0", NULL },
+    { "calling_mode", DIALER_PARAM_CUSTOM, DIALER_PARAM_FIELD( calling_mode ), 0, "progressive", dialer_param_calling_mode },
+    { "abandon_rate", DIALER_PARAM_CUSTOM, DIALER_PARAM_FIELD( predictive.abandon_target ), DIALER_PARAM_LIVE, DIALER_STR( DEFAULT_ABANDON_RATE ), dialer_param_abandon_rate },
+    { "agent_source", DIALER_PARAM_CUSTOM, DIALER_PARAM_FIELD( predictive.source ), 0, NULL, dialer_param_agent_source },
+    { "random_seed", DIALER_PARAM_INT, DIALER_PARAM_FIELD( random_seed ), 0, "0", NULL },
+    { "gateways", DIALER_PARAM_CUSTOM, DIALER_PARAM_FIELD( profile_gateway ), 0, NULL, dialer_param_gateways },
+    { "gateway_failover", DIALER_PARAM_INT, DIALER_PARAM_FIELD( gateway_failover ), 0, "1", NULL }
+};
 
-            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Done loading campaign %s, parameters set: %d\n", job->name, params_set );
+#define DIALER_PARAM_COUNT ( (int) ( sizeof( dialer_params ) / sizeof( dialer_params[0] ) ) )
 
+static int dialer_param_find( const char *name )
+{
+    for ( int i=0; i<DIALER_PARAM_COUNT; i++ ) {
+        if ( !strcmp( dialer_params[i].name, name ) ) {
+            return i;
         }
     }
-    
-    if ( campaign_found == SWITCH_FALSE ) {
-    	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Campaign '%s' not found\n", job->campaign_requested );
-    	job->running = SWITCH_FALSE;
-    	dialer_delete_campaign( job->campaign_requested );
-    	goto end;
+    return -1;
+}
+
+/*!\brief Store `value` in the campaign field of `param`
+ */
+static switch_bool_t dialer_param_apply( struct db_campaign_config *campaign, const struct dialer_param *param, const char *value )
+{
+    char *field = (char *) campaign + param->offset;
+
+    switch ( param->type ) {
+    case DIALER_PARAM_INT:
+        *(int *) field = atoi( value );
+        break;
+    case DIALER_PARAM_ULONG:
+        *(unsigned long int *) field = strtoul( value, NULL, 10 );
+        break;
+    case DIALER_PARAM_DOUBLE:
+        *(double *) field = atof( value );
+        break;
+    case DIALER_PARAM_STRING:
+        switch_copy_string( field, value, param->size );
+        break;
+    case DIALER_PARAM_CUSTOM:
+        if ( param->set( campaign, value ) == SWITCH_FALSE ) {
+            return SWITCH_FALSE;
+        }
+        break;
     }
 
-    /* Try and load the campaign's from xml config file - End */
-    
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: %s is: %s\n", param->name, value );
+    return SWITCH_TRUE;
+}
 
-    /* Initialize database and check if destinations table exists, else create the table */
-    if (!(dbh = dialer_get_db_handle())) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Cannot open DB!\n" );
-        goto end;
-    } else {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Connected to db!\n" );
-        sprintf(destinations_sql, destinations_sql_format,  job->destination_list);
-        sprintf(destinations_check_sql, destinations_check_format,  job->destination_list);
-        sprintf(destinations_delete_sql, destinations_delete_format,  job->destination_list);
+/*!\brief Does the definition set every required field? A file destination_source stands in for the destination_list
+ */
+static switch_bool_t dialer_definition_check( struct dialer_campaign_def *def )
+{
+    const char *source = def->values[ dialer_param_find( "destination_source" ) ];
+    switch_bool_t complete = SWITCH_TRUE;
+    int i, j;
 
-        if ( !(switch_cache_db_test_reactive(dbh, destinations_check_sql, destinations_delete_sql, destinations_sql)))
-        {
-            goto end;
-        } else {
-            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: destinations table looks good\n" );
+    for ( i = 0; i < DIALER_PARAM_COUNT; i++ ) {
+        if ( !( dialer_params[i].flags & DIALER_PARAM_REQUIRED ) ) {
+            continue;
+        }
+        if ( !strcmp( dialer_params[i].name, "destination_list" ) && source && !strncmp( source, "file:", 5 ) ) {
+            continue;
+        }
+        for ( j = 0; j < DIALER_PARAM_COUNT && !( def->values[j] && dialer_params[j].offset == dialer_params[i].offset ); j++ );
+        if ( j == DIALER_PARAM_COUNT ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: campaign %s doesn't set %s\n", def->name, dialer_params[i].name );
+            complete = SWITCH_FALSE;
         }
-        switch_cache_db_release_db_handle(&dbh);
     }
+    return complete;
+}
 
-    /* Finish loading the config */
+/*!\brief Parse every <campaign> of dialer.conf into the definitions table, replacing the previous one. Runs at load and on reloadxml,
+ * campaigns that are already running keep the definition they were started with
+ */
+static switch_bool_t dialer_definitions_load( void )
+{
+    switch_xml_t xml = NULL, cfg = NULL, x_campaigns = NULL, x_campaign = NULL, param = NULL;
+    switch_memory_pool_t *pool = NULL, *old_pool = NULL;
+    switch_hash_t *definitions = NULL, *old_definitions = NULL;
+    struct dialer_campaign_def *def;
+    int count = 0, i;
 
-    if (!(dbh = dialer_get_db_handle())) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Cannot open DB!\n" );
-        goto end;
+    if ( !( xml = switch_xml_open_cfg( global_cf, &cfg, NULL ) ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't load config file\n" );
+        return SWITCH_FALSE;
     }
 
-    sprintf(sql, "select * from %s where in_use = 0 and calls < %d and ( time_to_sec( timediff ( now(), lastcall) ) > %d  or lastcall is NULL ) order by rand() LIMIT 1", job->destination_list, job->attempts_per_number, job->time_between_retries );
-    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: SQL: %s\n", sql );
-    switch_mutex_unlock(globals.mutex);
-    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
+    switch_core_new_memory_pool( &pool );
+    switch_core_hash_init( &definitions );
 
+    if ( ( x_campaigns = switch_xml_child( cfg, "campaigns" ) ) ) {
+        for ( x_campaign = switch_xml_child( x_campaigns, "campaign" ); x_campaign; x_campaign = x_campaign->next ) {
+            const char *campaign_name = switch_xml_attr_soft( x_campaign, "name" );
 
-    while ( job->stop == SWITCH_FALSE ) {
-		//switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: curr: %d - max: %d\n", job->current_calls, job->max_concurrent_calls );
+            if ( zstr( campaign_name ) ) {
+                continue;
+            }
 
-    	while( job->current_calls < job->max_concurrent_calls && job->stop == SWITCH_FALSE ) {
-			switch_mutex_lock(globals.mutex);
-            //switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
+            def = switch_core_alloc( pool, sizeof( struct dialer_campaign_def ) );
+            switch_copy_string( def->name, campaign_name, sizeof( def->name ) );
+            def->values = switch_core_alloc( pool, sizeof( const char * ) * DIALER_PARAM_COUNT );
 
-			if( job->finish_on > 0 && globals.campaigns[ campaign_index ].calls_made >= job->finish_on ) {
-	            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: we've reached the amount of calls (%d) stopping now\n", job->finish_on );
-				job->stop = SWITCH_TRUE;
-			}
+            for ( param = switch_xml_child( x_campaign, "param" ); param; param = param->next ) {
+                const char *name = switch_xml_attr_soft( param, "name" );
 
-			//switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Getting next number (%lu secs)...\n", job->time_between_calls );
-			if( dialer_execute_sql_callback( NULL, sql, dialer_dests_callback, job->uuid_str ) == SWITCH_FALSE ) {
-				goto end;
-			}
-			rows_affected = switch_cache_db_affected_rows( dbh );
-
-			/* Make sure we're getting something from the table */
-			if ( rows_affected == 0 ) {
-				dialer_show_campaigns( job->name );
-				dialer_clear_struct_slot( campaign_index );
-				switch_mutex_unlock( globals.mutex );
-				switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: We got 0 (ZERO) rows from the table, maybe it's empty?\n" );
-				goto end;
-			} else {
-				//switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: affected rows: %d\n", rows_affected );
-				switch_mutex_unlock( globals.mutex );
-				switch_yield( job->time_between_calls*1000*1000 );
-			}
+                if ( zstr( name ) ) {
+                    continue;
+                }
+                if ( ( i = dialer_param_find( name ) ) < 0 ) {
+                    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown attribute '%s' found in campaign '%s'\n", name, campaign_name );
+                    continue;
+                }
+                def->values[i] = switch_core_strdup( pool, switch_xml_attr_soft( param, "value" ) );
+            }
+
+            def->complete = dialer_definition_check( def );
+            switch_core_hash_insert( definitions, def->name, def );
+            count++;
         }
-        
-        switch_yield( job->time_between_calls*1000*1000 );
     }
-    
-    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: SOMETHING ENDED THE EXECUTION\n");
-    
-    /* wait for ongoing calls to end */
-	while ( globals.campaigns[campaign_index].current_calls > 0 ) {
-		switch_mutex_unlock(globals.mutex);
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
+    switch_xml_free( xml );
+
+    switch_mutex_lock( globals.definitions_mutex );
+    old_definitions = globals.definitions;
+    old_pool = globals.definitions_pool;
+    globals.definitions = definitions;
+    globals.definitions_pool = pool;
+    switch_mutex_unlock( globals.definitions_mutex );
+
+    if ( old_definitions ) {
+        switch_core_hash_destroy( &old_definitions );
+        switch_core_destroy_memory_pool( &old_pool );
+    }
 
-		switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: stopping: Waiting for ongoing calls to end (campaign %d)\n", campaign_index );
-		switch_yield( 2000000 );
-		switch_mutex_lock(globals.mutex);
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: loaded %d campaign definitions\n", count );
+    return SWITCH_TRUE;
+}
 
-	}        	
+static void dialer_reloadxml_handler( switch_event_t *event )
+{
+    dialer_definitions_load();
+}
 
-	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: exiting from campaign %s\n", job->name );
+/*!\brief Copy the definition of campaign `name` into `pool`, a reload can't pull it from under the caller then
+ * return the values by position in dialer_params, NULL if there is no such campaign
+ */
+static const char **dialer_definition_get( const char *name, switch_memory_pool_t *pool, switch_bool_t *complete )
+{
+    struct dialer_campaign_def *def;
+    const char **values = NULL;
+
+    switch_mutex_lock( globals.definitions_mutex );
+    if ( globals.definitions && ( def = switch_core_hash_find( globals.definitions, name ) ) ) {
+        values = switch_core_alloc( pool, sizeof( const char * ) * DIALER_PARAM_COUNT );
+        for ( int i=0; i<DIALER_PARAM_COUNT; i++ ) {
+            values[i] = def->values[i] ? switch_core_strdup( pool, def->values[i] ) : NULL;
+        }
+        *complete = def->complete;
+    }
+    switch_mutex_unlock( globals.definitions_mutex );
 
-    dialer_show_campaigns( job->name );
-	dialer_clear_struct_slot( campaign_index );
-    switch_mutex_unlock( globals.mutex );
+    return values;
+}
 
+/*!\brief `dialer set <campaign> <param> <value>`: change the pacing or concurrency of a running campaign, it takes effect with the next call
+ */
+static switch_bool_t dialer_set_param( const char *name_or_uuid, const char *name, const char *value, switch_stream_handle_t *stream )
+{
+    struct db_campaign_config *campaign = NULL;
+    int i = dialer_param_find( name );
+    switch_bool_t set;
+    size_t field;
 
-end:
-    /* destroy our thing, be tidy */
-    job = NULL;
-    if (pool) {
-        switch_core_destroy_memory_pool(&pool);
+    if ( i < 0 || !( dialer_params[i].flags & DIALER_PARAM_LIVE ) ) {
+        stream->write_function( stream, "-ERR %s can't be changed on a running campaign\n", name );
+        return SWITCH_FALSE;
     }
-    pool = NULL;
-    if (xml) {
-        switch_xml_free(xml);
+    field = dialer_params[i].offset;
+    if ( !( campaign = dialer_campaign_find( name_or_uuid ) ) || !campaign->queue_mutex ) {
+        stream->write_function( stream, "-ERR campaign %s isn't running\n", name_or_uuid );
+        if ( campaign ) {
+            dialer_campaign_release( campaign );
+        }
+        return SWITCH_FALSE;
     }
 
-	globals.campaigns[campaign_index].campaign_requested[0] = '\0';
-    globals.campaigns[campaign_index].running = SWITCH_FALSE;
-    switch_mutex_unlock(globals.mutex);
-    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKED globals.mutex and set running to SWITCH_FALSE\n");
+    switch_mutex_lock( campaign->mutex );
+    if ( ( set = dialer_param_apply( campaign, &dialer_params[i], value ) ) == SWITCH_TRUE &&
+         ( field == offsetof( struct db_campaign_config, cps ) || field == offsetof( struct db_campaign_config, cps_burst ) || field == offsetof( struct db_campaign_config, time_between_calls ) ) ) {
+        if ( field == offsetof( struct db_campaign_config, time_between_calls ) ) {
+            campaign->cps = campaign->time_between_calls > 0 ? 1.0 / campaign->time_between_calls : 0;
+        } else if ( campaign->cps <= 0 && campaign->time_between_calls > 0 ) {
+            /* like at start, no cps means pacing by time_between_calls */
+            campaign->cps = 1.0 / campaign->time_between_calls;
+        }
+        /* a new limit, not a new burst of calls: the tokens saved up so far are kept */
+        dialer_bucket_set_limit( &campaign->bucket, campaign->cps, campaign->cps_burst );
+    }
+    switch_mutex_unlock( campaign->mutex );
 
-    return NULL;
+    if ( set == SWITCH_TRUE ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "dialer: campaign %s %s set to %s\n", campaign->name, name, value );
+        stream->write_function( stream, "+OK\n" );
+    } else {
+        stream->write_function( stream, "-ERR bad value for %s: %s\n", name, value );
+    }
+    dialer_campaign_release( campaign );
+    return set;
 }
 
-static void dialer_show_campaigns( const char * campaign )
+static void *SWITCH_THREAD_FUNC dialer_start_campaign(switch_thread_t *thread, void *obj)
 {
-    int campaign_index;
-	switch_mutex_lock( globals.mutex );
-    
-    if ( !(strcmp( campaign , "all" ) ) ) {
-        campaign_index = -1;
-    } else {
-        campaign_index = dialer_get_campaign_by_name( campaign );
-        if ( campaign_index == -1 ) {
-            return;
+    struct db_campaign_config *job = (struct db_campaign_config *) obj;
+    const char **values = NULL;
+    switch_bool_t complete = SWITCH_FALSE;
+
+    /* destinations */
+    struct dialer_destination destination;
+    struct dialer_route *route = NULL;
+    switch_status_t pop_status;
+
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: start_camapign received campaign %s (%s)\n", job->campaign_requested, job->uuid_str );
+
+    /* the campaign is ours until it is unregistered, nobody else touches its config */
+    job->running = 1;
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Attempting to load campaign %s\n", job->campaign_requested );
+
+    /* the definition was parsed at load or on the last reloadxml, we only take a copy of it */
+    job->stop = SWITCH_FALSE;
+
+    if ( !( values = dialer_definition_get( job->campaign_requested, job->pool, &complete ) ) ) {
+    	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Campaign '%s' not found\n", job->campaign_requested );
+    	goto end;
+    }
+    if ( complete == SWITCH_FALSE ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't find all parameters for campaign %s\n", job->campaign_requested );
+        goto end;
+    }
+    switch_copy_string( job->name, job->campaign_requested, sizeof( job->name ) );
+
+    for ( int i=0; i<DIALER_PARAM_COUNT; i++ ) {
+        const char *value = values[i] ? values[i] : dialer_params[i].default_value;
+
+        if ( value && dialer_param_apply( job, &dialer_params[i], value ) == SWITCH_FALSE ) {
+            goto end;
+        }
+    }
+
+    if ( job->lease_batch_size <= 0 ) {
+        job->lease_batch_size = DEFAULT_LEASE_BATCH_SIZE;
+    }
+    if ( job->queue_high_watermark < job->lease_batch_size ) {
+        job->queue_high_watermark = job->lease_batch_size;
+    }
+    if ( job->queue_low_watermark < 0 || job->queue_low_watermark >= job->queue_high_watermark ) {
+        job->queue_low_watermark = job->queue_high_watermark / 2;
+    }
+    if ( job->cps <= 0 && job->time_between_calls > 0 ) {
+        /* no cps given, pace like time_between_calls always did */
+        job->cps = 1.0 / job->time_between_calls;
+    }
+    dialer_bucket_init( &job->bucket, job->cps, job->cps_burst, job->pool );
+
+    if ( job->calling_mode == PREDICTIVE && !job->predictive.source ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: campaign %s is predictive but has no agent_source\n", job->name );
+        goto end;
+    }
+    dialer_predictive_init( job );
+    dialer_dial_template_init( job );
+
+    switch_atomic_set( &job->stats.current_calls, 0 );
+    switch_atomic_set( &job->stats.calls_made, 0 );
+    switch_atomic_set( &job->stats.answered, 0 );
+    switch_atomic_set( &job->stats.total_seconds, 0 );
+
+    if ( job->resume ) {
+        /* only a checkpoint of the same list dialed the same way tells us anything */
+        if ( strcmp( job->resume->source, job->file ? job->file->path : job->destination_list ) || job->resume->calling_strategy != job->calling_strategy ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: the checkpoint of campaign %s is of another list or calling_strategy, starting afresh\n", job->name );
+            switch_safe_free( job->resume );
+        } else {
+            switch_atomic_set( &job->stats.calls_made, job->resume->calls_made );
+            switch_atomic_set( &job->stats.answered, job->resume->answered );
+            switch_atomic_set( &job->stats.total_seconds, job->resume->total_seconds );
+            /* none of those calls is still talking */
+            switch_atomic_set( &job->predictive.answered_done, job->resume->answered );
+        }
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Done loading campaign %s\n", job->name );
+    
+
+    if ( job->file ) {
+        if ( dialer_file_open( job ) == SWITCH_FALSE ) {
+            goto end;
+        }
+    } else if ( dialer_check_destinations_table( job->destination_list ) == SWITCH_FALSE ) {
+        /* Initialize database and check if destinations table exists, else create the table */
+        goto end;
+    }
+
+    /* Finish loading the config */
+
+    dialer_journal_open( job );
+
+    /* From now on numbers are leased in batches by the refill thread, the loop below only pops them from memory */
+    if ( dialer_queue_start( job ) == SWITCH_FALSE ) {
+        goto end;
+    }
+    switch_safe_free( job->resume );
+
+    job->cps_since = switch_micro_time_now();
+    job->cps_calls = switch_atomic_read( &job->stats.calls_made );
+    job->current_cps = 0;
+    job->checkpoint_next = job->cps_since + (switch_time_t) globals.checkpoint_interval * 1000000;
+
+    while ( job->stop == SWITCH_FALSE ) {
+        switch_time_t now = switch_micro_time_now();
+
+        if ( now - job->cps_since >= 1000000 ) {
+            uint32_t calls = switch_atomic_read( &job->stats.calls_made );
+
+            job->current_cps = ( calls - job->cps_calls ) * 1000000.0 / ( now - job->cps_since );
+            job->cps_calls = calls;
+            job->cps_since = now;
+        }
+
+        if ( globals.checkpoint_interval > 0 && now >= job->checkpoint_next ) {
+            dialer_checkpoint_save( job, SWITCH_TRUE );
+            job->checkpoint_next = now + (switch_time_t) globals.checkpoint_interval * 1000000;
+        }
+
+        if ( job->calling_mode == PREDICTIVE ) {
+            dialer_predictive_update( job );
+        }
+
+        /* keep max_concurrent_calls filled, but never with more unanswered originates than allowed (predictive: than the free agents call for)
+         * nor with more calls than the gateways' max_calls add up to */
+        if ( (int) switch_atomic_read( &job->stats.current_calls ) >= job->max_concurrent_calls || dialer_inflight_full( job ) || dialer_routes_full( job ) ||
+             ( job->calling_mode == PREDICTIVE && switch_atomic_read( &job->inflight ) >= switch_atomic_read( &job->predictive.target ) ) ) {
+            switch_yield( DIALER_PACING_POLL );
+            continue;
+        }
+
+        if( job->finish_on > 0 && (int) switch_atomic_read( &job->stats.calls_made ) >= job->finish_on ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: we've reached the amount of calls (%d) stopping now\n", job->finish_on );
+            job->stop = SWITCH_TRUE;
+            break;
+        }
+
+        pop_status = dialer_queue_pop( job, &destination );
+
+        if ( pop_status == SWITCH_STATUS_TIMEOUT ) {
+            /* The refill thread is still leasing, try again */
+            continue;
+        } else if ( pop_status != SWITCH_STATUS_SUCCESS ) {
+            /* Make sure we're getting something from the table */
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: We got 0 (ZERO) rows from the table, maybe it's empty?\n" );
+            job->stop = SWITCH_TRUE;
+            break;
+        }
+
+        /* campaign, gateway and global rate limits, the gateway is the least loaded one that can take the call */
+        if ( !( route = dialer_pace( job ) ) || dialer_dial_destination( job, &destination, route ) == SWITCH_FALSE ) {
+            dialer_release_numbers( job, &destination, 1 );
         }
     }
+
+    /* Give back whatever we leased but didn't dial */
+    dialer_queue_stop( job );
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: SOMETHING ENDED THE EXECUTION\n");
     
-    if ( campaign_index == -1 ) {
-        // We should initialize the comapign_config array inside our global struct
-        for( int i=0; i<MAX_CAMPAIGNS; i++) {
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: ----------------------- Campaign %s -----------------------\n", campaign);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d campaign_requested: <%s>\n", i, globals.campaigns[i].campaign_requested);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d name: <%s>\n", i, globals.campaigns[i].name);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d datetime_start: <%s>\n", i, globals.campaigns[i].datetime_start);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d context: <%s>\n", i, globals.campaigns[i].context);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d running: <%d>\n", i, globals.campaigns[i].running);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d stop: <%d>\n", i, globals.campaigns[i].stop);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d max_concurrent_calls: <%d>\n", i, globals.campaigns[i].max_concurrent_calls);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d time_between_calls: <%lu>\n", i, globals.campaigns[i].time_between_calls);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d attempts_per_number: <%d>\n", i, globals.campaigns[i].attempts_per_number);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d time_between_retries: <%d>\n", i, globals.campaigns[i].time_between_retries);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d gaussian_distribution: <%d>\n", i, globals.campaigns[i].gaussian_distribution );
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d gaussian_distribution_mean: <%d>\n", i, globals.campaigns[i].gaussian_distribution_mean );
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d gaussian_distribution_stdv: <%d>\n", i, globals.campaigns[i].gaussian_distribution_stdv );
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d call_max_duration: <%d>\n", i, globals.campaigns[i].call_max_duration);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d call_min_duration: <%d>\n", i, globals.campaigns[i].call_min_duration);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d originate_timeout: <%d>\n", i, globals.campaigns[i].originate_timeout);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d cancel_ratio: <%d>\n", i, globals.campaigns[i].cancel_ratio);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d global_caller_id: <%s>\n", i, globals.campaigns[i].global_caller_id);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d action_on_anwser: <%s>\n", i, globals.campaigns[i].action_on_anwser);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d transfer_on_anwser: <%s>\n", i, globals.campaigns[i].transfer_on_answer);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d destination_list: <%s>\n", i, globals.campaigns[i].destination_list);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d codec_list: <%s>\n", i, globals.campaigns[i].codec_list);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d profile_gateway: <%s>\n", i, globals.campaigns[i].profile_gateway);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d calling_strategy: <%d>\n", i, globals.campaigns[i].calling_strategy);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d my_local_ip: <%s>\n", i, globals.campaigns[i].my_local_ip);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d uuid_str: <%s>\n", i, globals.campaigns[i].uuid_str);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d current_calls: <%d>\n", i, globals.campaigns[i].current_calls);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d calls_made: <%lu>\n", i, globals.campaigns[i].calls_made);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d answered: <%lu>\n", i, globals.campaigns[i].answered);
-	        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d total_seconds: <%lu>\n", i, globals.campaigns[i].total_seconds);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d finish_on: <%d>\n", i, globals.campaigns[i].finish_on);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d custom_header_name:  <%s>\n", i, globals.campaigns[i].custom_header_name);
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d custom_header_value:  <%s>\n", i, globals.campaigns[i].custom_header_value);
+    /* wait for ongoing calls to end */
+	while ( (int) switch_atomic_read( &job->stats.current_calls ) > 0 || (int) switch_atomic_read( &job->inflight ) > 0 ) {
+		switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: stopping: Waiting for ongoing calls to end (campaign %s)\n", job->campaign_requested );
+		switch_yield( 2000000 );
+	}
+
+	/* the campaign's last releases must hit the table before the campaign can be freed */
+	dialer_db_flush( job );
+
+	/* the final counters, with the retries dialer_queue_stop() saw */
+	dialer_checkpoint_save( job, SWITCH_FALSE );
+
+	/* every call is over: write out the last results and put them in the table */
+	dialer_journal_close( job );
+
+	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: exiting from campaign %s\n", job->name );
+
+    dialer_show_campaign( job );
+
+
+end:
+    dialer_journal_close( job );
+    if ( job->file ) {
+        dialer_file_close( job->file );
+    }
+    switch_safe_free( job->resume );
+    switch_safe_free( job->checkpoint_retries );
+
+    /* the name can be started again right away, the memory goes once the last reference is dropped */
+    job->running = SWITCH_FALSE;
+    dialer_campaign_unregister( job );
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s unregistered\n", job->campaign_requested );
+    dialer_campaign_release( job );
+
+    return NULL;
+}
+
+static void dialer_show_campaign( struct db_campaign_config *campaign )
+{
+    struct dialer_stats_snapshot snapshot;
+
+    dialer_stats_snapshot( campaign, &snapshot );
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: ----------------------- Campaign %s -----------------------\n", campaign->campaign_requested );
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s campaign_requested: <%s>\n", campaign->campaign_requested, campaign->campaign_requested);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s name: <%s>\n", campaign->campaign_requested, campaign->name);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s datetime_start: <%s>\n", campaign->campaign_requested, campaign->datetime_start);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s context: <%s>\n", campaign->campaign_requested, campaign->context);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s running: <%d>\n", campaign->campaign_requested, campaign->running);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s stop: <%d>\n", campaign->campaign_requested, campaign->stop);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s max_concurrent_calls: <%d>\n", campaign->campaign_requested, campaign->max_concurrent_calls);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s time_between_calls: <%lu>\n", campaign->campaign_requested, campaign->time_between_calls);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s cps: <%.2f> burst: <%.2f>\n", campaign->campaign_requested, campaign->cps, campaign->cps_burst);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s max_inflight_originates: <%d> inflight: <%u>\n", campaign->campaign_requested, campaign->max_inflight_originates, switch_atomic_read( &campaign->inflight ));
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s attempts_per_number: <%d>\n", campaign->campaign_requested, campaign->attempts_per_number);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s time_between_retries: <%d>\n", campaign->campaign_requested, campaign->time_between_retries);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s gaussian_distribution: <%d>\n", campaign->campaign_requested, campaign->gaussian_distribution );
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s gaussian_distribution_mean: <%d>\n", campaign->campaign_requested, campaign->gaussian_distribution_mean );
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s gaussian_distribution_stdv: <%d>\n", campaign->campaign_requested, campaign->gaussian_distribution_stdv );
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s call_max_duration: <%d>\n", campaign->campaign_requested, campaign->call_max_duration);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s call_min_duration: <%d>\n", campaign->campaign_requested, campaign->call_min_duration);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s originate_timeout: <%d>\n", campaign->campaign_requested, campaign->originate_timeout);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s cancel_ratio: <%d>\n", campaign->campaign_requested, campaign->cancel_ratio);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s global_caller_id: <%s>\n", campaign->campaign_requested, campaign->global_caller_id);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s action_on_anwser: <%s>\n", campaign->campaign_requested, campaign->action_on_anwser);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s transfer_on_anwser: <%s>\n", campaign->campaign_requested, campaign->transfer_on_answer);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s destination_list: <%s>\n", campaign->campaign_requested, campaign->destination_list);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s destination_source: <%s%s>\n", campaign->campaign_requested, campaign->file ? "file:" : "db", campaign->file ? campaign->file->path : "");
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s codec_list: <%s>\n", campaign->campaign_requested, campaign->codec_list);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s profile_gateway: <%s>\n", campaign->campaign_requested, campaign->profile_gateway);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s calling_strategy: <%d>\n", campaign->campaign_requested, campaign->calling_strategy);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s calling_mode: <%d>\n", campaign->campaign_requested, campaign->calling_mode);
+    if ( campaign->calling_mode == PREDICTIVE ) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s agent_source: <%s:%s>\n", campaign->campaign_requested, campaign->predictive.source->name, campaign->predictive.source_arg);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s abandon_rate: <%.2f%%> target: <%.2f%%>\n", campaign->campaign_requested, campaign->predictive.abandon_rate * 100, campaign->predictive.abandon_target * 100);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s answer_rate: <%.2f> ring_time: <%.1f> talk_time: <%.1f> gain: <%.2f>\n", campaign->campaign_requested, campaign->predictive.answer_rate, campaign->predictive.ring_time, campaign->predictive.talk_time, campaign->predictive.gain);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s capacity: <%d> outstanding target: <%u>\n", campaign->campaign_requested, campaign->predictive.capacity, switch_atomic_read( &campaign->predictive.target ));
+    }
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s my_local_ip: <%s>\n", campaign->campaign_requested, campaign->my_local_ip);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s uuid_str: <%s>\n", campaign->campaign_requested, campaign->uuid_str);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s current_calls: <%u>\n", campaign->campaign_requested, snapshot.current_calls);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s calls_made: <%u>\n", campaign->campaign_requested, snapshot.calls_made);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s answered: <%u>\n", campaign->campaign_requested, snapshot.answered);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s total_seconds: <%u>\n", campaign->campaign_requested, snapshot.total_seconds);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s finish_on: <%d>\n", campaign->campaign_requested, campaign->finish_on);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s custom_header_name:  <%s>\n", campaign->campaign_requested, campaign->custom_header_name);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s custom_header_value:  <%s>\n", campaign->campaign_requested, campaign->custom_header_value);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s lease_batch_size: <%d>\n", campaign->campaign_requested, campaign->lease_batch_size);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s queue_low_watermark: <%d>\n", campaign->campaign_requested, campaign->queue_low_watermark);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s queue_high_watermark: <%d>\n", campaign->campaign_requested, campaign->queue_high_watermark);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s queue_count: <%d>\n", campaign->campaign_requested, campaign->queue_count);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %s retries scheduled: <%d> due: <%d>\n", campaign->campaign_requested, campaign->retries.count, campaign->retries.due_count);
+}
+
+static void dialer_show_campaigns( const char * campaign )
+{
+    struct db_campaign_config *found = NULL;
+
+    if ( !(strcmp( campaign , "all" ) ) ) {
+        switch_mutex_lock( globals.mutex );
+        for ( found = globals.campaign_list; found; found = found->next ) {
+            dialer_show_campaign( found );
+        }
+        switch_mutex_unlock( globals.mutex );
+        return;
+    }
+
+    if ( ( found = dialer_campaign_find( campaign ) ) ) {
+        dialer_show_campaign( found );
+        dialer_campaign_release( found );
+    }
+}
+
+/*!\brief Open a multi-counter update on the campaign's stats. Writers serialize on the campaign's own lock,
+ * readers never take it, see dialer_stats_snapshot()
+ */
+static void dialer_stats_write_begin( struct db_campaign_config *campaign )
+{
+    switch_mutex_lock( campaign->mutex );
+    switch_atomic_inc( &campaign->stats.seq );
+    dialer_memory_barrier();
+}
+
+static void dialer_stats_write_end( struct db_campaign_config *campaign )
+{
+    dialer_memory_barrier();
+    switch_atomic_inc( &campaign->stats.seq );
+    switch_mutex_unlock( campaign->mutex );
+}
+
+/*!\brief Take a consistent copy of the campaign's counters without locking: retry while a writer is in the middle
+ * of an update or the sequence moved under us
+ */
+static void dialer_stats_snapshot( struct db_campaign_config *campaign, struct dialer_stats_snapshot *snapshot )
+{
+    uint32_t seq;
+
+    do {
+        seq = switch_atomic_read( &campaign->stats.seq );
+        if ( seq & 1 ) {
+            continue;
+        }
+        dialer_memory_barrier();
+        snapshot->current_calls = switch_atomic_read( &campaign->stats.current_calls );
+        snapshot->calls_made = switch_atomic_read( &campaign->stats.calls_made );
+        snapshot->answered = switch_atomic_read( &campaign->stats.answered );
+        snapshot->total_seconds = switch_atomic_read( &campaign->stats.total_seconds );
+        dialer_memory_barrier();
+    } while ( ( seq & 1 ) || seq != switch_atomic_read( &campaign->stats.seq ) );
+}
+
+/* Histogram bucket upper bounds, in seconds */
+static const double dialer_latency_bounds[DIALER_HISTOGRAM_BUCKETS - 1] = { 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60 };
+static const double dialer_duration_bounds[DIALER_HISTOGRAM_BUCKETS - 1] = { 1, 5, 10, 30, 60, 120, 300, 600, 1200, 1800, 3600, 7200 };
+
+static uint64_t dialer_metrics_next_shard;
+static DIALER_THREAD_LOCAL int dialer_metrics_my_shard = -1;
+
+/*!\brief The calling thread's metrics shard, handed out round robin the first time a thread counts something
+ */
+static int dialer_metrics_shard( void )
+{
+    if ( dialer_metrics_my_shard < 0 ) {
+        dialer_metrics_my_shard = (int) ( dialer_atomic_add64( &dialer_metrics_next_shard, 1 ) % DIALER_METRIC_SHARDS );
+    }
+    return dialer_metrics_my_shard;
+}
+
+static void dialer_metrics_failure( struct dialer_metrics *metrics, switch_call_cause_t cause )
+{
+    switch_atomic_inc( &metrics->shards[ dialer_metrics_shard() ].failures );
+    switch_atomic_inc( &metrics->causes[ (unsigned) cause < DIALER_CAUSES ? (unsigned) cause : 0 ] );
+}
+
+static void dialer_histogram_observe( struct dialer_histogram *histogram, const double *bounds, switch_interval_time_t usec )
+{
+    struct dialer_histogram_shard *shard = &histogram->shards[ dialer_metrics_shard() ];
+    int bucket = 0;
+
+    if ( usec < 0 ) {
+        usec = 0;
+    }
+    while ( bucket < DIALER_HISTOGRAM_BUCKETS - 1 && usec > bounds[ bucket ] * 1000000 ) {
+        bucket++;
+    }
+    switch_atomic_inc( &shard->counts[ bucket ] );
+    dialer_atomic_add64( &shard->sum, (uint64_t) usec );
+}
+
+static void dialer_metrics_counters( struct dialer_metrics *metrics, uint32_t *attempts, uint32_t *answers, uint32_t *failures )
+{
+    *attempts = *answers = *failures = 0;
+    for ( int i=0; i<DIALER_METRIC_SHARDS; i++ ) {
+        *attempts += switch_atomic_read( &metrics->shards[i].attempts );
+        *answers += switch_atomic_read( &metrics->shards[i].answers );
+        *failures += switch_atomic_read( &metrics->shards[i].failures );
+    }
+}
+
+static void dialer_metrics_write_causes( switch_stream_handle_t *stream, const char *name, struct dialer_metrics *metrics, const char *label, const char *value )
+{
+    uint32_t count;
+
+    for ( int cause=0; cause<DIALER_CAUSES; cause++ ) {
+        if ( ( count = switch_atomic_read( &metrics->causes[cause] ) ) ) {
+            stream->write_function( stream, "%s{%s=\"%s\",cause=\"%s\"} %u\n", name, label, value, switch_channel_cause2str( (switch_call_cause_t) cause ), count );
+        }
+    }
+}
+
+static void dialer_metrics_write_histogram( switch_stream_handle_t *stream, const char *name, const char *campaign, struct dialer_histogram *histogram, const double *bounds )
+{
+    uint64_t counts[DIALER_HISTOGRAM_BUCKETS] = { 0 }, sum = 0, cumulative = 0;
+
+    for ( int i=0; i<DIALER_METRIC_SHARDS; i++ ) {
+        for ( int bucket=0; bucket<DIALER_HISTOGRAM_BUCKETS; bucket++ ) {
+            counts[bucket] += switch_atomic_read( &histogram->shards[i].counts[bucket] );
+        }
+        sum += histogram->shards[i].sum;
+    }
+
+    for ( int bucket=0; bucket<DIALER_HISTOGRAM_BUCKETS; bucket++ ) {
+        cumulative += counts[bucket];
+        if ( bucket < DIALER_HISTOGRAM_BUCKETS - 1 ) {
+            stream->write_function( stream, "%s_bucket{campaign=\"%s\",le=\"%g\"} %" SWITCH_UINT64_T_FMT "\n", name, campaign, bounds[bucket], cumulative );
+        } else {
+            stream->write_function( stream, "%s_bucket{campaign=\"%s\",le=\"+Inf\"} %" SWITCH_UINT64_T_FMT "\n", name, campaign, cumulative );
+        }
+    }
+    stream->write_function( stream, "%s_sum{campaign=\"%s\"} %.6f\n", name, campaign, sum / 1000000.0 );
+    stream->write_function( stream, "%s_count{campaign=\"%s\"} %" SWITCH_UINT64_T_FMT "\n", name, campaign, cumulative );
+}
+
+/*!\brief `dialer metrics`: every running campaign's and every gateway's counters, in the Prometheus text format.
+ * Like `dialer status`, the registry lock is only held to take references, never while writing to the stream
+ */
+static void dialer_metrics_write( switch_stream_handle_t *stream )
+{
+    struct db_campaign_config *campaign = NULL, **campaigns = NULL;
+    struct dialer_gateway *gateway = NULL;
+    int count = 0;
+    uint32_t attempts, answers, failures;
+    static const char *histograms[][2] = {
+        { "dialer_post_dial_delay_seconds", "Time from sending the call to the first ringing or early media" },
+        { "dialer_originate_latency_seconds", "Time spent in originate, until the call was answered or failed" },
+        { "dialer_pick_latency_seconds", "Time taken to claim a batch of numbers from the destination list" },
+        { "dialer_call_duration_seconds", "Talk time of answered calls" }
+    };
+
+    campaigns = dialer_campaign_hold_all( &count );
+
+    stream->write_function( stream, "# HELP dialer_attempts_total Calls sent to originate\n# TYPE dialer_attempts_total counter\n" );
+    for ( int c=0; c<count; c++ ) {
+        campaign = campaigns[c];
+        dialer_metrics_counters( &campaign->metrics, &attempts, &answers, &failures );
+        stream->write_function( stream, "dialer_attempts_total{campaign=\"%s\"} %u\n", campaign->campaign_requested, attempts );
+    }
+    stream->write_function( stream, "# HELP dialer_answers_total Calls answered\n# TYPE dialer_answers_total counter\n" );
+    for ( int c=0; c<count; c++ ) {
+        campaign = campaigns[c];
+        dialer_metrics_counters( &campaign->metrics, &attempts, &answers, &failures );
+        stream->write_function( stream, "dialer_answers_total{campaign=\"%s\"} %u\n", campaign->campaign_requested, answers );
+    }
+    stream->write_function( stream, "# HELP dialer_failures_total Calls that failed, by hangup cause\n# TYPE dialer_failures_total counter\n" );
+    for ( int c=0; c<count; c++ ) {
+        campaign = campaigns[c];
+        dialer_metrics_write_causes( stream, "dialer_failures_total", &campaign->metrics, "campaign", campaign->campaign_requested );
+    }
+    stream->write_function( stream, "# HELP dialer_inflight Originates waiting to be answered or fail\n# TYPE dialer_inflight gauge\n" );
+    for ( int c=0; c<count; c++ ) {
+        campaign = campaigns[c];
+        stream->write_function( stream, "dialer_inflight{campaign=\"%s\"} %u\n", campaign->campaign_requested, switch_atomic_read( &campaign->inflight ) );
+    }
+    stream->write_function( stream, "# HELP dialer_current_calls Calls in progress\n# TYPE dialer_current_calls gauge\n" );
+    for ( int c=0; c<count; c++ ) {
+        campaign = campaigns[c];
+        stream->write_function( stream, "dialer_current_calls{campaign=\"%s\"} %u\n", campaign->campaign_requested, switch_atomic_read( &campaign->stats.current_calls ) );
+    }
+    stream->write_function( stream, "# HELP dialer_route_outstanding Calls in progress through each of the campaign's gateways\n# TYPE dialer_route_outstanding gauge\n" );
+    for ( int c=0; c<count; c++ ) {
+        campaign = campaigns[c];
+        for ( int i=0; i<campaign->route_count; i++ ) {
+            stream->write_function( stream, "dialer_route_outstanding{campaign=\"%s\",gateway=\"%s\"} %u\n", campaign->campaign_requested, campaign->routes[i].gateway->name,
+                                    switch_atomic_read( &campaign->routes[i].outstanding ) );
+        }
+    }
+
+    for ( int i=0; i<(int) ( sizeof( histograms ) / sizeof( histograms[0] ) ); i++ ) {
+        stream->write_function( stream, "# HELP %s %s\n# TYPE %s histogram\n", histograms[i][0], histograms[i][1], histograms[i][0] );
+        for ( int c=0; c<count; c++ ) {
+            struct dialer_histogram *histogram;
+
+            campaign = campaigns[c];
+            histogram = i == 0 ? &campaign->post_dial_delay : i == 1 ? &campaign->originate_latency : i == 2 ? &campaign->pick_latency : &campaign->call_duration;
+            dialer_metrics_write_histogram( stream, histograms[i][0], campaign->campaign_requested, histogram, i == 3 ? dialer_duration_bounds : dialer_latency_bounds );
+        }
+    }
+
+    dialer_campaign_release_all( campaigns, count );
+
+    /* gateways live as long as the module, no need to hold the registry */
+    switch_mutex_lock( globals.gateways_mutex );
+    gateway = globals.gateway_list;
+    switch_mutex_unlock( globals.gateways_mutex );
+
+    stream->write_function( stream, "# HELP dialer_gateway_attempts_total Calls sent through the gateway\n# TYPE dialer_gateway_attempts_total counter\n" );
+    for ( struct dialer_gateway *g = gateway; g; g = g->next ) {
+        dialer_metrics_counters( &g->metrics, &attempts, &answers, &failures );
+        stream->write_function( stream, "dialer_gateway_attempts_total{gateway=\"%s\"} %u\n", g->name, attempts );
+    }
+    stream->write_function( stream, "# HELP dialer_gateway_answers_total Calls answered through the gateway\n# TYPE dialer_gateway_answers_total counter\n" );
+    for ( struct dialer_gateway *g = gateway; g; g = g->next ) {
+        dialer_metrics_counters( &g->metrics, &attempts, &answers, &failures );
+        stream->write_function( stream, "dialer_gateway_answers_total{gateway=\"%s\"} %u\n", g->name, answers );
+    }
+    stream->write_function( stream, "# HELP dialer_gateway_failures_total Calls through the gateway that failed, by hangup cause\n# TYPE dialer_gateway_failures_total counter\n" );
+    for ( struct dialer_gateway *g = gateway; g; g = g->next ) {
+        dialer_metrics_write_causes( stream, "dialer_gateway_failures_total", &g->metrics, "gateway", g->name );
+    }
+    stream->write_function( stream, "# HELP dialer_gateway_inflight Originates through the gateway waiting to be answered or fail\n# TYPE dialer_gateway_inflight gauge\n" );
+    for ( struct dialer_gateway *g = gateway; g; g = g->next ) {
+        stream->write_function( stream, "dialer_gateway_inflight{gateway=\"%s\"} %u\n", g->name, switch_atomic_read( &g->inflight ) );
+    }
+    stream->write_function( stream, "# HELP dialer_gateway_breaker_state Gateway breaker, 0 closed, 1 open, 2 half-open\n# TYPE dialer_gateway_breaker_state gauge\n" );
+    for ( struct dialer_gateway *g = gateway; g; g = g->next ) {
+        stream->write_function( stream, "dialer_gateway_breaker_state{gateway=\"%s\"} %d\n", g->name, (int) g->health.state );
+    }
+    stream->write_function( stream, "# HELP dialer_gateway_cps Calls per second the gateway is paced at right now, 0 for no limit\n# TYPE dialer_gateway_cps gauge\n" );
+    for ( struct dialer_gateway *g = gateway; g; g = g->next ) {
+        stream->write_function( stream, "dialer_gateway_cps{gateway=\"%s\"} %.2f\n", g->name, g->bucket.rate );
+    }
+}
+
+/*!\brief Copy `in` into `out` as the inside of a JSON string: quotes and backslashes escaped, control characters as \u00XX
+ */
+static void dialer_json_escape( const char *in, char *out, switch_size_t len )
+{
+    switch_size_t o = 0;
+
+    for ( ; *in && o + 7 <= len; in++ ) {
+        if ( *in == '"' || *in == '\\' ) {
+            out[ o++ ] = '\\';
+            out[ o++ ] = *in;
+        } else if ( (unsigned char) *in < 0x20 ) {
+            o += switch_snprintf( out + o, len - o, "\\u%04x", (unsigned char) *in );
+        } else {
+            out[ o++ ] = *in;
         }
+    }
+    out[ o ] = '\0';
+}
+
+/*!\brief Format one campaign's state and counters into `buf`, as a JSON object or as a key=value line.
+ * The queue and retry counters are copied under queue_mutex so that they agree with each other
+ */
+static void dialer_status_format( struct db_campaign_config *campaign, switch_bool_t json, char *buf, switch_size_t len )
+{
+    struct dialer_stats_snapshot snapshot;
+    const char *state;
+    char name[ sizeof( campaign->campaign_requested ) * 6 ];
+    int queue_count, retries_count, retries_due, retries;
+    switch_bool_t queue_exhausted;
+
+    dialer_stats_snapshot( campaign, &snapshot );
+
+    if ( campaign->queue_mutex ) {
+        switch_mutex_lock( campaign->queue_mutex );
+    }
+    queue_count = campaign->queue_count;
+    retries_count = campaign->retries.count;
+    retries_due = campaign->retries.due_count;
+    queue_exhausted = campaign->queue_exhausted;
+    if ( campaign->queue_mutex ) {
+        switch_mutex_unlock( campaign->queue_mutex );
+    }
+    retries = retries_count + retries_due;
+
+    if ( json ) {
+        dialer_json_escape( campaign->campaign_requested, name, sizeof( name ) );
     } else {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: ----------------------- Campaign Array #%s -----------------------\n", campaign );
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d campaign_requested: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].campaign_requested);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d name: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].name);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d datetime_start: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].datetime_start);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d context: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].context);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d running: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].running);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d stop: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].stop);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d max_concurrent_calls: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].max_concurrent_calls);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d time_between_calls: <%lu>\n", campaign_index, globals.campaigns[ campaign_index ].time_between_calls);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d attempts_per_number: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].attempts_per_number);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d time_between_retries: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].time_between_retries);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d gaussian_distribution: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].gaussian_distribution );
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d gaussian_distribution_mean: <%d>\n", campaign_index, globals.campaigns[campaign_index].gaussian_distribution_mean );
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d gaussian_distribution_stdv: <%d>\n", campaign_index, globals.campaigns[campaign_index].gaussian_distribution_stdv );
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d call_max_duration: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].call_max_duration);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d call_min_duration: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].call_min_duration);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d originate_timeout: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].originate_timeout);
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d cancel_ratio: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].cancel_ratio);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d global_caller_id: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].global_caller_id);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d action_on_anwser: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].action_on_anwser);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d transfer_on_anwser: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].transfer_on_answer);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d destination_list: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].destination_list);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d codec_list: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].codec_list);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d profile_gateway: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].profile_gateway);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d calling_strategy: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].calling_strategy);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d my_local_ip: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].my_local_ip);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d uuid_str: <%s>\n", campaign_index, globals.campaigns[ campaign_index ].uuid_str);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d current_calls: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].current_calls);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d calls_made: <%lu>\n", campaign_index, globals.campaigns[ campaign_index ].calls_made);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d answered: <%lu>\n", campaign_index, globals.campaigns[ campaign_index ].answered);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d total_seconds: <%lu>\n", campaign_index, globals.campaigns[ campaign_index ].total_seconds);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d finish_on: <%d>\n", campaign_index, globals.campaigns[ campaign_index ].finish_on);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d custom_header_name:  <%s>\n", campaign_index, globals.campaigns[ campaign_index ].custom_header_name);
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_dialer: campaign %d custom_header_value:  <%s>\n", campaign_index, globals.campaigns[ campaign_index ].custom_header_value);
+        switch_copy_string( name, campaign->campaign_requested, sizeof( name ) );
     }
-    switch_mutex_unlock( globals.mutex );
+
+    if ( campaign->running == SWITCH_FALSE ) {
+        state = "stopped";
+    } else if ( campaign->stop == SWITCH_TRUE ) {
+        state = "stopping";
+    } else if ( queue_exhausted == SWITCH_TRUE && queue_count == 0 ) {
+        state = retries > 0 ? "waiting_retries" : "finishing";
+    } else {
+        state = "running";
+    }
+
+    switch_snprintf( buf, len,
+                     json ?
+                     "{\"campaign\":\"%s\",\"uuid\":\"%s\",\"state\":\"%s\",\"calling_strategy\":\"%s\",\"calling_mode\":\"%s\","
+                     "\"calls_made\":%u,\"answered\":%u,\"total_seconds\":%u,\"current_calls\":%u,\"max_concurrent_calls\":%d,"
+                     "\"inflight\":%u,\"max_inflight_originates\":%d,\"cps\":%.2f,\"cps_limit\":%.2f,"
+                     "\"queue_depth\":%d,\"queue_exhausted\":%s,\"retries\":%d,\"retries_due\":%d,\"leased\":%d}"
+                     :
+                     "campaign=%s uuid=%s state=%s calling_strategy=%s calling_mode=%s "
+                     "calls_made=%u answered=%u total_seconds=%u current_calls=%u max_concurrent_calls=%d "
+                     "inflight=%u max_inflight_originates=%d cps=%.2f cps_limit=%.2f "
+                     "queue_depth=%d queue_exhausted=%s retries=%d retries_due=%d leased=%d\n",
+                     name, campaign->uuid_str, state,
+                     campaign->calling_strategy == SEQUENTIAL ? "sequential" : "random",
+                     campaign->calling_mode == PREDICTIVE ? "predictive" : "progressive",
+                     snapshot.calls_made, snapshot.answered, snapshot.total_seconds, snapshot.current_calls, campaign->max_concurrent_calls,
+                     switch_atomic_read( &campaign->inflight ), campaign->max_inflight_originates, campaign->current_cps, campaign->cps,
+                     queue_count, queue_exhausted == SWITCH_TRUE ? "true" : "false", retries_count, retries_due,
+                     queue_count + retries + (int) snapshot.current_calls );
+}
+
+/*!\brief `dialer status [campaign|all] [json]`: one line (or JSON object) per campaign, written to the API stream.
+ * The registry lock is only held to take references, the counters are read lock-free and formatted on the stack
+ */
+static void dialer_status( switch_stream_handle_t *stream, const char *campaign, switch_bool_t json )
+{
+    struct db_campaign_config *found = NULL, **campaigns = NULL;
+    char buf[1024];
+    int count = 0;
+
+    if ( strcmp( campaign, "all" ) ) {
+        if ( !( found = dialer_campaign_find( campaign ) ) ) {
+            stream->write_function( stream, json ? "{}\n" : "-ERR campaign %s isn't running\n", campaign );
+            return;
+        }
+        dialer_status_format( found, json, buf, sizeof( buf ) );
+        stream->write_function( stream, json ? "%s\n" : "%s", buf );
+        dialer_campaign_release( found );
+        return;
+    }
+
+    campaigns = dialer_campaign_hold_all( &count );
+
+    if ( json ) {
+        stream->write_function( stream, "[" );
+    }
+    for ( int i=0; i<count; i++ ) {
+        dialer_status_format( campaigns[i], json, buf, sizeof( buf ) );
+        stream->write_function( stream, json && i > 0 ? ",%s" : "%s", buf );
+    }
+    if ( json ) {
+        stream->write_function( stream, "]\n" );
+    }
+
+    dialer_campaign_release_all( campaigns, count );
 }
 
 #define LOG_SYNTAX "<action> [<test-name>] [<calls>]"
 SWITCH_STANDARD_API(start_tests_function)
 {
     char *argv[32] = { 0 };
-    int argc, new_campaign_slot;
+    int argc;
     char *mydata = NULL;
     switch_status_t status = SWITCH_STATUS_SUCCESS;
 
     struct db_campaign_config *my_campaign = NULL;
-    switch_uuid_t uuid;
-    char my_uuid[32];
-    switch_memory_pool_t *pool;
-    switch_thread_t *thread;
-    switch_threadattr_t *thd_attr = NULL;
 
     if (zstr(cmd)) {
         goto usage;
     }
 
     mydata = strdup(cmd);
-    switch_zmalloc( my_campaign, sizeof( struct db_campaign_config ) );
 
     if ((argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0]))))) {
-        if (argc < 2) {
+        if ( !strcmp(argv[0],"metrics") ) {
+            dialer_metrics_write( stream );
+            goto end;
+        } else if ( !strcmp(argv[0],"status") ) {
+            /* status [campaign|all] [json] */
+            if ( argc > 1 && !strcmp( argv[argc - 1], "json" ) ) {
+                dialer_status( stream, argc > 2 ? argv[1] : "all", SWITCH_TRUE );
+            } else {
+                dialer_status( stream, argc > 1 ? argv[1] : "all", SWITCH_FALSE );
+            }
+            goto end;
+        } else if ( !strcmp(argv[0],"reload") ) {
+            /* reload: parse the campaign definitions again, like reloadxml does */
+            stream->write_function( stream, dialer_definitions_load() == SWITCH_TRUE ? "+OK\n" : "-ERR couldn't load dialer.conf\n" );
+            goto end;
+        } else if ( !strcmp(argv[0],"load") && argc < 3 ) {
+            /* load: loads in progress */
+            dialer_load_list( stream );
+            goto end;
+        } else if (argc < 2) {
             goto usage;
         } else if  ( !strcmp(argv[0],"start") && !zstr(argv[1]) ) {
 
-            /* Let's check if the requested campaign is already running somewhere */
-            if ( dialer_is_campaign_running(argv[1]) > -1 ) {
+            /* registering the name fails if the requested campaign is already running somewhere */
+            if ( !( my_campaign = dialer_campaign_create( argv[1], NULL ) ) ) {
                 switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: The requested campaign is already running!\n" );
                 status = SWITCH_STATUS_TERM;
                 goto end;
             }
 
-            /* We also need to find an empty campaign struct inside the globals' struct array so that we can insert the config there */
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Finding empty item in campaigns array\n" );
-            new_campaign_slot = dialer_get_empty_index( &my_campaign, argv[1] );
-            if ( new_campaign_slot > -1 ) {
-                //if ( dialer_get_empty_slot( &my_campaign, argv[1] ) ) {
-                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: found a campaign %s index %d\n", argv[1], new_campaign_slot );
-            } else {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Got command %s for campaing %s... Attempting to start a new thread\n", argv[0], argv[1] );
+
+            if ( dialer_campaign_spawn( my_campaign ) == SWITCH_FALSE ) {
                 status = SWITCH_STATUS_TERM;
                 goto end;
             }
-
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Got command %s for campaing %s... Attempting to start a new thread\n", argv[0], argv[1] );
-
-            switch_core_new_memory_pool(&pool);
-            my_campaign = &globals.campaigns[new_campaign_slot];
-            my_campaign->pool = pool;
-            strncpy( my_campaign->campaign_requested, switch_core_strdup(pool, argv[1]), sizeof( my_campaign->campaign_requested ) );
-            
-            
-
-            switch_uuid_get( &uuid );
-            switch_uuid_format( my_uuid, &uuid );
-            strncpy( my_campaign->uuid_str, my_uuid, sizeof( my_campaign->uuid_str ) );
-
-            switch_threadattr_create( &thd_attr, my_campaign->pool );
-            switch_threadattr_detach_set(thd_attr, 1);
-            switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
             stream->write_function(stream, "+OK Campaign-UUID: %s for campaign: %s\n", my_campaign->uuid_str, my_campaign->campaign_requested);
 
-            switch_thread_create(&thread, thd_attr, dialer_start_campaign, (void *) (intptr_t) new_campaign_slot, my_campaign->pool);
-
             status = SWITCH_STATUS_SUCCESS;
 
             goto end;
 
-        } else if  ( !strcmp(cmd,"status") ) {
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Got command %s\n", cmd );
+        } else if  ( !strcmp(argv[0],"resume") && !zstr(argv[1]) ) {
+            dialer_resume_campaign( argv[1], stream );
             goto end;
         } else if  ( !strcmp(argv[0],"stop")  && !zstr(argv[1]) ) {
             switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Got command %s\n", cmd );
@@ -654,6 +2047,19 @@ SWITCH_STANDARD_API(start_tests_function)
         } else if  ( !strcmp(argv[0],"show") && !zstr(argv[1]) ) {
             dialer_show_campaigns( argv[1] );
             goto end;
+        } else if  ( !strcmp(argv[0],"load") ) {
+            dialer_load_start( argv[1], argv[2], stream );
+            goto end;
+        } else if  ( !strcmp(argv[0],"agents") && argc > 2 ) {
+            if ( dialer_set_agents( argv[1], atoi( argv[2] ) ) == SWITCH_FALSE ) {
+                stream->write_function(stream, "-ERR campaign %s isn't running with a static agent_source\n", argv[1]);
+                goto end;
+            }
+            stream->write_function(stream, "+OK\n");
+            goto end;
+        } else if  ( !strcmp(argv[0],"set") && argc > 3 ) {
+            dialer_set_param( argv[1], argv[2], argv[3], stream );
+            goto end;
         } else if  ( !strcmp(argv[0],"delete") && !zstr(argv[1]) ) {
             if ( dialer_delete_campaign( argv[1] ) == SWITCH_TRUE ) {
                 status = SWITCH_STATUS_SUCCESS;
@@ -678,11 +2084,12 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_dialer_load)
 {
 
     /* Vars for xml setting loading */
-    switch_xml_t cfg = NULL, settings, xml = NULL, param = NULL;
+    switch_xml_t cfg = NULL, settings, xml = NULL, param = NULL, gateways = NULL, x_gateway = NULL;
 
     /* Other vars */
     switch_api_interface_t *dialer_api_interface;
     switch_status_t status = SWITCH_STATUS_SUCCESS;
+    const char *db_dialect = NULL;
     memset(&globals, 0, sizeof(globals));
     globals.pool = pool;
 
@@ -700,26 +2107,15 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_dialer_load)
 
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Starting dialer mod!\n");
 
-    /* bind to events */
-    if (switch_event_bind("mod_dialer", SWITCH_EVENT_HEARTBEAT, SWITCH_EVENT_SUBCLASS_ANY, dialer_event_handler, NULL ) !=  SWITCH_STATUS_SUCCESS) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Couldn't bind event to monitor for session heartbeats!\n");
-        return SWITCH_STATUS_GENERR;
-    }
-
-    if (switch_event_bind("mod_dialer", SWITCH_EVENT_CUSTOM, SWITCH_EVENT_SUBCLASS_ANY, dialer_event_handler, NULL ) !=  SWITCH_STATUS_SUCCESS) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Couldn't bind event to monitor for CUSTOM event!\n");
-        return SWITCH_STATUS_GENERR;
-    } 
-
-    if (switch_event_bind("mod_dialer", SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE, SWITCH_EVENT_SUBCLASS_ANY, dialer_event_handler, NULL ) !=  SWITCH_STATUS_SUCCESS) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Couldn't bind to SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE!\n");
-        return SWITCH_STATUS_GENERR;
-    }
-
-    if (switch_event_bind("mod_dialer", SWITCH_EVENT_CHANNEL_ANSWER, SWITCH_EVENT_SUBCLASS_ANY, dialer_event_handler, NULL ) !=  SWITCH_STATUS_SUCCESS) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Couldn't bind to SWITCH_EVENT_CHANNEL_ANSWER!\n");
-        return SWITCH_STATUS_GENERR;
-    }
+    /* calls are tracked through the state handlers we install on the channels we originate, no event bindings */
+    switch_mutex_init(&globals.calls_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+    switch_core_hash_init(&globals.calls);
+    switch_core_hash_init(&globals.campaigns_by_name);
+    switch_core_hash_init(&globals.campaigns_by_uuid);
+    switch_mutex_init(&globals.gateways_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+    switch_core_hash_init(&globals.gateways);
+    switch_mutex_init(&globals.loads_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+    switch_mutex_init(&globals.definitions_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 
     /* set api commands */
     if (switch_true(switch_core_get_variable("disable_system_api_commands"))) {
@@ -736,6 +2132,13 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_dialer_load)
         switch_mutex_lock(globals.mutex);
         switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
 
+        globals.checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+        /* both opt-in: a list with a run of busy or unreachable numbers says nothing about the carrier */
+        globals.breaker_threshold = 0;
+        globals.aimd = SWITCH_FALSE;
+        /* opt-in: a journal is a file per campaign in db_dir */
+        globals.journal = SWITCH_FALSE;
+        globals.journal_compact_interval = DEFAULT_JOURNAL_COMPACT_INTERVAL;
 
         for (param = switch_xml_child(settings, "param"); param; param = param->next) {
             char *var = (char *) switch_xml_attr_soft(param, "name");
@@ -749,6 +2152,77 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_dialer_load)
             } else if (!strcasecmp(var, "odbc-dsn")) {
                 globals.odbc_dsn = strdup(val);
                 switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: odbc_dsn is: %s\n", globals.odbc_dsn );
+            } else if (!strcasecmp(var, "db-dialect")) {
+                db_dialect = val;
+            } else if (!strcasecmp(var, "originate-workers")) {
+                globals.originate_workers = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: originate-workers is: %d\n", globals.originate_workers );
+            } else if (!strcasecmp(var, "db-flush-interval-ms")) {
+                globals.db_flush_interval = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: db-flush-interval-ms is: %d\n", globals.db_flush_interval );
+            } else if (!strcasecmp(var, "db-flush-batch")) {
+                globals.db_flush_batch = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: db-flush-batch is: %d\n", globals.db_flush_batch );
+            } else if (!strcasecmp(var, "db-queue-size")) {
+                globals.db_queue_size = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: db-queue-size is: %d\n", globals.db_queue_size );
+            } else if (!strcasecmp(var, "cps")) {
+                globals.cps = atof(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: cps is: %.2f\n", globals.cps );
+            } else if (!strcasecmp(var, "cps-burst")) {
+                globals.cps_burst = atof(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: cps-burst is: %.2f\n", globals.cps_burst );
+            } else if (!strcasecmp(var, "gateway-cps")) {
+                globals.gateway_cps = atof(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-cps is: %.2f\n", globals.gateway_cps );
+            } else if (!strcasecmp(var, "gateway-cps-burst")) {
+                globals.gateway_cps_burst = atof(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-cps-burst is: %.2f\n", globals.gateway_cps_burst );
+            } else if (!strcasecmp(var, "gateway-breaker-threshold")) {
+                globals.breaker_threshold = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-breaker-threshold is: %d\n", globals.breaker_threshold );
+            } else if (!strcasecmp(var, "gateway-breaker-min-calls")) {
+                globals.breaker_min_calls = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-breaker-min-calls is: %d\n", globals.breaker_min_calls );
+            } else if (!strcasecmp(var, "gateway-breaker-window")) {
+                globals.breaker_window = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-breaker-window is: %d\n", globals.breaker_window );
+            } else if (!strcasecmp(var, "gateway-breaker-cooldown")) {
+                globals.breaker_cooldown = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-breaker-cooldown is: %d\n", globals.breaker_cooldown );
+            } else if (!strcasecmp(var, "gateway-aimd")) {
+                globals.aimd = switch_true(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-aimd is: %s\n", globals.aimd ? "on" : "off" );
+            } else if (!strcasecmp(var, "gateway-aimd-increase")) {
+                globals.aimd_increase = atof(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-aimd-increase is: %.2f\n", globals.aimd_increase );
+            } else if (!strcasecmp(var, "gateway-aimd-min-cps")) {
+                globals.aimd_min_cps = atof(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway-aimd-min-cps is: %.2f\n", globals.aimd_min_cps );
+            } else if (!strcasecmp(var, "max-inflight-originates")) {
+                globals.max_inflight_originates = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: max-inflight-originates is: %d\n", globals.max_inflight_originates );
+            } else if (!strcasecmp(var, "lease-seconds")) {
+                globals.lease_seconds = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: lease-seconds is: %d\n", globals.lease_seconds );
+            } else if (!strcasecmp(var, "lease-renew-interval")) {
+                globals.lease_renew_interval = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: lease-renew-interval is: %d\n", globals.lease_renew_interval );
+            } else if (!strcasecmp(var, "checkpoint-interval")) {
+                globals.checkpoint_interval = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: checkpoint-interval is: %d\n", globals.checkpoint_interval );
+            } else if (!strcasecmp(var, "journal")) {
+                globals.journal = switch_true(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: journal is: %s\n", globals.journal ? "on" : "off" );
+            } else if (!strcasecmp(var, "journal-queue-size")) {
+                globals.journal_queue_size = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: journal-queue-size is: %d\n", globals.journal_queue_size );
+            } else if (!strcasecmp(var, "journal-compact-interval")) {
+                globals.journal_compact_interval = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: journal-compact-interval is: %d\n", globals.journal_compact_interval );
+            } else if (!strcasecmp(var, "originate-queue-size")) {
+                globals.originate_queue_size = atoi(val);
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: originate-queue-size is: %d\n", globals.originate_queue_size );
             } else {
                 switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Unkown parameter in 'settings': %s\n", var );
             }
@@ -758,113 +2232,140 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_dialer_load)
             status = SWITCH_STATUS_SUCCESS;
         }
 
-        switch_mutex_unlock(globals.mutex);
-switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
-
-    }
-    /* Load global settings into global struct - End */
-
-
-    /* connect my internal structure to the blank pointer passed to me */
-    SWITCH_ADD_API(dialer_api_interface, "dialer", "Start dialer", start_tests_function, "[start|status|stop]");
-
-    /* Done setting api commands */
-end:
-    if (xml) {
-        switch_xml_free(xml);
-    }
-    return status;
+        if ( !( globals.dialect = dialer_sql_dialect_select( db_dialect ) ) ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Unknown db-dialect %s, use mysql, pgsql or sqlite\n", db_dialect );
+            switch_mutex_unlock(globals.mutex);
+            status = SWITCH_STATUS_GENERR;
+            goto end;
+        }
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: SQL dialect is: %s\n", globals.dialect->name );
 
-}
+        if ( globals.originate_workers <= 0 ) {
+            globals.originate_workers = DEFAULT_ORIGINATE_WORKERS;
+        } else if ( globals.originate_workers > MAX_ORIGINATE_WORKERS ) {
+            globals.originate_workers = MAX_ORIGINATE_WORKERS;
+        }
+        if ( globals.originate_queue_size <= 0 ) {
+            globals.originate_queue_size = DEFAULT_ORIGINATE_QUEUE_SIZE;
+        }
+        if ( globals.db_flush_interval <= 0 ) {
+            globals.db_flush_interval = DEFAULT_DB_FLUSH_INTERVAL;
+        }
+        if ( globals.db_flush_batch <= 0 ) {
+            globals.db_flush_batch = DEFAULT_DB_FLUSH_BATCH;
+        }
+        if ( globals.db_queue_size <= 0 ) {
+            globals.db_queue_size = DEFAULT_DB_QUEUE_SIZE;
+        }
+        if ( globals.lease_seconds <= 0 ) {
+            globals.lease_seconds = DEFAULT_LEASE_SECONDS;
+        }
+        if ( globals.lease_renew_interval <= 0 || globals.lease_renew_interval * 2 > globals.lease_seconds ) {
+            /* a lease must survive at least one missed renewal */
+            globals.lease_renew_interval = switch_max( globals.lease_seconds / 3, 1 );
+        }
+        if ( globals.checkpoint_interval < 0 ) {
+            globals.checkpoint_interval = 0;
+        }
+        if ( globals.journal_queue_size <= 0 ) {
+            globals.journal_queue_size = DEFAULT_JOURNAL_QUEUE_SIZE;
+        }
+        if ( globals.journal_compact_interval < 0 ) {
+            globals.journal_compact_interval = 0;
+        }
+        if ( globals.breaker_threshold < 0 || globals.breaker_threshold > 100 ) {
+            globals.breaker_threshold = DEFAULT_BREAKER_THRESHOLD;
+        }
+        if ( globals.breaker_min_calls <= 0 ) {
+            globals.breaker_min_calls = DEFAULT_BREAKER_MIN_CALLS;
+        }
+        if ( globals.breaker_window <= 0 ) {
+            globals.breaker_window = DEFAULT_BREAKER_WINDOW;
+        }
+        if ( globals.breaker_cooldown <= 0 ) {
+            globals.breaker_cooldown = DEFAULT_BREAKER_COOLDOWN;
+        }
+        if ( globals.aimd_increase <= 0 ) {
+            globals.aimd_increase = DEFAULT_AIMD_INCREASE;
+        }
+        if ( globals.aimd_min_cps <= 0 ) {
+            globals.aimd_min_cps = DEFAULT_AIMD_MIN_CPS;
+        }
+        dialer_bucket_init( &globals.bucket, globals.cps, globals.cps_burst, globals.pool );
+
+        /* per-gateway overrides of gateway-cps */
+        if ( ( gateways = switch_xml_child(cfg, "gateways") ) ) {
+            for ( x_gateway = switch_xml_child(gateways, "gateway"); x_gateway; x_gateway = x_gateway->next ) {
+                const char *gateway_name = switch_xml_attr_soft(x_gateway, "name");
+                struct dialer_gateway *gateway;
+                double cps = globals.gateway_cps, cps_burst = globals.gateway_cps_burst;
 
-static char * dialer_get_event_header( switch_event_t *event, const char * header_name ) {
-    for (switch_event_header_t *hp = event->headers; hp; hp = hp->next) {
-        char *var = hp->name;
-        char *val = hp->value;
-        if ( !strcmp( var, header_name ) ) {
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: comparing %s with %s!\n", var, header_name );
-            return val;
+                if ( zstr(gateway_name) ) {
+                    continue;
+                }
+                for (param = switch_xml_child(x_gateway, "param"); param; param = param->next) {
+                    char *var = (char *) switch_xml_attr_soft(param, "name");
+                    char *val = (char *) switch_xml_attr_soft(param, "value");
+
+                    if (!strcasecmp(var, "cps")) {
+                        cps = atof(val);
+                    } else if (!strcasecmp(var, "cps-burst")) {
+                        cps_burst = atof(val);
+                    } else {
+                        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Unkown parameter in gateway %s: %s\n", gateway_name, var );
+                    }
+                }
+                gateway = dialer_gateway_get( gateway_name );
+                dialer_gateway_limit( gateway, cps, cps_burst );
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: gateway %s cps is: %.2f, burst %.2f\n", gateway_name, cps, cps_burst );
+            }
         }
+
+        switch_mutex_unlock(globals.mutex);
+switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
+
     }
-    return NULL;
-}
+    /* Load global settings into global struct - End */
 
-/* You can turn on session heartbeat on a channel to have us check billing more often */
-static void dialer_event_handler(switch_event_t *event)
-{
-    char *uuid;
-    char *number;
-    switch_event_header_t *hp;
-    int campaign_index;
-    
-    /* Only if the event is ours */
-    
-    if ( !(switch_event_get_header(event, "variable_campaign_id") == NULL) ){
-    
-    	campaign_index =  atoi( switch_event_get_header(event, "variable_campaign_id") );
-
-		if ( !strcmp( switch_event_name(event->event_id), "CHANNEL_ANSWER" ) ) {
-
-			switch_mutex_lock(globals.mutex);
-			switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
-
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, 
-				"dialer: incrementing answered for "
-				"campaign_id %d: "
-				"current calls: %d, "
-				"total answered: %lu\n",
-				campaign_index,
-				globals.campaigns[ campaign_index ].current_calls,
-				++globals.campaigns[ campaign_index ].answered );
-
-			switch_mutex_unlock(globals.mutex);
-			switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
-		} 
-
-
-		if ( !strcmp( switch_event_name(event->event_id), "CHANNEL_HANGUP_COMPLETE" ) && !strcmp( dialer_get_event_header( event, "Call-Direction" ) , "outbound" ) ) {
-
-			switch_mutex_lock(globals.mutex);
-			switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
-
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: decrementing current_calls for campaign_id %d\n", campaign_index );
-			globals.campaigns[ campaign_index ].current_calls--;
-			globals.campaigns[ campaign_index ].total_seconds += atoi( switch_event_get_header(event, "variable_duration") );
-		
-			number = switch_event_get_header(event, "Caller-Callee-ID-Number");
-			if ( dialer_set_number_inuse( campaign_index, number, "0") == SWITCH_TRUE ) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: set number as not in use: %s\n", number );
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: I couldn't set is as in NOT in use: %s\n", number );
-			}
-
-			switch_mutex_unlock(globals.mutex);
-			switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
-		}
-	
-    } else {
-		switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: call is not ours\n");
+    /* campaigns are parsed once here and again on every reloadxml, `dialer start` only looks them up */
+    dialer_definitions_load();
+    if ( switch_event_bind( modname, SWITCH_EVENT_RELOADXML, SWITCH_EVENT_SUBCLASS_ANY, dialer_reloadxml_handler, NULL ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: Couldn't bind to reloadxml, campaign changes need `dialer reload`\n" );
     }
 
-    if (!event) {
-        /* We should never get here - it means an event came in without the event info */
-        return;
+    if ( globals.dialect->setup ) {
+        dialer_execute_sql( (char *) globals.dialect->setup );
     }
 
-    /* Make sure everything is sane */
-    if (!(uuid = switch_event_get_header(event, "Unique-ID"))) {
-        /* Donde esta channel? */
-        return;
+    globals.running = SWITCH_TRUE;
+    if ( dialer_start_db_writer() == SWITCH_FALSE ) {
+        status = SWITCH_STATUS_GENERR;
+        goto end;
     }
+    if ( dialer_start_lease_thread() == SWITCH_FALSE ) {
+        dialer_stop_db_writer();
+        status = SWITCH_STATUS_GENERR;
+        goto end;
+    }
+    if ( dialer_start_originate_workers() == SWITCH_FALSE ) {
+        dialer_stop_originate_workers();
+        dialer_stop_lease_thread();
+        dialer_stop_db_writer();
+        status = SWITCH_STATUS_GENERR;
+        goto end;
+    }
+
+
+    /* connect my internal structure to the blank pointer passed to me */
+    SWITCH_ADD_API(dialer_api_interface, "dialer", "Start dialer", start_tests_function, "[start|status|stop]");
 
-    for (hp = event->headers; hp; hp = hp->next) {
-        char *var = hp->name;
-        char *val = hp->value;
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: header %s: %s\n", var, val );
+    /* Done setting api commands */
+end:
+    if (xml) {
+        switch_xml_free(xml);
     }
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Done Listing headers --------------------------\n" );
-    
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Exiting even_handler for received event %s\n", switch_event_name(event->event_id));
+    return status;
+
 }
 
 /*
@@ -876,33 +2377,59 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_dialer_shutdown)
     switch_channel_unbind_device_state_handler(mycb);
     switch_xml_config_cleanup(instructions); */
 
-    /* stopping all campaigns */
-	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
+    switch_event_unbind_callback( dialer_reloadxml_handler );
 
-    for (int i=0; i<MAX_CAMPAIGNS; i++) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: stopping all campaigns (%d)\n", i );
-		switch_mutex_lock(globals.mutex);
-        globals.campaigns[i].stop = SWITCH_TRUE;
-		switch_mutex_unlock(globals.mutex);
-    }
-    
-    for (int i=0; i<MAX_CAMPAIGNS; i++) {
-        while ( globals.campaigns[i].running == SWITCH_TRUE ) {
-            switch_mutex_unlock(globals.mutex);
-        	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Waiting for campaigns to finish\n");
-            switch_yield(5000000);
-            switch_mutex_lock(globals.mutex);
+    /* stopping all campaigns, every campaign thread unregisters its campaign on the way out */
+    switch_mutex_lock(globals.mutex);
+    while ( globals.campaign_list ) {
+        struct db_campaign_config *campaign;
+
+        for ( campaign = globals.campaign_list; campaign; campaign = campaign->next ) {
+            campaign->stop = SWITCH_TRUE;
         }
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Waiting for %d campaigns to finish\n", globals.campaign_count );
+        switch_mutex_unlock(globals.mutex);
+        switch_yield(1000000);
+        switch_mutex_lock(globals.mutex);
     }
-    
-    if ( dialer_delete_all_campaigns() == SWITCH_FALSE ) {
-		switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: could NOT delete all campaigns!\n");
+    switch_mutex_unlock(globals.mutex);
+
+    /* loads stop at the next line, their last batch is written */
+    switch_mutex_lock(globals.loads_mutex);
+    while ( globals.load_list ) {
+        struct dialer_load *load;
+
+        for ( load = globals.load_list; load; load = load->next ) {
+            load->stop = SWITCH_TRUE;
+        }
+        switch_mutex_unlock(globals.loads_mutex);
+        switch_yield(100000);
+        switch_mutex_lock(globals.loads_mutex);
     }
-    
-	switch_mutex_unlock(globals.mutex);
-	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
+    switch_mutex_unlock(globals.loads_mutex);
 
-    switch_event_unbind_callback(dialer_event_handler);
+    /* campaigns are gone, nothing else will be queued */
+    dialer_stop_originate_workers();
+    dialer_stop_db_writer();
+    dialer_stop_lease_thread();
+
+    if ( globals.calls ) {
+        switch_core_hash_destroy(&globals.calls);
+    }
+    dialer_call_slab_destroy();
+    if ( globals.definitions ) {
+        switch_core_hash_destroy(&globals.definitions);
+        switch_core_destroy_memory_pool(&globals.definitions_pool);
+    }
+    if ( globals.campaigns_by_name ) {
+        switch_core_hash_destroy(&globals.campaigns_by_name);
+    }
+    if ( globals.campaigns_by_uuid ) {
+        switch_core_hash_destroy(&globals.campaigns_by_uuid);
+    }
+    if ( globals.gateways ) {
+        switch_core_hash_destroy(&globals.gateways);
+    }
 	switch_safe_free(globals.dbname);
 	switch_safe_free(globals.odbc_dsn);
 
@@ -910,141 +2437,302 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_dialer_shutdown)
     return SWITCH_STATUS_SUCCESS;
 }
 
-static switch_bool_t dialer_delete_all_campaigns() {
-    
-    for ( int i=0; i<MAX_CAMPAIGNS; i++ ) {
-    	if ( !zstr(globals.campaigns[i].campaign_requested) ) {
-    		if( dialer_delete_campaign( globals.campaigns[i].campaign_requested ) == SWITCH_FALSE ) {
-    			switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: could NOT remove campaign %s\n", globals.campaigns[i].campaign_requested );
-    			return SWITCH_FALSE;
-    		}
-    	} else {
-			switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: campaign %s deleted\n", globals.campaigns[i].campaign_requested );
-    	}
-    }
-	return SWITCH_TRUE;
-}
-
-/*!\brief Loop through campaign's array searching for the passed "char * campaign_name" in "campaigns[i].campaign_requested" and
- * return the index if found, -1 if not
- */
-static int dialer_is_campaign_running( char * campaign_requested )
-{
-    for ( int i=0; i<MAX_CAMPAIGNS; i++ ) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: checking [%d]: %s\n", i, globals.campaigns[i].campaign_requested);
-        if ( !zstr(campaign_requested) ) {
-            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: looking for %s in campaign array [%d]: %s\n", campaign_requested, i, globals.campaigns[i].campaign_requested);
-            if ( strcmp( globals.campaigns[i].campaign_requested, campaign_requested ) == 0 ) {
-                return i;
-            }
-        }
+/*!\brief Register a new campaign under `campaign_requested` with a fresh uuid, or with `uuid` when resuming a run.
+ * The campaign lives in its own memory pool.
+ * return the campaign holding one reference for the caller, NULL if a campaign by that name (or uuid) is already registered
+ */
+static struct db_campaign_config *dialer_campaign_create( const char *campaign_requested, const char *uuid )
+{
+    struct db_campaign_config *campaign = NULL;
+    switch_memory_pool_t *pool = NULL;
+
+    if ( switch_core_new_memory_pool( &pool ) != SWITCH_STATUS_SUCCESS ) {
+        return NULL;
     }
-    return -1;
+    campaign = switch_core_alloc( pool, sizeof( struct db_campaign_config ) );
+    campaign->pool = pool;
+    switch_mutex_init( &campaign->mutex, SWITCH_MUTEX_NESTED, pool );
+    switch_copy_string( campaign->campaign_requested, campaign_requested, sizeof( campaign->campaign_requested ) );
+    if ( zstr( uuid ) ) {
+        switch_uuid_str( campaign->uuid_str, sizeof( campaign->uuid_str ) );
+    } else {
+        switch_copy_string( campaign->uuid_str, uuid, sizeof( campaign->uuid_str ) );
+    }
+
+    switch_mutex_lock( globals.mutex );
+    if ( switch_core_hash_find( globals.campaigns_by_name, campaign->campaign_requested ) || switch_core_hash_find( globals.campaigns_by_uuid, campaign->uuid_str ) ) {
+        switch_mutex_unlock( globals.mutex );
+        switch_core_destroy_memory_pool( &pool );
+        return NULL;
+    }
+    switch_core_hash_insert( globals.campaigns_by_name, campaign->campaign_requested, campaign );
+    switch_core_hash_insert( globals.campaigns_by_uuid, campaign->uuid_str, campaign );
+    campaign->next = globals.campaign_list;
+    globals.campaign_list = campaign;
+    globals.campaign_count++;
+    campaign->registered = SWITCH_TRUE;
+    /* one reference for the registry, one for the caller */
+    campaign->refs = 2;
+    switch_mutex_unlock( globals.mutex );
+
+    return campaign;
 }
 
-/*!\brief Loop through campaign's array searching for an empty "campaigns[i].campaign_requested", meaning such index is not being used
- * parameter `found_campaign` is a "struct db_campaign_config **", this will be pointing to the found slot if a slot was found.
- * parameter `campaign_requested` is the campaign to start, we will assign it to "globals.campaigns[i].campaign_requested" so that no other thread can use it
- * return SWITCH_TRUE if a slot was found and successfully assigned, SWITCH_FALSE otherwise
+/*!\brief Run a registered campaign in a thread of its own, which takes over the caller's reference
+ * return SWITCH_FALSE if the thread couldn't be started, the campaign is unregistered and the reference dropped then
  */
-static int dialer_get_empty_index(struct db_campaign_config ** found_campaign, const char * campaign_requested )
+static switch_bool_t dialer_campaign_spawn( struct db_campaign_config *campaign )
 {
-    for (int i=0; i<MAX_CAMPAIGNS; i++) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Looking for campaign with empty 'campaign_requested' [%d]: <%s>\n", i, globals.campaigns[i].campaign_requested);
-        if ( zstr( globals.campaigns[i].campaign_requested ) ) {
-            return i;
-        }
+    switch_thread_t *thread;
+    switch_threadattr_t *thd_attr = NULL;
+
+    switch_threadattr_create( &thd_attr, campaign->pool );
+    switch_threadattr_detach_set( thd_attr, 1 );
+    switch_threadattr_stacksize_set( thd_attr, SWITCH_THREAD_STACKSIZE );
+
+    if ( switch_thread_create( &thread, thd_attr, dialer_start_campaign, campaign, campaign->pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Couldn't start a thread for campaign %s\n", campaign->campaign_requested );
+        switch_safe_free( campaign->resume );
+        dialer_campaign_unregister( campaign );
+        dialer_campaign_release( campaign );
+        return SWITCH_FALSE;
     }
-    return -1;
+    return SWITCH_TRUE;
 }
 
-static int dialer_get_campaign_by_name( const char * campaign_requested )
+/*!\brief Look a registered campaign up by name, or by campaign uuid
+ * return the campaign with a reference the caller must drop with dialer_campaign_release(), NULL if not found
+ */
+static struct db_campaign_config *dialer_campaign_find( const char *name_or_uuid )
 {
-    for (int i=0; i<MAX_CAMPAIGNS; i++) {
-        if ( !strcmp( globals.campaigns[i].campaign_requested, campaign_requested ) ) {
-            return i;
+    struct db_campaign_config *campaign = NULL;
+
+    if ( zstr( name_or_uuid ) ) {
+        return NULL;
+    }
+
+    switch_mutex_lock( globals.mutex );
+    if ( !( campaign = switch_core_hash_find( globals.campaigns_by_name, name_or_uuid ) ) ) {
+        campaign = switch_core_hash_find( globals.campaigns_by_uuid, name_or_uuid );
+    }
+    if ( campaign ) {
+        campaign->refs++;
+    }
+    switch_mutex_unlock( globals.mutex );
+
+    return campaign;
+}
+
+/*!\brief Drop a reference, the last one frees the campaign
+ */
+static void dialer_campaign_release( struct db_campaign_config *campaign )
+{
+    switch_memory_pool_t *pool = NULL;
+
+    switch_mutex_lock( globals.mutex );
+    if ( --campaign->refs == 0 ) {
+        pool = campaign->pool;
+    }
+    switch_mutex_unlock( globals.mutex );
+
+    if ( pool ) {
+        switch_core_destroy_memory_pool( &pool );
+    }
+}
+
+/*!\brief Take a reference to every registered campaign, so that they can be read without holding the registry lock
+ * return a malloc'ed array of `count` campaigns to give back with dialer_campaign_release_all(), NULL if none is registered
+ */
+static struct db_campaign_config **dialer_campaign_hold_all( int *count )
+{
+    struct db_campaign_config **campaigns = NULL, *campaign;
+
+    *count = 0;
+    switch_mutex_lock( globals.mutex );
+    if ( globals.campaign_count > 0 ) {
+        switch_zmalloc( campaigns, sizeof( *campaigns ) * globals.campaign_count );
+        for ( campaign = globals.campaign_list; campaign && *count < globals.campaign_count; campaign = campaign->next ) {
+            campaign->refs++;
+            campaigns[ (*count)++ ] = campaign;
         }
     }
-    return -1;
+    switch_mutex_unlock( globals.mutex );
+
+    return campaigns;
 }
 
-static int dialer_get_campaign_by_uuid( const char * uuid )
+/*!\brief Drop the references dialer_campaign_hold_all() took and free its array
+ */
+static void dialer_campaign_release_all( struct db_campaign_config **campaigns, int count )
 {
-    for (int i=0; i<MAX_CAMPAIGNS; i++) {
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Looking for campaign with empty 'campaign_requested' [%d]: <%s>\n", i, globals.campaigns[i].campaign_requested);
-        if ( strcmp( globals.campaigns[i].uuid_str, uuid ) == 0 ) {
-            return i;
+    for ( int i=0; i<count; i++ ) {
+        dialer_campaign_release( campaigns[i] );
+    }
+    switch_safe_free( campaigns );
+}
+
+/*!\brief Take the campaign out of the registry and drop the registry's reference, holders of other references keep a valid campaign
+ */
+static void dialer_campaign_unregister( struct db_campaign_config *campaign )
+{
+    struct db_campaign_config **link;
+
+    switch_mutex_lock( globals.mutex );
+    if ( campaign->registered == SWITCH_FALSE ) {
+        switch_mutex_unlock( globals.mutex );
+        return;
+    }
+
+    switch_core_hash_delete( globals.campaigns_by_name, campaign->campaign_requested );
+    switch_core_hash_delete( globals.campaigns_by_uuid, campaign->uuid_str );
+    for ( link = &globals.campaign_list; *link; link = &(*link)->next ) {
+        if ( *link == campaign ) {
+            *link = campaign->next;
+            break;
         }
     }
-    return -1;
+    campaign->next = NULL;
+    campaign->registered = SWITCH_FALSE;
+    globals.campaign_count--;
+    switch_mutex_unlock( globals.mutex );
+
+    dialer_campaign_release( campaign );
 }
 
 static switch_bool_t dialer_stop_campaign( const char * campaign_to_stop  )
 {
+    struct db_campaign_config *campaign = NULL;
+
     switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: stopping campaign %s\n", campaign_to_stop );
-    for ( int i=0; i<MAX_CAMPAIGNS; i++  ) {
-        if ( !zstr(campaign_to_stop)  ) {
-            if ( strcmp( globals.campaigns[i].campaign_requested, campaign_to_stop ) == 0  ) {
-                switch_mutex_lock(globals.mutex);
-switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
-
-                globals.campaigns[i].stop = SWITCH_TRUE;
-                switch_mutex_unlock(globals.mutex);
-switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
+    if ( !( campaign = dialer_campaign_find( campaign_to_stop ) ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Couldn't find campaign %s\n", campaign_to_stop );
+        return SWITCH_FALSE;
+    }
 
-                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: stopped %s\n", campaign_to_stop );
-                return SWITCH_TRUE;
-            }
+    switch_mutex_lock( campaign->mutex );
+    campaign->stop = SWITCH_TRUE;
+    switch_mutex_unlock( campaign->mutex );
+    dialer_campaign_release( campaign );
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: stopped %s\n", campaign_to_stop );
+    return SWITCH_TRUE;
+}
+
+static switch_bool_t dialer_delete_campaign( const char * campaign_to_delete )
+{
+    struct db_campaign_config *campaign = NULL;
+
+    if ( !( campaign = dialer_campaign_find( campaign_to_delete ) ) ) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: campaign <%s> not found\n", campaign_to_delete );
+        return SWITCH_FALSE;
+    }
+
+    if ( campaign->running ) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: can't stop campaign <%s> is running\n", campaign_to_delete );
+        dialer_campaign_release( campaign );
+        return SWITCH_FALSE;
+    }
+
+    dialer_campaign_unregister( campaign );
+    dialer_campaign_release( campaign );
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: deleted campaign %s\n", campaign_to_delete );
+    return SWITCH_TRUE;
+}
+
+/*!\brief Make sure `table` exists as a destination_list, creating or upgrading it as needed, and that the campaign
+ * state table is there too
+ */
+static switch_bool_t dialer_check_destinations_table( const char *table )
+{
+    switch_cache_db_handle_t *dbh = NULL;
+    switch_bool_t ret = SWITCH_FALSE;
+    char destinations_sql[1536];
+    char destinations_check_sql[100];
+    char destinations_delete_sql[100];
+    char destinations_id_check_sql[100];
+    char destinations_id_sql[150];
+    char destinations_lease_check_sql[100];
+    char destinations_lease_sql[300];
+
+    if (!(dbh = dialer_get_db_handle())) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Cannot open DB!\n" );
+        return SWITCH_FALSE;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: Connected to db!\n" );
+    /* every %s of the dialect's CREATE TABLE is the table name, unused arguments are ignored */
+    switch_snprintf(destinations_sql, sizeof(destinations_sql), globals.dialect->destinations_create, table, table, table, table, table, table, table);
+    switch_snprintf(destinations_check_sql, sizeof(destinations_check_sql), destinations_check_format, table);
+    switch_snprintf(destinations_delete_sql, sizeof(destinations_delete_sql), destinations_delete_format, table);
+
+    if ( !(switch_cache_db_test_reactive(dbh, destinations_check_sql, destinations_delete_sql, destinations_sql)))
+    {
+        goto end;
+    } else {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: destinations table looks good\n" );
+    }
+
+    if ( globals.dialect->destinations_id_add ) {
+        switch_snprintf(destinations_id_check_sql, sizeof(destinations_id_check_sql), destinations_id_check_format, table);
+        switch_snprintf(destinations_id_sql, sizeof(destinations_id_sql), globals.dialect->destinations_id_add, table);
+        if ( !(switch_cache_db_test_reactive(dbh, destinations_id_check_sql, NULL, destinations_id_sql)) )
+        {
+            goto end;
         }
     }
-    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Couldn't find campaign %s\n", campaign_to_stop );
-    return SWITCH_FALSE;
+
+    if ( globals.dialect->destinations_lease_add ) {
+        switch_snprintf(destinations_lease_check_sql, sizeof(destinations_lease_check_sql), destinations_lease_check_format, table);
+        switch_snprintf(destinations_lease_sql, sizeof(destinations_lease_sql), globals.dialect->destinations_lease_add, table);
+        if ( !(switch_cache_db_test_reactive(dbh, destinations_lease_check_sql, NULL, destinations_lease_sql)) )
+        {
+            goto end;
+        }
+    }
+
+    if ( !(switch_cache_db_test_reactive(dbh, campaign_state_check_sql, NULL, globals.dialect->campaign_state_create)) )
+    {
+        goto end;
+    }
+    ret = SWITCH_TRUE;
+
+end:
+    switch_cache_db_release_db_handle(&dbh);
+    return ret;
 }
 
-static switch_bool_t dialer_delete_campaign( const char * campaign_to_delete )
+/*!\brief Find the SQL dialect called `name`, or guess it from the DSN when no name is given: the core's own
+ * database (a plain dbname or sqlite://) is SQLite, pgsql:// is PostgreSQL and anything else is taken as MySQL over ODBC
+ * return NULL if there is no dialect by that name
+ */
+static const struct dialer_sql_dialect *dialer_sql_dialect_select( const char *name )
 {
-    int campaign_index = dialer_get_campaign_by_name( campaign_to_delete );
-    
-    if( globals.campaigns[campaign_index].running == 0 ) {
-        if ( campaign_index > -1 && campaign_index < MAX_CAMPAIGNS ) {
-            globals.campaigns[campaign_index].campaign_requested[0] = '\0';
-            globals.campaigns[campaign_index].datetime_start[0] = '\0';
-            globals.campaigns[campaign_index].context[0] = '\0';
-            globals.campaigns[campaign_index].custom_header_name[0] = '\0';
-            globals.campaigns[campaign_index].custom_header_value[0] = '\0';
-            globals.campaigns[campaign_index].max_concurrent_calls = 0;
-            globals.campaigns[campaign_index].time_between_calls = 0;
-            globals.campaigns[campaign_index].attempts_per_number = 0;
-            globals.campaigns[campaign_index].time_between_retries = 0;
-            globals.campaigns[campaign_index].gaussian_distribution = 0;
-            globals.campaigns[campaign_index].gaussian_distribution_mean = 0;
-            globals.campaigns[campaign_index].gaussian_distribution_stdv = 0;
-            globals.campaigns[campaign_index].call_max_duration = 0;
-            globals.campaigns[campaign_index].call_min_duration = 0;
-            globals.campaigns[campaign_index].originate_timeout = 0;
-            globals.campaigns[campaign_index].global_caller_id[0] = '\0';
-            globals.campaigns[campaign_index].action_on_anwser[0] = '\0';
-            globals.campaigns[campaign_index].destination_list[0] = '\0';
-            globals.campaigns[campaign_index].codec_list[0] = '\0';
-            globals.campaigns[campaign_index].uuid_str[0] = '\0';
-            globals.campaigns[campaign_index].profile_gateway[0] = '\0';
-            globals.campaigns[campaign_index].dialplan_type[0] = '\0';
-            globals.campaigns[campaign_index].transfer_on_answer[0] = '\0';
-            globals.campaigns[campaign_index].finish_on = 0;
-            globals.campaigns[campaign_index].calling_strategy = '\0';
-			globals.campaigns[campaign_index].cancel_ratio = 0;
+    int i;
 
+    if ( zstr( name ) ) {
+        if ( zstr( globals.odbc_dsn ) || !strncasecmp( globals.odbc_dsn, "sqlite://", 9 ) ) {
+            name = "sqlite";
+        } else if ( !strncasecmp( globals.odbc_dsn, "pgsql://", 8 ) || !strncasecmp( globals.odbc_dsn, "postgres", 8 ) ) {
+            name = "pgsql";
         } else {
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: campaign <%s> not found\n", campaign_to_delete );
-            return SWITCH_FALSE;
+            name = "mysql";
         }
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: deleted campaign %s\n", campaign_to_delete );
-        return SWITCH_TRUE;
-    } else {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: can't stop campaign <%s> is running\n", campaign_to_delete );
-        return SWITCH_FALSE;
     }
-    
+
+    for ( i = 0; i < (int) ( sizeof( dialer_sql_dialects ) / sizeof( dialer_sql_dialects[0] ) ); i++ ) {
+        if ( !strcasecmp( dialer_sql_dialects[i].name, name ) ) {
+            return &dialer_sql_dialects[i];
+        }
+    }
+    return NULL;
+}
+
+/*!\brief The dialect's expression for now + `seconds` (negative for the past), written into `buf`
+ */
+static const char *dialer_sql_time( char *buf, switch_size_t len, int seconds )
+{
+    switch_snprintf( buf, len, globals.dialect->now_offset, seconds );
+    return buf;
 }
 
 static switch_cache_db_handle_t *dialer_get_db_handle(void)
@@ -1074,11 +2762,9 @@ static switch_bool_t dialer_execute_sql_callback( switch_mutex_t *mutex, char *s
 
     //switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: in dialer_execute_sql_callback function\n");
 
+    /* Cached db handles are per thread, only serialize when the caller asks for it */
     if (mutex) {
         switch_mutex_lock(mutex);
-    } else {
-        switch_mutex_lock(globals.mutex);
-        //switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: LOCKING globals.mutex\n");
     }
 
     if (!(dbh = dialer_get_db_handle())) {
@@ -1101,259 +2787,3613 @@ end:
 
     if (mutex) {
         switch_mutex_unlock(mutex);
-    } else {
-        switch_mutex_unlock(globals.mutex);
-        //switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
     }
 
     //switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: going OUT of dialer_execute_sql_callback function\n");
     return ret;
 }
 
+struct dialer_lease {
+    struct dialer_destination *destinations;
+    int max;
+    int count;
+};
+
+/*!\brief SQL callback for the lease query, copies every returned row into the lease's destination array
+ */
 static int dialer_dests_callback(void *pArg, int argc, char **argv, char **columnNames)
 {
-#define MAX_DIAL_STRING 256
-
-    char *my_uuid = (char *) pArg;
-    const char *number = argv[0];
-    const char *lastcall = argv[1];
-    const char *lastresult = argv[2];
-    const char *calls = argv[3];
-    const char *inuse = argv[4];
-    int duration_in_table = atoi( argv[5] );
-    const char *sql_get_numbers;
-    const char *custom_header = NULL, *sched_duration = NULL;
-    int rnd_number = 0;
-    
-    int campaign_index = -1;
-    char *exten, *cid_name, *cid_num;
-    
-    switch_core_session_t *caller_session = NULL;
-    switch_call_cause_t *ccause = SWITCH_CAUSE_NONE;
-    uint32_t timeout = 60;
+    struct dialer_lease *lease = (struct dialer_lease *) pArg;
+    struct dialer_destination *destination;
 
-    switch_call_cause_t cause = SWITCH_CAUSE_NORMAL_CLEARING;
+    if ( lease->count >= lease->max || zstr( argv[0] ) ) {
+        return 0;
+    }
 
-    campaign_index = dialer_get_campaign_by_uuid( my_uuid );
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: in dialer_dests_callback function\n");
+    destination = &lease->destinations[ lease->count++ ];
+    memset( destination, 0, sizeof( *destination ) );
+    // argv[0] is the number, argv[1] the callerid, argv[2] the duration, argv[3] the row id and argv[4] the calls so far
+    switch_copy_string( destination->number, argv[0], sizeof( destination->number ) );
+    if ( !zstr( argv[1] ) ) {
+        switch_copy_string( destination->callerid, argv[1], sizeof( destination->callerid ) );
+    }
+    destination->duration = zstr( argv[2] ) ? 0 : atoi( argv[2] );
+    destination->id = ( argc > 3 && !zstr( argv[3] ) ) ? (uint32_t) strtoul( argv[3], NULL, 10 ) : 0;
+    destination->calls = ( argc > 4 && !zstr( argv[4] ) ) ? atoi( argv[4] ) : 0;
 
-    //ORIGINATE_SYNTAX "<call url> <exten>|&<application_name>(<app_args>) [<dialplan>] [<context>] [<cid_name>] [<cid_num>] [<timeout_sec>]"
+    return 0;
+}
 
-    if ( campaign_index > -1 && globals.campaigns[ campaign_index ].stop == SWITCH_TRUE ) {
-        return 1;
+/*!\brief Claim eligible rows for this campaign run and read them back. The claim is a single UPDATE, so two nodes dialing the same
+ * destination_list can never both get a row; claimed rows are flagged in_use = 2 until they have been read, then in_use = 1.
+ * `filter` narrows the eligible rows, `order_limit` is appended to the claim. Return the amount of rows claimed, -1 on error
+ */
+static int dialer_claim_destinations( struct db_campaign_config *campaign, struct dialer_lease *lease, const char *filter, const char *order_limit, const char *order )
+{
+    char *sql = NULL, *where = NULL;
+    char lease_expires[64], retry_after[64];
+    switch_bool_t ret;
+    switch_time_t started = switch_micro_time_now();
+
+    where = switch_mprintf( "%s and in_use = 0 and calls < %d and ( lastcall is NULL or lastcall < %s ) %s", filter, campaign->attempts_per_number,
+                            dialer_sql_time( retry_after, sizeof( retry_after ), -campaign->time_between_retries ), order_limit );
+    if ( globals.dialect->update_limit || zstr( order_limit ) ) {
+        sql = switch_mprintf( "update %s set in_use = 2, lease_owner = '%q', lease_expires = %s where %s", campaign->destination_list, campaign->uuid_str,
+                              dialer_sql_time( lease_expires, sizeof( lease_expires ), globals.lease_seconds ), where );
+    } else {
+        sql = switch_mprintf( "update %s set in_use = 2, lease_owner = '%q', lease_expires = %s where number in ( select number from %s where %s%s )", campaign->destination_list,
+                              campaign->uuid_str, dialer_sql_time( lease_expires, sizeof( lease_expires ), globals.lease_seconds ), campaign->destination_list, where,
+                              globals.dialect->claim_lock );
+    }
+    switch_safe_free( where );
+    ret = dialer_execute_sql( sql );
+    switch_safe_free( sql );
+    if ( ret == SWITCH_FALSE ) {
+        return -1;
     }
 
-    if ( campaign_index < 0 ) {
+    sql = switch_mprintf( "select number, callerid, duration, id, calls from %s where lease_owner = '%q' and in_use = 2 %s", campaign->destination_list, campaign->uuid_str, order );
+    ret = dialer_execute_sql_callback( NULL, sql, dialer_dests_callback, lease );
+    switch_safe_free( sql );
+    if ( ret == SWITCH_FALSE ) {
         return -1;
-    } else {
-    
-        struct randnorm_state rs;
-    
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Number belongs to campaign %s with uuid: %s I got number: %s - lastcall: %s - lastresult: %s"" - calls: %s - inuse: %s\n" , globals.campaigns[ campaign_index ].name, my_uuid, number, lastcall, lastresult, calls, inuse );
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Originating call...\n" );
+    }
 
-        /* set vars from campaign globals */
-        exten = globals.campaigns[ campaign_index ].action_on_anwser;
-        
-        /* 	
-        	If cancel_ratio > 0 then we just set the sched_hangup for 1 second, else
-        	If gaussian is disabled, duration in table is 0 and max and min_call_duration is 0, we set no time limit 
-        */
-        
-        rnd_number = ( rand() % ( 100 + 1 - 0 ) + 0 );
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Random Number: %d - cancel_ratio: %d\n", rnd_number, globals.campaigns[ campaign_index ].cancel_ratio );
+    sql = switch_mprintf( "update %s set in_use = 1 where lease_owner = '%q' and in_use = 2", campaign->destination_list, campaign->uuid_str );
+    ret = dialer_execute_sql( sql );
+    switch_safe_free( sql );
 
-        if ( globals.campaigns[ campaign_index ].cancel_ratio > 0 && rnd_number < globals.campaigns[ campaign_index ].cancel_ratio ) {
-			sched_duration = switch_mprintf( "execute_on_pre_answer='sched_api +1 normal_clearing bleg'" );
-	        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: ------------------>>>>>>> Random Number: %d - cancel_ratio: %d\n", rnd_number, globals.campaigns[ campaign_index ].cancel_ratio );
-        } else {
-			if ( globals.campaigns[ campaign_index ].gaussian_distribution == 0 ) {
-				if ( duration_in_table == 0 ) {
-					if ( globals.campaigns[ campaign_index ].call_max_duration == 0 && globals.campaigns[ campaign_index ].call_min_duration == 0 ) {
-						sched_duration = "";
-					} else {
-						sched_duration = switch_mprintf( "execute_on_answer='sched_hangup +%d alloted_timeout'", rand() % ( globals.campaigns[ campaign_index ].call_max_duration + 1 - globals.campaigns[ campaign_index ].call_min_duration) + globals.campaigns[ campaign_index ].call_min_duration );
-					}
-				} else {
-					sched_duration = switch_mprintf( "execute_on_answer='sched_hangup +%d alloted_timeout'", duration_in_table);
-				}
-			} else if ( globals.campaigns[ campaign_index ].gaussian_distribution_mean > 0 && globals.campaigns[ campaign_index ].gaussian_distribution_stdv > 0 ) {
-				randnorm_init(&rs, time(NULL));
-				sched_duration = switch_mprintf( "execute_on_answer='sched_hangup +%d alloted_timeout'", (int)randnorm_r(&rs, globals.campaigns[ campaign_index ].gaussian_distribution_mean, globals.campaigns[ campaign_index ].gaussian_distribution_stdv) );
-			} else {
-				switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: gaussian distribution is enabled, but there's no 'mean' or 'stdv', please set them or disable it!\n");
-				return 0;
-			}
-	    }
-	    
-	    if ( !zstr( globals.campaigns[ campaign_index ].custom_header_name) && !zstr( globals.campaigns[ campaign_index ].custom_header_value) ) {
-            custom_header = switch_mprintf("%s=%s,", globals.campaigns[ campaign_index ].custom_header_name, globals.campaigns[ campaign_index ].custom_header_value);
-            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: added custom header: %s -> %s\n", globals.campaigns[ campaign_index ].custom_header_name, globals.campaigns[ campaign_index ].custom_header_value);
-	    }
-	           
-        sql_get_numbers = switch_mprintf(
-            "{"
-				"%s"
-				"originate_timeout=%d,"
-				"campaign_id=%d,"
-				"origination_caller_id_name=%s,"
-				"origination_caller_id_number=%s,"
-				"absolute_codec_string='%s',"
-				"%s"
-            "}sofia/gateway/%s/%s", 
-            custom_header,
-            globals.campaigns[ campaign_index ].originate_timeout, 
-            campaign_index,
-            number,
-            number,
-            globals.campaigns[ campaign_index ].codec_list,
-            sched_duration, 
-            globals.campaigns[ campaign_index ].profile_gateway, 
-            number 
-        );
-
-		// argv[6] is the incoming callerid from the sql query to the destinations table
-		if ( strlen(argv[6]) == 0 ) {
-        	cid_name = globals.campaigns[ campaign_index ].global_caller_id;
-        	cid_num = globals.campaigns[ campaign_index ].global_caller_id;
-        } else {
-			cid_name = argv[6];
-			cid_num = argv[6];
-        }
+    dialer_histogram_observe( &campaign->pick_latency, dialer_latency_bounds, switch_micro_time_now() - started );
 
-        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: dial_string: %s -> %s\n", sql_get_numbers, exten );
+    return ret == SWITCH_TRUE ? lease->count : -1;
+}
 
-		globals.campaigns[ campaign_index ].calls_made++;
-		globals.campaigns[ campaign_index ].current_calls++;
-		if ( dialer_set_number_inuse( campaign_index, number, "1" ) == SWITCH_FALSE ) {
-			switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't set the number as 'in-use' on the dbtable! cancelling...\n");
-			return 1;
-		}
+static uint32_t dialer_perm_mix( uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
 
-        if (switch_ivr_originate(NULL, &caller_session, &cause, sql_get_numbers, timeout, NULL, cid_name, cid_num, NULL, NULL, 0, ccause, NULL) != SWITCH_STATUS_SUCCESS || !caller_session ) {
-        	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: something went wrong when sending the call, skipping\n");
-            dialer_set_number_inuse( campaign_index, number, "0" );
-            return 0;
-        } else {
-            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: call sent, with transfer: exten:%s, dialplan_type:%s, context: %s\n", globals.campaigns[ campaign_index ].transfer_on_answer , globals.campaigns[ campaign_index ].dialplan_type, globals.campaigns[ campaign_index ].context);
-            if ( !dialer_increment_number_calls( campaign_index, number ) ) {
-                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: I couldn't increment the number's calls: %s\n", number );
-            }
-            switch_ivr_session_transfer(caller_session, globals.campaigns[ campaign_index ].transfer_on_answer , globals.campaigns[ campaign_index ].dialplan_type, globals.campaigns[ campaign_index ].context);
-        }
+/*!\brief Key a Feistel network whose block covers [0, size)
+ */
+static void dialer_perm_init( struct dialer_permutation *perm, uint32_t seed, uint32_t size )
+{
+    uint32_t bits = 2;
+    int i;
 
-        switch_core_session_rwunlock(caller_session);
+    while ( bits < 32 && ( (uint64_t) 1 << bits ) < size ) {
+        bits += 2;
+    }
 
+    perm->seed = seed;
+    perm->size = size;
+    perm->half_bits = bits / 2;
+    perm->half_mask = ( 1U << perm->half_bits ) - 1;
+    for ( i = 0; i < DIALER_FEISTEL_ROUNDS; i++ ) {
+        perm->keys[i] = dialer_perm_mix( seed + 0x9e3779b9 * ( i + 1 ) );
     }
-    return 0;
 }
 
-static void dialer_clear_struct_slot(int index)
+static uint32_t dialer_perm_encrypt( struct dialer_permutation *perm, uint32_t value )
 {
-    switch_mutex_unlock(globals.mutex);
-	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
-
-        globals.campaigns[index].campaign_requested[0] = '\0';
-        globals.campaigns[index].name[0] = '\0';
-        globals.campaigns[index].datetime_start[0] = '\0';
-        globals.campaigns[index].context[0] = '\0';
-        globals.campaigns[index].running = SWITCH_FALSE;
-        globals.campaigns[index].stop = SWITCH_FALSE;
-        globals.campaigns[index].max_concurrent_calls = 0;
-        globals.campaigns[index].time_between_calls = 0;
-        globals.campaigns[index].attempts_per_number = 0;
-        globals.campaigns[index].time_between_retries = 0;
-        globals.campaigns[index].call_max_duration = 0;
-        globals.campaigns[index].call_min_duration = 0;
-        globals.campaigns[index].originate_timeout = 0;
-        globals.campaigns[index].global_caller_id[0] = '\0';
-        globals.campaigns[index].action_on_anwser[0] = '\0';
-        globals.campaigns[index].transfer_on_answer[0] = '\0';
-        globals.campaigns[index].destination_list[0] = '\0';
-        globals.campaigns[index].codec_list[0] = '\0';
-        globals.campaigns[index].profile_gateway[0] = '\0';
-        globals.campaigns[index].calling_strategy = 0;
-        globals.campaigns[index].my_local_ip[0] = '\0';
-        globals.campaigns[index].uuid_str[0] = '\0';
-        globals.campaigns[index].current_calls = 0;
-        globals.campaigns[index].calls_made = 0;
-        globals.campaigns[index].answered = 0;
-        globals.campaigns[index].total_seconds = 0;
-        globals.campaigns[index].cancel_ratio = 0;
-    switch_mutex_unlock(globals.mutex);
-	switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: UN-LOCKING globals.mutex\n");
+    uint32_t left = ( value >> perm->half_bits ) & perm->half_mask;
+    uint32_t right = value & perm->half_mask;
+    uint32_t tmp;
+    int i;
+
+    for ( i = 0; i < DIALER_FEISTEL_ROUNDS; i++ ) {
+        tmp = right;
+        right = left ^ ( dialer_perm_mix( right ^ perm->keys[i] ) & perm->half_mask );
+        left = tmp;
+    }
+    return ( left << perm->half_bits ) | right;
+}
 
+static uint32_t dialer_perm_decrypt( struct dialer_permutation *perm, uint32_t value )
+{
+    uint32_t left = ( value >> perm->half_bits ) & perm->half_mask;
+    uint32_t right = value & perm->half_mask;
+    uint32_t tmp;
+    int i;
+
+    for ( i = DIALER_FEISTEL_ROUNDS - 1; i >= 0; i-- ) {
+        tmp = left;
+        left = right ^ ( dialer_perm_mix( left ^ perm->keys[i] ) & perm->half_mask );
+        right = tmp;
+    }
+    return ( left << perm->half_bits ) | right;
 }
 
-static switch_bool_t dialer_set_number_inuse( int campaign_index, const char *number, const char * status ) 
+/*!\brief Position `index` of the permutation, cycle-walking the block down to [0, size)
+ */
+static uint32_t dialer_perm_forward( struct dialer_permutation *perm, uint32_t index )
 {
-    char *errmsg = NULL;
-    char *sql_update = NULL;
-    switch_cache_db_handle_t *dbh = NULL;
-    switch_bool_t ret = SWITCH_FALSE;
-    
-    if (!(dbh = dialer_get_db_handle())) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Error Opening DB\n");
-        ret = SWITCH_FALSE;
-        goto end;
+    uint32_t value = index;
+
+    do {
+        value = dialer_perm_encrypt( perm, value );
+    } while ( value >= perm->size );
+
+    return value;
+}
+
+/*!\brief Position at which `value` is visited
+ */
+static uint32_t dialer_perm_inverse( struct dialer_permutation *perm, uint32_t value )
+{
+    uint32_t index = value;
+
+    do {
+        index = dialer_perm_decrypt( perm, index );
+    } while ( index >= perm->size );
+
+    return index;
+}
+
+static int dialer_max_id_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+    uint32_t *max_id = (uint32_t *) pArg;
+
+    *max_id = zstr( argv[0] ) ? 0 : (uint32_t) strtoul( argv[0], NULL, 10 );
+    return 0;
+}
+
+/*!\brief Start a new RANDOM pass over the ids currently in the destination_list, the seed stays the same for the whole run
+ */
+static void dialer_perm_start_pass( struct db_campaign_config *campaign )
+{
+    uint32_t max_id = 0;
+    char *sql = switch_mprintf( "select max(id) from %s", campaign->destination_list );
+
+    dialer_execute_sql_callback( NULL, sql, dialer_max_id_callback, &max_id );
+    switch_safe_free( sql );
+
+    dialer_perm_init( &campaign->perm, campaign->perm.seed, max_id );
+    campaign->perm_pos = 0;
+}
+
+struct dialer_perm_slot {
+    uint32_t position;
+    struct dialer_destination destination;
+};
+
+static int dialer_perm_compare( const void *a, const void *b )
+{
+    uint32_t pa = ( (const struct dialer_perm_slot *) a )->position;
+    uint32_t pb = ( (const struct dialer_perm_slot *) b )->position;
+
+    return pa < pb ? -1 : pa > pb;
+}
+
+/*!\brief RANDOM lease: walk the campaign's permutation of row ids and fetch the next eligible rows by id
+ * ids 1..size are visited exactly once per pass, no table-wide sort is involved
+ */
+static int dialer_lease_random( struct db_campaign_config *campaign, struct dialer_lease *lease )
+{
+    struct dialer_perm_slot *slots = NULL;
+    char *in_list = NULL;
+    size_t in_size, in_len;
+    int candidates, i;
+
+    in_size = (size_t) lease->max * 12 + 8;
+    if ( !( in_list = malloc( in_size ) ) ) {
+        return -1;
     }
-    
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "update %s set lastcall=NOW(), in_use = 1 where number = '%s';", globals.campaigns[ campaign_index ].destination_list, number );
-    sql_update = switch_mprintf( "update %s set lastcall=NOW(), in_use = %s where number = '%s';", globals.campaigns[ campaign_index ].destination_list, status, number );
-    switch_cache_db_execute_sql( dbh, sql_update, &errmsg );
 
-    if (errmsg) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: SQL ERR: [%s] %s\n", sql_update, errmsg);
-        free(errmsg);
+    while ( lease->count == 0 ) {
+        if ( campaign->perm_pos >= campaign->perm.size ) {
+            if ( campaign->perm.size > 0 && campaign->perm_misses >= campaign->perm.size ) {
+                /* a whole pass without a single eligible row */
+                break;
+            }
+            dialer_perm_start_pass( campaign );
+            if ( campaign->perm.size == 0 ) {
+                break;
+            }
+        }
+
+        in_len = switch_snprintf( in_list, in_size, "id in (" );
+        for ( candidates = 0; candidates < lease->max && campaign->perm_pos < campaign->perm.size; candidates++ ) {
+            in_len += switch_snprintf( in_list + in_len, in_size - in_len, "%s%u", candidates ? "," : "", dialer_perm_forward( &campaign->perm, campaign->perm_pos++ ) + 1 );
+        }
+        switch_snprintf( in_list + in_len, in_size - in_len, ")" );
+
+        if ( dialer_claim_destinations( campaign, lease, in_list, "", "" ) < 0 ) {
+            free( in_list );
+            return -1;
+        }
+
+        campaign->perm_misses = lease->count ? 0 : campaign->perm_misses + candidates;
+    }
+    free( in_list );
+
+    /* the IN list comes back in index order, put the batch back into permutation order */
+    if ( lease->count > 1 && ( slots = malloc( sizeof( struct dialer_perm_slot ) * lease->count ) ) ) {
+        for ( i = 0; i < lease->count; i++ ) {
+            slots[i].position = dialer_perm_inverse( &campaign->perm, lease->destinations[i].id - 1 );
+            slots[i].destination = lease->destinations[i];
+        }
+        qsort( slots, lease->count, sizeof( struct dialer_perm_slot ), dialer_perm_compare );
+        for ( i = 0; i < lease->count; i++ ) {
+            lease->destinations[i] = slots[i].destination;
+        }
+        free( slots );
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: leased %d numbers for campaign %s (pass position %u of %u)\n", lease->count, campaign->name, campaign->perm_pos, campaign->perm.size );
+    return lease->count;
+}
+
+/*!\brief Claim up to `max` eligible rows from the campaign's destination_list for this campaign run
+ * return the amount of rows leased, -1 on error
+ */
+static int dialer_lease_destinations( struct db_campaign_config *campaign, struct dialer_destination *destinations, int max )
+{
+    struct dialer_lease lease = { 0 };
+    char *filter = NULL;
+    char order_limit[64];
+    int claimed;
+
+    if ( campaign->file ) {
+        return dialer_file_lease( campaign, destinations, max );
+    }
+
+    lease.destinations = destinations;
+    lease.max = max;
+
+    if ( campaign->calling_strategy != SEQUENTIAL ) {
+        return dialer_lease_random( campaign, &lease );
+    }
+
+again:
+    /* keyset pagination on the primary key: a range scan that starts where the last batch ended */
+    filter = switch_mprintf( "number > '%q'", campaign->cursor );
+    switch_snprintf( order_limit, sizeof( order_limit ), "order by number LIMIT %d", max );
+    claimed = dialer_claim_destinations( campaign, &lease, filter, order_limit, "order by number" );
+    switch_safe_free( filter );
+
+    if ( claimed < 0 ) {
+        return -1;
+    }
+
+    if ( lease.count > 0 ) {
+        switch_copy_string( campaign->cursor, destinations[ lease.count - 1 ].number, sizeof( campaign->cursor ) );
+    } else if ( !zstr( campaign->cursor ) ) {
+        /* end of the list, start another pass for whatever is still eligible */
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s reached the end of %s, starting over\n", campaign->name, campaign->destination_list );
+        campaign->cursor[0] = '\0';
+        goto again;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: leased %d numbers for campaign %s\n", lease.count, campaign->name );
+    return lease.count;
+}
+
+static int dialer_cursor_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+    struct db_campaign_config *campaign = (struct db_campaign_config *) pArg;
+
+    if ( !zstr( argv[0] ) ) {
+        switch_copy_string( campaign->cursor, argv[0], sizeof( campaign->cursor ) );
+        switch_copy_string( campaign->last_dialed, argv[0], sizeof( campaign->last_dialed ) );
+    }
+    return 0;
+}
+
+/*!\brief Pick up a SEQUENTIAL campaign where its previous run left off
+ */
+static void dialer_load_cursor( struct db_campaign_config *campaign )
+{
+    char *sql = NULL;
+
+    if ( campaign->file ) {
+        /* the sidecar keeps its own cursor */
+        return;
+    }
+
+    sql = switch_mprintf( "select last_number from dialer_campaign_state where campaign = '%q'", campaign->name );
+    dialer_execute_sql_callback( NULL, sql, dialer_cursor_callback, campaign );
+    switch_safe_free( sql );
+
+    if ( !zstr( campaign->cursor ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s resumes after number %s\n", campaign->name, campaign->cursor );
+    }
+}
+
+/*!\brief Persist the last number a SEQUENTIAL campaign handed to the dial loop
+ */
+static void dialer_save_cursor( struct db_campaign_config *campaign )
+{
+    char last_dialed[DIALER_NUMBER_SIZE];
+    char *sql = NULL;
+
+    if ( campaign->calling_strategy != SEQUENTIAL || campaign->file ) {
+        return;
+    }
+
+    switch_mutex_lock( campaign->queue_mutex );
+    switch_copy_string( last_dialed, campaign->last_dialed, sizeof( last_dialed ) );
+    switch_mutex_unlock( campaign->queue_mutex );
+
+    sql = switch_mprintf( globals.dialect->cursor_save, campaign->name, last_dialed );
+    dialer_execute_sql( sql );
+    switch_safe_free( sql );
+}
+
+/*!\brief Keep the campaign's in-memory queue topped up: whenever it drops under the low watermark lease another
+ * batch, bounded by the high watermark. An empty lease marks the list as exhausted.
+ */
+static void *SWITCH_THREAD_FUNC dialer_queue_refill_thread(switch_thread_t *thread, void *obj)
+{
+    struct db_campaign_config *campaign = (struct db_campaign_config *) obj;
+    struct dialer_destination *batch = NULL;
+    int want, leased, tail;
+
+    switch_zmalloc( batch, sizeof( struct dialer_destination ) * campaign->lease_batch_size );
+
+    switch_mutex_lock( campaign->queue_mutex );
+    while ( campaign->queue_running == SWITCH_TRUE ) {
+
+        if ( campaign->queue_exhausted == SWITCH_TRUE || campaign->queue_count > campaign->queue_low_watermark ) {
+            switch_thread_cond_timedwait( campaign->queue_refill_cond, campaign->queue_mutex, 1000000 );
+            continue;
+        }
+
+        want = switch_min( campaign->lease_batch_size, campaign->queue_high_watermark - campaign->queue_count );
+        switch_mutex_unlock( campaign->queue_mutex );
+
+        leased = dialer_lease_destinations( campaign, batch, want );
+        dialer_save_cursor( campaign );
+
+        switch_mutex_lock( campaign->queue_mutex );
+        if ( leased < 0 ) {
+            /* DB trouble, don't hammer it */
+            switch_thread_cond_timedwait( campaign->queue_refill_cond, campaign->queue_mutex, 1000000 );
+            continue;
+        }
+
+        for ( int i=0; i<leased; i++ ) {
+            tail = ( campaign->queue_head + campaign->queue_count ) % campaign->queue_high_watermark;
+            campaign->queue[ tail ] = batch[ i ];
+            campaign->queue_count++;
+        }
+
+        if ( leased == 0 ) {
+            campaign->queue_exhausted = SWITCH_TRUE;
+            /* rows loaded later get a fresh RANDOM pass instead of being written off with this one */
+            campaign->perm_misses = 0;
+        }
+        switch_thread_cond_broadcast( campaign->queue_avail_cond );
+    }
+    switch_mutex_unlock( campaign->queue_mutex );
+
+    free( batch );
+    return NULL;
+}
+
+/*!\brief Allocate the campaign's destination queue and start its refill thread
+ */
+static switch_bool_t dialer_queue_start( struct db_campaign_config *campaign )
+{
+    switch_threadattr_t *thd_attr = NULL;
+
+    campaign->queue = switch_core_alloc( campaign->pool, sizeof( struct dialer_destination ) * campaign->queue_high_watermark );
+    campaign->queue_head = 0;
+    campaign->queue_count = 0;
+    campaign->queue_exhausted = SWITCH_FALSE;
+    campaign->queue_running = SWITCH_TRUE;
+    campaign->cursor[0] = '\0';
+    campaign->last_dialed[0] = '\0';
+    campaign->last_dialed_id = 0;
+    memset( &campaign->retries, 0, sizeof( campaign->retries ) );
+    campaign->retries.now = (uint64_t) ( switch_micro_time_now() / 1000000 );
+
+    if ( campaign->resume ) {
+        /* cursor, permutation and retries straight from the checkpoint, no need to ask the table */
+        dialer_checkpoint_restore( campaign );
+    } else if ( campaign->calling_strategy == SEQUENTIAL ) {
+        dialer_load_cursor( campaign );
     } else {
-        ret = SWITCH_TRUE;
+        /* a fixed random_seed reproduces the calling order of a previous run */
+        campaign->perm.seed = campaign->random_seed ? (uint32_t) campaign->random_seed : (uint32_t) switch_micro_time_now() ^ (uint32_t) rand();
+        campaign->perm.size = 0;
+        campaign->perm_pos = 0;
+        campaign->perm_misses = 0;
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s random order seed is %u\n", campaign->name, campaign->perm.seed );
     }
-    
-end:
 
-    switch_cache_db_release_db_handle(&dbh);
+    switch_mutex_init( &campaign->queue_mutex, SWITCH_MUTEX_NESTED, campaign->pool );
+    switch_thread_cond_create( &campaign->queue_refill_cond, campaign->pool );
+    switch_thread_cond_create( &campaign->queue_avail_cond, campaign->pool );
 
-	if ( ret == SWITCH_TRUE ) {
-    	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: going OUT of dialer_set_number_inuse function - TRUE - ALL OK\n");
-	} else {
-	    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: going OUT of dialer_set_number_inuse function - FALSE - NOT OK\n");
-	}
+    switch_threadattr_create( &thd_attr, campaign->pool );
+    switch_threadattr_stacksize_set( thd_attr, SWITCH_THREAD_STACKSIZE );
 
-    return ret;
+    if ( switch_thread_create( &campaign->queue_thread, thd_attr, dialer_queue_refill_thread, campaign, campaign->pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Couldn't start the refill thread for campaign %s\n", campaign->name );
+        campaign->queue_thread = NULL;
+        campaign->queue_running = SWITCH_FALSE;
+        return SWITCH_FALSE;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s queue started: batch %d, low watermark %d, high watermark %d\n", campaign->name, campaign->lease_batch_size, campaign->queue_low_watermark, campaign->queue_high_watermark );
+    return SWITCH_TRUE;
 }
 
-static switch_bool_t dialer_increment_number_calls( int campaign_index, const char *number ) 
+/*!\brief Stop the refill thread and release the leased numbers that were never dialed
+ */
+static void dialer_queue_stop( struct db_campaign_config *campaign )
 {
-    char *errmsg = NULL;
-    char *sql_update = NULL;
-    switch_cache_db_handle_t *dbh = NULL;
-    switch_bool_t ret = SWITCH_FALSE;
-    
-    if (!(dbh = dialer_get_db_handle())) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Error Opening DB\n");
-        goto end;
+    switch_status_t st;
+    int index, count;
+
+    if ( !campaign->queue_thread ) {
+        return;
     }
-    
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "update %s set in_use = 1 where number = '%s';", globals.campaigns[ campaign_index ].destination_list, number );
-    sql_update = switch_mprintf( "update %s set calls = calls + 1 where number = '%s';", globals.campaigns[ campaign_index ].destination_list, number );
-    switch_cache_db_execute_sql( dbh, sql_update, &errmsg );
 
-    if (errmsg) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: SQL ERR: [%s] %s\n", sql_update, errmsg);
-        free(errmsg);
+    /* the retries are about to be given back, the checkpoint keeps them for `dialer resume` */
+    dialer_checkpoint_save( campaign, SWITCH_TRUE );
+
+    switch_mutex_lock( campaign->queue_mutex );
+    campaign->queue_running = SWITCH_FALSE;
+    switch_thread_cond_broadcast( campaign->queue_refill_cond );
+    switch_thread_cond_broadcast( campaign->queue_avail_cond );
+    switch_mutex_unlock( campaign->queue_mutex );
+
+    switch_thread_join( &st, campaign->queue_thread );
+    campaign->queue_thread = NULL;
+
+    /* leased numbers that weren't dialed are after last_dialed, the next run will lease them again */
+    dialer_save_cursor( campaign );
+
+    /* The ring may wrap, release it in (at most) two contiguous chunks */
+    while ( campaign->queue_count > 0 ) {
+        int chunk = switch_min( campaign->queue_count, campaign->queue_high_watermark - campaign->queue_head );
+        index = campaign->queue_head;
+        dialer_release_numbers( campaign, &campaign->queue[ index ], chunk );
+        campaign->queue_head = ( campaign->queue_head + chunk ) % campaign->queue_high_watermark;
+        campaign->queue_count -= chunk;
+    }
+
+    /* Numbers waiting for a retry: their lastcall must be written before we let go of them. Nothing schedules
+     * retries any more now that queue_running is off, the ring is reused as scratch space
+     */
+    if ( campaign->retries.count + campaign->retries.due_count > 0 ) {
+        dialer_db_flush( campaign );
+        switch_mutex_lock( campaign->queue_mutex );
+        while ( ( count = dialer_wheel_drain( &campaign->retries, campaign->queue, campaign->queue_high_watermark ) ) > 0 ) {
+            dialer_release_numbers( campaign, campaign->queue, count );
+        }
+        switch_mutex_unlock( campaign->queue_mutex );
+    }
+}
+
+/*!\brief Take the next destination to dial: retries that are due first, then the leased numbers in the campaign's queue
+ * return SWITCH_STATUS_SUCCESS with `destination` filled, SWITCH_STATUS_TIMEOUT if there is momentarily nothing to dial and
+ * SWITCH_STATUS_FALSE once the destination list is exhausted and no retry is pending (or the campaign is stopping)
+ */
+static switch_status_t dialer_queue_pop( struct db_campaign_config *campaign, struct dialer_destination *destination )
+{
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+    switch_interval_time_t wait;
+    uint64_t next;
+
+    switch_mutex_lock( campaign->queue_mutex );
+
+    dialer_wheel_advance( &campaign->retries, (uint64_t) ( switch_micro_time_now() / 1000000 ) );
+
+    if ( !campaign->retries.due && campaign->queue_count == 0 && campaign->queue_exhausted == SWITCH_FALSE && campaign->queue_running == SWITCH_TRUE ) {
+        switch_thread_cond_signal( campaign->queue_refill_cond );
+        switch_thread_cond_timedwait( campaign->queue_avail_cond, campaign->queue_mutex, 1000000 );
+    }
+
+    if ( campaign->retries.due ) {
+        struct dialer_retry *retry = campaign->retries.due;
+
+        if ( !( campaign->retries.due = retry->next ) ) {
+            campaign->retries.due_tail = NULL;
+        }
+        campaign->retries.due_count--;
+        *destination = retry->destination;
+        free( retry );
+    } else if ( campaign->queue_count > 0 ) {
+        *destination = campaign->queue[ campaign->queue_head ];
+        switch_copy_string( campaign->last_dialed, destination->number, sizeof( campaign->last_dialed ) );
+        campaign->last_dialed_id = destination->id;
+        campaign->queue_head = ( campaign->queue_head + 1 ) % campaign->queue_high_watermark;
+        campaign->queue_count--;
+        if ( campaign->queue_count <= campaign->queue_low_watermark ) {
+            switch_thread_cond_signal( campaign->queue_refill_cond );
+        }
+    } else if ( campaign->queue_running == SWITCH_FALSE ) {
+        status = SWITCH_STATUS_FALSE;
+    } else if ( campaign->queue_exhausted == SWITCH_TRUE ) {
+        if ( campaign->retries.count == 0 && switch_atomic_read( &campaign->stats.current_calls ) == 0 && !dialer_load_running( campaign->destination_list ) ) {
+            status = SWITCH_STATUS_FALSE;
+        } else {
+            /* Nothing left but retries (or rows being loaded): sleep until the next one is due, or until a call in progress schedules one */
+            wait = 1000000;
+            if ( ( next = dialer_wheel_next( &campaign->retries ) ) ) {
+                wait = (switch_interval_time_t) ( next * 1000000 ) - switch_micro_time_now();
+                if ( wait < 1000 ) {
+                    wait = 1000;
+                }
+            }
+            switch_thread_cond_timedwait( campaign->queue_avail_cond, campaign->queue_mutex, wait );
+            status = SWITCH_STATUS_TIMEOUT;
+        }
     } else {
-        ret = SWITCH_TRUE;
+        status = SWITCH_STATUS_TIMEOUT;
     }
-    
-end:
 
-    switch_cache_db_release_db_handle(&dbh);
+    switch_mutex_unlock( campaign->queue_mutex );
+    return status;
+}
 
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: going OUT of dialer_set_number_inuse function\n");
-    return ret;
+/*!\brief File a retry under the slot its due tick falls in, on the lowest level whose span covers it.
+ * Due times beyond the top level are parked on its furthest slot and re-filed when that slot cascades
+ */
+static void dialer_wheel_insert( struct dialer_timing_wheel *wheel, struct dialer_retry *retry )
+{
+    uint64_t delta, due = retry->due;
+    int level;
+
+    if ( due <= wheel->now ) {
+        /* already due */
+        retry->next = NULL;
+        if ( wheel->due_tail ) {
+            wheel->due_tail->next = retry;
+        } else {
+            wheel->due = retry;
+        }
+        wheel->due_tail = retry;
+        wheel->due_count++;
+        return;
+    }
+
+    delta = due - wheel->now;
+    for ( level = 0; level < DIALER_WHEEL_LEVELS - 1; level++ ) {
+        if ( delta < ( (uint64_t) 1 << ( DIALER_WHEEL_BITS * ( level + 1 ) ) ) ) {
+            break;
+        }
+    }
+    if ( delta >= ( (uint64_t) 1 << ( DIALER_WHEEL_BITS * DIALER_WHEEL_LEVELS ) ) ) {
+        due = wheel->now + ( (uint64_t) 1 << ( DIALER_WHEEL_BITS * DIALER_WHEEL_LEVELS ) ) - 1;
+    }
+
+    retry->next = wheel->slots[level][ ( due >> ( DIALER_WHEEL_BITS * level ) ) & ( DIALER_WHEEL_SLOTS - 1 ) ];
+    wheel->slots[level][ ( due >> ( DIALER_WHEEL_BITS * level ) ) & ( DIALER_WHEEL_SLOTS - 1 ) ] = retry;
+    wheel->count++;
+}
+
+/*!\brief Move the wheel forward to `tick`, one tick at a time: cascade the upper levels' slots as their turn comes
+ * and put whatever expires on the due list
+ */
+static void dialer_wheel_advance( struct dialer_timing_wheel *wheel, uint64_t tick )
+{
+    struct dialer_retry *retry, *next;
+
+    while ( wheel->now < tick ) {
+        wheel->now++;
+
+        for ( int level = 1; level < DIALER_WHEEL_LEVELS; level++ ) {
+            uint64_t index;
+
+            if ( wheel->now & ( ( (uint64_t) 1 << ( DIALER_WHEEL_BITS * level ) ) - 1 ) ) {
+                break;
+            }
+            index = ( wheel->now >> ( DIALER_WHEEL_BITS * level ) ) & ( DIALER_WHEEL_SLOTS - 1 );
+            retry = wheel->slots[level][index];
+            wheel->slots[level][index] = NULL;
+            for ( ; retry; retry = next ) {
+                next = retry->next;
+                wheel->count--;
+                dialer_wheel_insert( wheel, retry );
+            }
+        }
+
+        retry = wheel->slots[0][ wheel->now & ( DIALER_WHEEL_SLOTS - 1 ) ];
+        wheel->slots[0][ wheel->now & ( DIALER_WHEEL_SLOTS - 1 ) ] = NULL;
+        for ( ; retry; retry = next ) {
+            next = retry->next;
+            wheel->count--;
+            dialer_wheel_insert( wheel, retry );
+        }
+
+        if ( wheel->count == 0 ) {
+            /* nothing left to cascade, catch up in one go */
+            wheel->now = tick;
+        }
+    }
+}
+
+/*!\brief The next tick at which the wheel has something to do (expire or cascade a slot), 0 if it is empty
+ */
+static uint64_t dialer_wheel_next( struct dialer_timing_wheel *wheel )
+{
+    uint64_t next = 0, base, candidate;
+
+    if ( wheel->count == 0 ) {
+        return 0;
+    }
+
+    for ( int level = 0; level < DIALER_WHEEL_LEVELS; level++ ) {
+        base = wheel->now >> ( DIALER_WHEEL_BITS * level );
+        for ( int i = 1; i <= DIALER_WHEEL_SLOTS; i++ ) {
+            if ( wheel->slots[level][ ( base + i ) & ( DIALER_WHEEL_SLOTS - 1 ) ] ) {
+                candidate = ( base + i ) << ( DIALER_WHEEL_BITS * level );
+                if ( !next || candidate < next ) {
+                    next = candidate;
+                }
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+/*!\brief Take up to `max` destinations out of the wheel, due ones included, and free their entries
+ * return how many were taken
+ */
+static int dialer_wheel_drain( struct dialer_timing_wheel *wheel, struct dialer_destination *destinations, int max )
+{
+    struct dialer_retry *retry;
+    int count = 0;
+
+    while ( count < max && ( retry = wheel->due ) ) {
+        wheel->due = retry->next;
+        wheel->due_count--;
+        destinations[ count++ ] = retry->destination;
+        free( retry );
+    }
+    if ( !wheel->due ) {
+        wheel->due_tail = NULL;
+    }
+
+    for ( int level = 0; level < DIALER_WHEEL_LEVELS; level++ ) {
+        for ( int i = 0; i < DIALER_WHEEL_SLOTS; i++ ) {
+            while ( count < max && ( retry = wheel->slots[level][i] ) ) {
+                wheel->slots[level][i] = retry->next;
+                wheel->count--;
+                destinations[ count++ ] = retry->destination;
+                free( retry );
+            }
+        }
+    }
+
+    return count;
+}
+
+/*!\brief Copy up to `max` of the wheel's entries, due ones included, leaving the wheel as it is
+ * return how many were copied
+ */
+static uint32_t dialer_wheel_copy( struct dialer_timing_wheel *wheel, struct dialer_checkpoint_retry *retries, uint32_t max )
+{
+    struct dialer_retry *retry;
+    uint32_t count = 0;
+
+    for ( retry = wheel->due; retry && count < max; retry = retry->next ) {
+        retries[ count ].due = retry->due;
+        retries[ count++ ].destination = retry->destination;
+    }
+
+    for ( int level = 0; level < DIALER_WHEEL_LEVELS; level++ ) {
+        for ( int i = 0; i < DIALER_WHEEL_SLOTS; i++ ) {
+            for ( retry = wheel->slots[level][i]; retry && count < max; retry = retry->next ) {
+                retries[ count ].due = retry->due;
+                retries[ count++ ].destination = retry->destination;
+            }
+        }
+    }
+
+    return count;
+}
 
+/*!\brief Keep a number that still has attempts left and dial it again once time_between_retries is over
+ * return SWITCH_FALSE if the campaign's queue is stopping, the number must be released then
+ */
+static switch_bool_t dialer_retry_schedule( struct db_campaign_config *campaign, const struct dialer_destination *destination )
+{
+    struct dialer_retry *retry = NULL;
+
+    switch_mutex_lock( campaign->queue_mutex );
+    if ( campaign->queue_running == SWITCH_FALSE ) {
+        switch_mutex_unlock( campaign->queue_mutex );
+        return SWITCH_FALSE;
+    }
+
+    switch_zmalloc( retry, sizeof( struct dialer_retry ) );
+    retry->destination = *destination;
+    retry->due = (uint64_t) ( switch_micro_time_now() / 1000000 ) + ( campaign->time_between_retries > 0 ? campaign->time_between_retries : 0 );
+    dialer_wheel_insert( &campaign->retries, retry );
+
+    /* the dial loop may be asleep waiting for a later retry */
+    switch_thread_cond_broadcast( campaign->queue_avail_cond );
+    switch_mutex_unlock( campaign->queue_mutex );
+
+    return SWITCH_TRUE;
 }
 
+static void dialer_checkpoint_path( const char *name, char *path, switch_size_t len )
+{
+    switch_snprintf( path, len, "%s%sdialer_%s.checkpoint", SWITCH_GLOBAL_dirs.db_dir, SWITCH_PATH_SEPARATOR, name );
+}
+
+/*!\brief Write the campaign's runtime state where `dialer resume` finds it: counters, cursor or permutation position and,
+ * with `with_retries`, the numbers waiting in the retry wheel (otherwise the ones the last checkpoint saw). Only the
+ * campaign thread takes checkpoints
+ */
+static void dialer_checkpoint_save( struct db_campaign_config *campaign, switch_bool_t with_retries )
+{
+    struct dialer_checkpoint checkpoint;
+    struct dialer_stats_snapshot snapshot;
+    struct dialer_permutation perm;
+    char path[1024], tmp[1040];
+    uint32_t last_dialed_id, count;
+    const char *data;
+    switch_size_t left;
+    ssize_t wrote;
+    int fd, part;
+
+    if ( globals.checkpoint_interval <= 0 || zstr( SWITCH_GLOBAL_dirs.db_dir ) ) {
+        return;
+    }
+
+    memset( &checkpoint, 0, sizeof( checkpoint ) );
+    checkpoint.magic = DIALER_CHECKPOINT_MAGIC;
+    checkpoint.version = DIALER_CHECKPOINT_VERSION;
+    switch_copy_string( checkpoint.uuid, campaign->uuid_str, sizeof( checkpoint.uuid ) );
+    switch_copy_string( checkpoint.source, campaign->file ? campaign->file->path : campaign->destination_list, sizeof( checkpoint.source ) );
+    checkpoint.calling_strategy = campaign->calling_strategy;
+    dialer_stats_snapshot( campaign, &snapshot );
+    checkpoint.calls_made = snapshot.calls_made;
+    checkpoint.answered = snapshot.answered;
+    checkpoint.total_seconds = snapshot.total_seconds;
+
+    switch_mutex_lock( campaign->queue_mutex );
+    switch_copy_string( checkpoint.last_dialed, campaign->last_dialed, sizeof( checkpoint.last_dialed ) );
+    last_dialed_id = campaign->last_dialed_id;
+    checkpoint.perm_seed = campaign->perm.seed;
+    checkpoint.perm_size = campaign->perm.size;
+    if ( with_retries ) {
+        count = campaign->retries.count + campaign->retries.due_count;
+        if ( count > campaign->checkpoint_retry_size ) {
+            struct dialer_checkpoint_retry *retries = realloc( campaign->checkpoint_retries, sizeof( struct dialer_checkpoint_retry ) * count );
+
+            if ( retries ) {
+                campaign->checkpoint_retries = retries;
+                campaign->checkpoint_retry_size = count;
+            }
+        }
+        campaign->checkpoint_retry_count = dialer_wheel_copy( &campaign->retries, campaign->checkpoint_retries, campaign->checkpoint_retry_size );
+    }
+    switch_mutex_unlock( campaign->queue_mutex );
+    checkpoint.retry_count = campaign->checkpoint_retry_count;
+
+    /* the refill thread may be starting a pass, work the position out on our own copy of the permutation */
+    if ( campaign->calling_strategy != SEQUENTIAL && last_dialed_id > 0 && last_dialed_id <= checkpoint.perm_size ) {
+        dialer_perm_init( &perm, checkpoint.perm_seed, checkpoint.perm_size );
+        checkpoint.perm_pos = dialer_perm_inverse( &perm, last_dialed_id - 1 ) + 1;
+    }
+    checkpoint.saved = (int64_t) switch_epoch_time_now( NULL );
+
+    dialer_checkpoint_path( campaign->name, path, sizeof( path ) );
+    switch_snprintf( tmp, sizeof( tmp ), "%s.tmp", path );
+    if ( ( fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) < 0 ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: couldn't write checkpoint %s: %s\n", tmp, strerror( errno ) );
+        return;
+    }
+
+    /* no fsync: the checkpoint is there for module reloads and restarts, not for power cuts */
+    for ( part = 0; part < 2; part++ ) {
+        data = part ? (const char *) campaign->checkpoint_retries : (const char *) &checkpoint;
+        left = part ? sizeof( struct dialer_checkpoint_retry ) * checkpoint.retry_count : sizeof( checkpoint );
+        while ( left > 0 ) {
+            if ( ( wrote = write( fd, data, left ) ) < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: couldn't write checkpoint %s: %s\n", tmp, strerror( errno ) );
+                close( fd );
+                unlink( tmp );
+                return;
+            }
+            data += wrote;
+            left -= wrote;
+        }
+    }
+    close( fd );
+
+    if ( rename( tmp, path ) < 0 ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: couldn't replace checkpoint %s: %s\n", path, strerror( errno ) );
+        unlink( tmp );
+    }
+}
+
+/*!\brief Read campaign `name`'s checkpoint, its retries follow the header in the same allocation
+ * return the checkpoint, to be freed with free(), NULL if there is none or it can't be used
+ */
+static struct dialer_checkpoint *dialer_checkpoint_load( const char *name )
+{
+    struct dialer_checkpoint *checkpoint = NULL;
+    struct stat st;
+    char path[1024];
+    ssize_t got;
+    int fd;
+
+    if ( globals.checkpoint_interval <= 0 || zstr( SWITCH_GLOBAL_dirs.db_dir ) ) {
+        return NULL;
+    }
+
+    dialer_checkpoint_path( name, path, sizeof( path ) );
+    if ( ( fd = open( path, O_RDONLY ) ) < 0 ) {
+        return NULL;
+    }
+
+    if ( fstat( fd, &st ) < 0 || st.st_size < (off_t) sizeof( struct dialer_checkpoint ) || !( checkpoint = malloc( st.st_size ) ) ) {
+        close( fd );
+        return NULL;
+    }
+    got = read( fd, checkpoint, st.st_size );
+    close( fd );
+
+    if ( got != st.st_size || checkpoint->magic != DIALER_CHECKPOINT_MAGIC || checkpoint->version != DIALER_CHECKPOINT_VERSION ||
+         (uint64_t) st.st_size != sizeof( struct dialer_checkpoint ) + (uint64_t) checkpoint->retry_count * sizeof( struct dialer_checkpoint_retry ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: checkpoint %s is damaged or of another version\n", path );
+        free( checkpoint );
+        return NULL;
+    }
+
+    checkpoint->uuid[ sizeof( checkpoint->uuid ) - 1 ] = '\0';
+    checkpoint->source[ sizeof( checkpoint->source ) - 1 ] = '\0';
+    checkpoint->last_dialed[ sizeof( checkpoint->last_dialed ) - 1 ] = '\0';
+    return checkpoint;
+}
+
+static int dialer_reclaim_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+    if ( !zstr( argv[0] ) ) {
+        switch_core_hash_insert( (switch_hash_t *) pArg, argv[0], (void *) 1 );
+    }
+    return 0;
+}
+
+/*!\brief Lease the checkpoint's retries again, under the run's own uuid. Whatever the previous run still holds is given
+ * back first: after a clean stop that is nothing, after a crash it is the numbers that sat in its queue, which the
+ * restored cursor leases again anyway. Retries somebody else got to in the meantime are dropped (their number is cleared)
+ * return how many were leased
+ */
+static uint32_t dialer_checkpoint_reclaim( struct db_campaign_config *campaign, struct dialer_checkpoint_retry *retries, uint32_t count )
+{
+    switch_hash_t *reclaimed = NULL;
+    char head[512], lease_expires[64];
+    char *sql = NULL;
+    uint32_t leased = 0, chunk;
+
+    if ( campaign->file ) {
+        struct dialer_file_source *file = campaign->file;
+
+        switch_mutex_lock( file->mutex );
+        for ( uint32_t i=0; i<count; i++ ) {
+            if ( retries[i].destination.id > 0 && retries[i].destination.id <= file->header->rows &&
+                 !( file->rows[ retries[i].destination.id - 1 ].flags & ( DIALER_FILE_ROW_LEASED | DIALER_FILE_ROW_INVALID ) ) ) {
+                file->rows[ retries[i].destination.id - 1 ].flags |= DIALER_FILE_ROW_LEASED;
+                leased++;
+            } else {
+                retries[i].destination.number[0] = '\0';
+            }
+        }
+        switch_mutex_unlock( file->mutex );
+        return leased;
+    }
+
+    sql = switch_mprintf( "update %s set in_use = 0, lease_owner = NULL, lease_expires = NULL where lease_owner = '%q'", campaign->destination_list, campaign->uuid_str );
+    dialer_execute_sql( sql );
+    switch_safe_free( sql );
+
+    if ( count == 0 ) {
+        return 0;
+    }
+
+    switch_snprintf( head, sizeof( head ), "update %s set in_use = 1, lease_owner = '%s', lease_expires = %s where in_use = 0 and number in", campaign->destination_list,
+                     campaign->uuid_str, dialer_sql_time( lease_expires, sizeof( lease_expires ), globals.lease_seconds ) );
+    for ( uint32_t i=0; i<count; i+=chunk ) {
+        chunk = switch_min( count - i, (uint32_t) campaign->lease_batch_size );
+        sql = dialer_sql_in_list( head, retries[i].destination.number, sizeof( struct dialer_checkpoint_retry ), chunk );
+        dialer_execute_sql( sql );
+        switch_safe_free( sql );
+    }
+
+    /* the refill thread isn't running yet, every row we own now is one of the retries */
+    switch_core_hash_init( &reclaimed );
+    sql = switch_mprintf( "select number from %s where lease_owner = '%q' and in_use = 1", campaign->destination_list, campaign->uuid_str );
+    dialer_execute_sql_callback( NULL, sql, dialer_reclaim_callback, reclaimed );
+    switch_safe_free( sql );
+
+    for ( uint32_t i=0; i<count; i++ ) {
+        if ( switch_core_hash_find( reclaimed, retries[i].destination.number ) ) {
+            leased++;
+        } else {
+            retries[i].destination.number[0] = '\0';
+        }
+    }
+    switch_core_hash_destroy( &reclaimed );
+
+    return leased;
+}
+
+/*!\brief Pick the run up from campaign->resume: cursor or permutation position, and the retry wheel. Called by
+ * dialer_queue_start() before the refill thread starts
+ */
+static void dialer_checkpoint_restore( struct db_campaign_config *campaign )
+{
+    struct dialer_checkpoint *checkpoint = campaign->resume;
+    struct dialer_checkpoint_retry *retries = (struct dialer_checkpoint_retry *) ( checkpoint + 1 );
+    struct dialer_retry *retry = NULL;
+    uint32_t leased;
+
+    if ( campaign->calling_strategy == SEQUENTIAL ) {
+        /* a file source keeps its cursor in the sidecar */
+        switch_copy_string( campaign->cursor, checkpoint->last_dialed, sizeof( campaign->cursor ) );
+        switch_copy_string( campaign->last_dialed, checkpoint->last_dialed, sizeof( campaign->last_dialed ) );
+    } else {
+        dialer_perm_init( &campaign->perm, checkpoint->perm_seed, checkpoint->perm_size );
+        campaign->perm_pos = checkpoint->perm_pos;
+        campaign->perm_misses = 0;
+    }
+
+    leased = dialer_checkpoint_reclaim( campaign, retries, checkpoint->retry_count );
+    for ( uint32_t i=0; i<checkpoint->retry_count; i++ ) {
+        if ( zstr( retries[i].destination.number ) ) {
+            continue;
+        }
+        switch_zmalloc( retry, sizeof( struct dialer_retry ) );
+        retry->destination = retries[i].destination;
+        retry->due = retries[i].due;
+        dialer_wheel_insert( &campaign->retries, retry );
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s resumed from its checkpoint of %" SWITCH_UINT64_T_FMT " seconds ago: %u calls made, %s %s, %u of %u retries leased again\n",
+                       campaign->name, (uint64_t) ( switch_epoch_time_now( NULL ) - checkpoint->saved ), checkpoint->calls_made,
+                       campaign->calling_strategy == SEQUENTIAL ? "after number" : "at position",
+                       campaign->calling_strategy == SEQUENTIAL ? ( zstr( checkpoint->last_dialed ) ? "-" : checkpoint->last_dialed ) : switch_core_sprintf( campaign->pool, "%u of %u", checkpoint->perm_pos, checkpoint->perm_size ),
+                       leased, checkpoint->retry_count );
+}
+
+/*!\brief `dialer resume <campaign>`: start the campaign again under the uuid of the run that wrote its checkpoint,
+ * with that run's counters, position and retries
+ */
+static switch_bool_t dialer_resume_campaign( const char *name, switch_stream_handle_t *stream )
+{
+    struct dialer_checkpoint *checkpoint = NULL;
+    struct db_campaign_config *campaign = NULL;
+    char uuid[SWITCH_UUID_FORMATTED_LENGTH + 1];
+
+    if ( strchr( name, '/' ) || !( checkpoint = dialer_checkpoint_load( name ) ) ) {
+        stream->write_function( stream, "-ERR no checkpoint of campaign %s\n", name );
+        return SWITCH_FALSE;
+    }
+
+    if ( !( campaign = dialer_campaign_create( name, checkpoint->uuid ) ) ) {
+        stream->write_function( stream, "-ERR campaign %s is already running\n", name );
+        free( checkpoint );
+        return SWITCH_FALSE;
+    }
+    switch_copy_string( uuid, campaign->uuid_str, sizeof( uuid ) );
+    campaign->resume = checkpoint;
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: resuming campaign %s (%s)\n", name, uuid );
+    if ( dialer_campaign_spawn( campaign ) == SWITCH_FALSE ) {
+        stream->write_function( stream, "-ERR couldn't start campaign %s\n", name );
+        return SWITCH_FALSE;
+    }
+
+    stream->write_function( stream, "+OK Campaign-UUID: %s for campaign: %s\n", uuid, name );
+    return SWITCH_TRUE;
+}
+
+static void dialer_bucket_init( struct dialer_token_bucket *bucket, double rate, double burst, switch_memory_pool_t *pool )
+{
+    if ( !bucket->mutex ) {
+        switch_mutex_init( &bucket->mutex, SWITCH_MUTEX_NESTED, pool );
+    }
+
+    switch_mutex_lock( bucket->mutex );
+    bucket->rate = rate > 0 ? rate : 0;
+    bucket->burst = burst >= 1 ? burst : 1;
+    bucket->tokens = bucket->burst;
+    bucket->last = switch_micro_time_now();
+    switch_mutex_unlock( bucket->mutex );
+}
+
+/*!\brief Take one token if there is one, or with `take` off only see whether there is
+ * return 0 if a token was (or could be) taken, otherwise how many microseconds until the next one is due
+ */
+static switch_interval_time_t dialer_bucket_check( struct dialer_token_bucket *bucket, switch_bool_t take )
+{
+    switch_interval_time_t wait = 0;
+    switch_time_t now;
+
+    if ( bucket->rate <= 0 ) {
+        return 0;
+    }
+
+    switch_mutex_lock( bucket->mutex );
+    now = switch_micro_time_now();
+    bucket->tokens += (double) ( now - bucket->last ) * bucket->rate / 1000000.0;
+    if ( bucket->tokens > bucket->burst ) {
+        bucket->tokens = bucket->burst;
+    }
+    bucket->last = now;
+
+    if ( bucket->tokens >= 1 ) {
+        if ( take ) {
+            bucket->tokens -= 1;
+        }
+    } else {
+        wait = (switch_interval_time_t) ( ( 1 - bucket->tokens ) * 1000000.0 / bucket->rate ) + 1;
+    }
+    switch_mutex_unlock( bucket->mutex );
+
+    return wait;
+}
+
+static switch_interval_time_t dialer_bucket_take( struct dialer_token_bucket *bucket )
+{
+    return dialer_bucket_check( bucket, SWITCH_TRUE );
+}
+
+/*!\brief Put back a token taken for a call that isn't going to be sent
+ */
+static void dialer_bucket_give( struct dialer_token_bucket *bucket )
+{
+    if ( bucket->rate <= 0 ) {
+        return;
+    }
+
+    switch_mutex_lock( bucket->mutex );
+    bucket->tokens += 1;
+    if ( bucket->tokens > bucket->burst ) {
+        bucket->tokens = bucket->burst;
+    }
+    switch_mutex_unlock( bucket->mutex );
+}
+
+/*!\brief Change the rate and burst of a bucket but keep the tokens it has saved up, no more than the new burst. 0 lifts the limit
+ */
+static void dialer_bucket_set_limit( struct dialer_token_bucket *bucket, double rate, double burst )
+{
+    switch_time_t now;
+
+    switch_mutex_lock( bucket->mutex );
+    now = switch_micro_time_now();
+    bucket->burst = burst >= 1 ? burst : 1;
+    if ( bucket->rate > 0 ) {
+        /* what was earned at the old rate until now */
+        bucket->tokens += (double) ( now - bucket->last ) * bucket->rate / 1000000.0;
+        if ( bucket->tokens > bucket->burst ) {
+            bucket->tokens = bucket->burst;
+        }
+    } else {
+        bucket->tokens = bucket->burst;
+    }
+    bucket->last = now;
+    bucket->rate = rate > 0 ? rate : 0;
+    switch_mutex_unlock( bucket->mutex );
+}
+
+/*!\brief Change the rate of a bucket but keep the tokens it has saved up, 0 lifts the limit
+ */
+static void dialer_bucket_set_rate( struct dialer_token_bucket *bucket, double rate )
+{
+    dialer_bucket_set_limit( bucket, rate, bucket->burst );
+}
+
+/*!\brief Wait for a token of `bucket`
+ * return SWITCH_FALSE if the campaign was stopped while waiting
+ */
+static switch_bool_t dialer_pace_bucket( struct db_campaign_config *campaign, struct dialer_token_bucket *bucket )
+{
+    switch_interval_time_t wait;
+
+    while ( ( wait = dialer_bucket_take( bucket ) ) > 0 ) {
+        if ( campaign->stop == SWITCH_TRUE ) {
+            return SWITCH_FALSE;
+        }
+        switch_yield( wait < 100000 ? wait : 100000 );
+    }
+    return SWITCH_TRUE;
+}
+
+/*!\brief Pick the gateway for the next call and wait until the campaign's, the route's, its gateway's and the global bucket
+ * each let one more call through
+ * return the route, NULL if the campaign was stopped while waiting
+ */
+static struct dialer_route *dialer_pace( struct db_campaign_config *campaign )
+{
+    struct dialer_route *route = NULL;
+    switch_bool_t probe = SWITCH_FALSE;
+
+    if ( dialer_pace_bucket( campaign, &campaign->bucket ) == SWITCH_FALSE ) {
+        return NULL;
+    }
+
+    /* the dial loop only gets here with room on some gateway, and only it adds calls to them */
+    while ( !( route = dialer_route_pick( campaign, 0 ) ) || dialer_gateway_admit( route->gateway, &probe ) == SWITCH_FALSE ) {
+        if ( campaign->stop == SWITCH_TRUE ) {
+            return NULL;
+        }
+        switch_yield( DIALER_PACING_POLL );
+    }
+
+    if ( dialer_pace_bucket( campaign, &route->bucket ) == SWITCH_FALSE || dialer_pace_bucket( campaign, &route->gateway->bucket ) == SWITCH_FALSE ||
+         dialer_pace_bucket( campaign, &globals.bucket ) == SWITCH_FALSE ) {
+        /* stopped before the probe was sent, the breaker would otherwise stay half-open for a whole cooldown */
+        if ( probe ) {
+            dialer_gateway_release_probe( route->gateway );
+        }
+        return NULL;
+    }
+
+    return route;
+}
+
+/*!\brief The gateway with the fewest calls in progress for its weight, out of those under their max_calls, not in `tried`
+ * (a bit per route index) and not held back by their breaker. A gateway whose cps lets a call through right now goes
+ * before one that would make us wait
+ * return NULL if there is none
+ */
+static struct dialer_route *dialer_route_pick( struct db_campaign_config *campaign, uint32_t tried )
+{
+    struct dialer_route *route, *best = NULL;
+    switch_interval_time_t wait, best_wait = 0;
+    double load, best_load = 0;
+    uint32_t outstanding;
+
+    for ( int i=0; i<campaign->route_count; i++ ) {
+        route = &campaign->routes[i];
+        if ( tried & ( 1U << i ) ) {
+            continue;
+        }
+        outstanding = switch_atomic_read( &route->outstanding );
+        if ( ( route->max_calls > 0 && (int) outstanding >= route->max_calls ) || dialer_gateway_usable( route->gateway ) == SWITCH_FALSE ) {
+            continue;
+        }
+
+        wait = switch_max( dialer_bucket_check( &route->bucket, SWITCH_FALSE ), dialer_bucket_check( &route->gateway->bucket, SWITCH_FALSE ) );
+        load = (double) ( outstanding + 1 ) / route->weight;
+        if ( !best || ( wait == 0 && best_wait > 0 ) || ( ( wait == 0 ) == ( best_wait == 0 ) && ( wait == 0 ? load < best_load : wait < best_wait ) ) ) {
+            best = route;
+            best_wait = wait;
+            best_load = load;
+        }
+    }
+
+    return best;
+}
+
+/*!\brief Is every gateway of the campaign at its max_calls or open?
+ */
+static switch_bool_t dialer_routes_full( struct db_campaign_config *campaign )
+{
+    for ( int i=0; i<campaign->route_count; i++ ) {
+        if ( ( campaign->routes[i].max_calls <= 0 || (int) switch_atomic_read( &campaign->routes[i].outstanding ) < campaign->routes[i].max_calls ) &&
+             dialer_gateway_usable( campaign->routes[i].gateway ) == SWITCH_TRUE ) {
+            return SWITCH_FALSE;
+        }
+    }
+    return campaign->route_count > 0 ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*!\brief Causes that tell about the gateway rather than about the number: another gateway may well get the call through
+ */
+static switch_bool_t dialer_failover_cause( switch_call_cause_t cause )
+{
+    switch ( cause ) {
+    case SWITCH_CAUSE_GATEWAY_DOWN:
+    case SWITCH_CAUSE_NORMAL_TEMPORARY_FAILURE:
+    case SWITCH_CAUSE_SWITCH_CONGESTION:
+    case SWITCH_CAUSE_NORMAL_CIRCUIT_CONGESTION:
+    case SWITCH_CAUSE_NETWORK_OUT_OF_ORDER:
+    case SWITCH_CAUSE_SERVICE_UNAVAILABLE:
+    case SWITCH_CAUSE_RECOVERY_ON_TIMER_EXPIRE:
+        return SWITCH_TRUE;
+    default:
+        return SWITCH_FALSE;
+    }
+}
+
+/*!\brief Would the campaign's, the route's, its gateway's and the global bucket each let a call through right now?
+ */
+static switch_bool_t dialer_route_ready( struct db_campaign_config *campaign, struct dialer_route *route )
+{
+    return dialer_bucket_check( &campaign->bucket, SWITCH_FALSE ) == 0 && dialer_bucket_check( &route->bucket, SWITCH_FALSE ) == 0 &&
+           dialer_bucket_check( &route->gateway->bucket, SWITCH_FALSE ) == 0 && dialer_bucket_check( &globals.bucket, SWITCH_FALSE ) == 0 ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*!\brief Take a token of each of the buckets dialer_route_ready() looks at without waiting. If one ran out since the look,
+ * the tokens already taken are put back
+ */
+static switch_bool_t dialer_route_take( struct db_campaign_config *campaign, struct dialer_route *route )
+{
+    struct dialer_token_bucket *buckets[] = { &campaign->bucket, &route->bucket, &route->gateway->bucket, &globals.bucket };
+    int taken;
+
+    for ( taken = 0; taken < (int) ( sizeof( buckets ) / sizeof( buckets[0] ) ); taken++ ) {
+        if ( dialer_bucket_take( buckets[taken] ) > 0 ) {
+            while ( taken-- > 0 ) {
+                dialer_bucket_give( buckets[taken] );
+            }
+            return SWITCH_FALSE;
+        }
+    }
+    return SWITCH_TRUE;
+}
+
+/*!\brief Put back the tokens dialer_route_take() took
+ */
+static void dialer_route_give( struct db_campaign_config *campaign, struct dialer_route *route )
+{
+    dialer_bucket_give( &campaign->bucket );
+    dialer_bucket_give( &route->bucket );
+    dialer_bucket_give( &route->gateway->bucket );
+    dialer_bucket_give( &globals.bucket );
+}
+
+/*!\brief A call that failed on its gateway with `cause` goes straight back to the originate workers through another gateway
+ * that can take it right now, as the same attempt. It is paced like any other call: the campaign's, the route's, its
+ * gateway's and the global cps all have to let it through
+ * return SWITCH_FALSE if it wasn't sent again, the call is finished as usual then
+ */
+static switch_bool_t dialer_route_failover( struct dialer_dial_job *dial_job, switch_call_cause_t cause )
+{
+    struct db_campaign_config *campaign = dial_job->campaign;
+    struct dialer_route *from = dial_job->route, *to = NULL;
+    switch_bool_t probe = SWITCH_FALSE;
+
+    if ( !campaign->gateway_failover || !from || campaign->stop == SWITCH_TRUE || dialer_failover_cause( cause ) == SWITCH_FALSE ) {
+        return SWITCH_FALSE;
+    }
+
+    dial_job->routes_tried |= 1U << ( from - campaign->routes );
+    /* only a look at the buckets first, nothing is taken unless all of them and the breaker let the call through */
+    if ( !( to = dialer_route_pick( campaign, dial_job->routes_tried ) ) || dialer_route_ready( campaign, to ) == SWITCH_FALSE ||
+         dialer_gateway_admit( to->gateway, &probe ) == SWITCH_FALSE ) {
+        return SWITCH_FALSE;
+    }
+    if ( dialer_route_take( campaign, to ) == SWITCH_FALSE ) {
+        if ( probe ) {
+            dialer_gateway_release_probe( to->gateway );
+        }
+        return SWITCH_FALSE;
+    }
+
+    dial_job->route = to;
+    dial_job->state = DIALER_CALL_QUEUED;
+    dial_job->post_dial_delay = 0;
+    dial_job->queued = switch_micro_time_now();
+    switch_atomic_inc( &to->outstanding );
+    dialer_inflight_add( campaign, to );
+
+    /* never block here, this may be an originate worker itself */
+    if ( switch_queue_trypush( globals.dial_queue, dial_job ) != SWITCH_STATUS_SUCCESS ) {
+        switch_atomic_dec( &to->outstanding );
+        dialer_inflight_done( campaign, to );
+        dialer_route_give( campaign, to );
+        if ( probe ) {
+            dialer_gateway_release_probe( to->gateway );
+        }
+        dial_job->route = from;
+        return SWITCH_FALSE;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: %s failed on gateway %s (%s), trying gateway %s\n", dial_job->destination.number, from->gateway->name,
+                       switch_channel_cause2str( cause ), to->gateway->name );
+    switch_atomic_dec( &from->outstanding );
+    return SWITCH_TRUE;
+}
+
+/*!\brief Are there as many unanswered originates as the campaign, or the whole module, allows?
+ */
+static switch_bool_t dialer_inflight_full( struct db_campaign_config *campaign )
+{
+    if ( campaign->max_inflight_originates > 0 && (int) switch_atomic_read( &campaign->inflight ) >= campaign->max_inflight_originates ) {
+        return SWITCH_TRUE;
+    }
+    if ( globals.max_inflight_originates > 0 && (int) switch_atomic_read( &globals.inflight ) >= globals.max_inflight_originates ) {
+        return SWITCH_TRUE;
+    }
+    return SWITCH_FALSE;
+}
+
+/*!\brief An originate is about to be queued through `route`
+ */
+static void dialer_inflight_add( struct db_campaign_config *campaign, struct dialer_route *route )
+{
+    switch_atomic_inc( &campaign->inflight );
+    switch_atomic_inc( &globals.inflight );
+    switch_atomic_inc( &route->gateway->inflight );
+}
+
+/*!\brief An originate through `route` is over: answered, failed or never sent
+ */
+static void dialer_inflight_done( struct db_campaign_config *campaign, struct dialer_route *route )
+{
+    switch_atomic_dec( &route->gateway->inflight );
+    switch_atomic_dec( &globals.inflight );
+    switch_atomic_dec( &campaign->inflight );
+}
+
+/*!\brief Find a gateway's shared state, creating it with the default gateway-cps the first time the gateway is used
+ */
+static struct dialer_gateway *dialer_gateway_get( const char *name )
+{
+    struct dialer_gateway *gateway = NULL;
+
+    switch_mutex_lock( globals.gateways_mutex );
+    if ( !( gateway = switch_core_hash_find( globals.gateways, name ) ) ) {
+        gateway = switch_core_alloc( globals.pool, sizeof( struct dialer_gateway ) );
+        switch_copy_string( gateway->name, name, sizeof( gateway->name ) );
+        switch_mutex_init( &gateway->health.mutex, SWITCH_MUTEX_NESTED, globals.pool );
+        dialer_gateway_limit( gateway, globals.gateway_cps, globals.gateway_cps_burst );
+        switch_core_hash_insert( globals.gateways, gateway->name, gateway );
+        gateway->next = globals.gateway_list;
+        globals.gateway_list = gateway;
+    }
+    switch_mutex_unlock( globals.gateways_mutex );
+
+    return gateway;
+}
+
+/*!\brief Set the gateway's cps from the config, which also ends any AIMD throttling of it
+ */
+static void dialer_gateway_limit( struct dialer_gateway *gateway, double cps, double burst )
+{
+    switch_mutex_lock( gateway->health.mutex );
+    dialer_bucket_init( &gateway->bucket, cps, burst, globals.pool );
+    gateway->health.ceiling = gateway->bucket.rate;
+    gateway->health.lift = 0;
+    switch_mutex_unlock( gateway->health.mutex );
+}
+
+/*!\brief Would the gateway's breaker let a call through? Only a look without the lock, dialer_gateway_admit() decides
+ */
+static switch_bool_t dialer_gateway_usable( struct dialer_gateway *gateway )
+{
+    struct dialer_gateway_health *health = &gateway->health;
+    switch_time_t now;
+
+    if ( health->state == DIALER_BREAKER_CLOSED ) {
+        return SWITCH_TRUE;
+    }
+
+    now = switch_micro_time_now();
+    if ( health->state == DIALER_BREAKER_OPEN ) {
+        return now >= health->open_until ? SWITCH_TRUE : SWITCH_FALSE;
+    }
+    /* half-open: one probe at a time, one that never got to report (dropped before it was sent) is given up after the cooldown */
+    return !health->probe_started || now - health->probe_started >= (switch_time_t) globals.breaker_cooldown * 1000000 ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*!\brief Let one call through the gateway's breaker: always while it is closed, and once the cooldown is over only a
+ * single probe call until that one reports. `probe`, if given, tells whether the call is that probe: one that ends up
+ * not being sent must be given back with dialer_gateway_release_probe()
+ */
+static switch_bool_t dialer_gateway_admit( struct dialer_gateway *gateway, switch_bool_t *probe )
+{
+    struct dialer_gateway_health *health = &gateway->health;
+    switch_bool_t admitted = SWITCH_FALSE;
+    switch_time_t now;
+
+    if ( probe ) {
+        *probe = SWITCH_FALSE;
+    }
+    if ( health->state == DIALER_BREAKER_CLOSED ) {
+        return SWITCH_TRUE;
+    }
+
+    switch_mutex_lock( health->mutex );
+    now = switch_micro_time_now();
+    if ( health->state == DIALER_BREAKER_CLOSED ) {
+        admitted = SWITCH_TRUE;
+    } else if ( dialer_gateway_usable( gateway ) == SWITCH_TRUE ) {
+        if ( health->state == DIALER_BREAKER_OPEN ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "dialer: gateway %s breaker is half-open, sending a probe call\n", gateway->name );
+            health->state = DIALER_BREAKER_HALF_OPEN;
+        }
+        health->probe_started = now;
+        admitted = SWITCH_TRUE;
+        if ( probe ) {
+            *probe = SWITCH_TRUE;
+        }
+    }
+    switch_mutex_unlock( health->mutex );
+
+    return admitted;
+}
+
+/*!\brief A probe call dialer_gateway_admit() let through won't be sent after all, the next call may be the probe
+ */
+static void dialer_gateway_release_probe( struct dialer_gateway *gateway )
+{
+    switch_mutex_lock( gateway->health.mutex );
+    if ( gateway->health.state == DIALER_BREAKER_HALF_OPEN ) {
+        gateway->health.probe_started = 0;
+    }
+    switch_mutex_unlock( gateway->health.mutex );
+}
+
+/*!\brief Causes that say the gateway is in trouble: the failover ones, and 486 as well since a carrier over its limits
+ * may answer busy to everything
+ */
+static switch_bool_t dialer_gateway_failure_cause( switch_call_cause_t cause )
+{
+    return cause == SWITCH_CAUSE_USER_BUSY || dialer_failover_cause( cause ) == SWITCH_TRUE ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*!\brief Account a call through the gateway that was answered, or failed with `cause`: the breaker opens when too many
+ * of the calls in the window failed, and closes again when the probe gets through. With gateway-aimd a failure halves the
+ * gateway's cps (at most once a second) and every second of calls going through adds gateway-aimd-increase back
+ */
+static void dialer_gateway_outcome( struct dialer_gateway *gateway, switch_call_cause_t cause, switch_bool_t answered )
+{
+    struct dialer_gateway_health *health = &gateway->health;
+    switch_bool_t failed = !answered && dialer_gateway_failure_cause( cause ) == SWITCH_TRUE ? SWITCH_TRUE : SWITCH_FALSE;
+    switch_time_t now, slot_length;
+    uint32_t attempts = 0, failures = 0;
+    uint64_t tick;
+    double rate;
+    int slot;
+
+    if ( globals.breaker_threshold <= 0 && !globals.aimd ) {
+        return;
+    }
+
+    now = switch_micro_time_now();
+    slot_length = switch_max( (switch_time_t) globals.breaker_window * 1000000 / DIALER_HEALTH_SLOTS, 1 );
+    tick = now / slot_length;
+    slot = tick % DIALER_HEALTH_SLOTS;
+
+    switch_mutex_lock( health->mutex );
+
+    if ( health->ticks[slot] != tick ) {
+        health->ticks[slot] = tick;
+        health->attempts[slot] = 0;
+        health->failures[slot] = 0;
+    }
+    health->attempts[slot]++;
+    health->failures[slot] += failed ? 1 : 0;
+    for ( int i=0; i<DIALER_HEALTH_SLOTS; i++ ) {
+        if ( health->ticks[i] + DIALER_HEALTH_SLOTS > tick ) {
+            attempts += health->attempts[i];
+            failures += health->failures[i];
+        }
+    }
+
+    if ( globals.breaker_threshold > 0 ) {
+        if ( health->state == DIALER_BREAKER_HALF_OPEN ) {
+            health->probe_started = 0;
+            if ( failed ) {
+                health->open_until = now + (switch_time_t) globals.breaker_cooldown * 1000000;
+                dialer_memory_barrier();
+                health->state = DIALER_BREAKER_OPEN;
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: gateway %s failed the probe call (%s), breaker open for %d more seconds\n", gateway->name,
+                                   switch_channel_cause2str( cause ), globals.breaker_cooldown );
+            } else {
+                /* start over, the failures that opened it would trip it again right away */
+                memset( health->attempts, 0, sizeof( health->attempts ) );
+                memset( health->failures, 0, sizeof( health->failures ) );
+                health->state = DIALER_BREAKER_CLOSED;
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "dialer: gateway %s got the probe call through, breaker closed\n", gateway->name );
+            }
+        } else if ( health->state == DIALER_BREAKER_CLOSED && failed && attempts >= (uint32_t) globals.breaker_min_calls &&
+                    (uint64_t) failures * 100 >= (uint64_t) attempts * globals.breaker_threshold ) {
+            health->open_until = now + (switch_time_t) globals.breaker_cooldown * 1000000;
+            dialer_memory_barrier();
+            health->state = DIALER_BREAKER_OPEN;
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: gateway %s failed %u of its last %u calls, breaker open for %d seconds\n", gateway->name,
+                               failures, attempts, globals.breaker_cooldown );
+        }
+    }
+
+    if ( globals.aimd ) {
+        rate = gateway->bucket.rate;
+        if ( failed ) {
+            if ( now - health->last_decrease >= 1000000 ) {
+                if ( rate <= 0 ) {
+                    /* no cps set: start from what went through the window, and lift the limit again past twice that */
+                    rate = (double) attempts * 1000000.0 / (double) ( slot_length * DIALER_HEALTH_SLOTS );
+                    health->lift = rate * 2;
+                }
+                rate = switch_max( rate * DIALER_AIMD_DECREASE, globals.aimd_min_cps );
+                health->last_decrease = now;
+                health->last_increase = now;
+                dialer_bucket_set_rate( &gateway->bucket, rate );
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: gateway %s failed with %s, cps down to %.2f\n", gateway->name,
+                                   switch_channel_cause2str( cause ), rate );
+            }
+        } else if ( rate > 0 && ( health->ceiling <= 0 || rate < health->ceiling ) ) {
+            rate += globals.aimd_increase * (double) ( now - health->last_increase ) / 1000000.0;
+            health->last_increase = now;
+            if ( health->ceiling > 0 && rate >= health->ceiling ) {
+                rate = health->ceiling;
+            } else if ( health->ceiling <= 0 && rate >= health->lift ) {
+                rate = 0;
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: gateway %s recovered, no cps limit again\n", gateway->name );
+            }
+            dialer_bucket_set_rate( &gateway->bucket, rate );
+        }
+    }
+
+    switch_mutex_unlock( health->mutex );
+}
+
+/*!\brief Stub agent source: the number given in the config, changed at runtime with `dialer agents`
+ */
+static int dialer_agents_static( struct db_campaign_config *campaign, const char *arg )
+{
+    return (int) switch_atomic_read( &campaign->predictive.static_agents );
+}
+
+/*!\brief Run an API command ("<command> <args>") whose output starts with the number of free agents
+ */
+static int dialer_agents_api( struct db_campaign_config *campaign, const char *arg )
+{
+    switch_stream_handle_t stream = { 0 };
+    char *command = strdup( arg ), *args = NULL;
+    int agents = -1;
+
+    if ( ( args = strchr( command, ' ' ) ) ) {
+        *args++ = '\0';
+    }
+
+    SWITCH_STANDARD_STREAM( stream );
+    if ( switch_api_execute( command, args, NULL, &stream ) == SWITCH_STATUS_SUCCESS && stream.data && isdigit( *(char *) stream.data ) ) {
+        agents = atoi( (char *) stream.data );
+    } else {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: agent_source api:%s didn't return a number of agents\n", arg );
+    }
+
+    switch_safe_free( stream.data );
+    free( command );
+    return agents;
+}
+
+/*!\brief Available agents of a mod_callcenter queue. Those already talking to this campaign's calls are still
+ * Available in the queue, so they are taken off
+ */
+static int dialer_agents_callcenter( struct db_campaign_config *campaign, const char *arg )
+{
+    char *command = switch_mprintf( "callcenter_config queue count agents %s Available", arg );
+    int agents = dialer_agents_api( campaign, command );
+    int connected = (int) ( switch_atomic_read( &campaign->stats.answered ) - switch_atomic_read( &campaign->predictive.answered_done ) );
+
+    switch_safe_free( command );
+    if ( agents < 0 ) {
+        return agents;
+    }
+    return agents > connected ? agents - connected : 0;
+}
+
+static const struct dialer_agent_source dialer_agent_sources[] = {
+    { "static", dialer_agents_static },
+    { "api", dialer_agents_api },
+    { "callcenter", dialer_agents_callcenter },
+    { NULL, NULL }
+};
+
+/*!\brief Parse agent_source=<name>:<argument>
+ */
+static switch_bool_t dialer_agent_source_set( struct db_campaign_config *campaign, const char *value )
+{
+    const char *arg = strchr( value, ':' );
+
+    if ( !arg ) {
+        return SWITCH_FALSE;
+    }
+
+    for ( int i=0; dialer_agent_sources[i].name; i++ ) {
+        if ( strlen( dialer_agent_sources[i].name ) == (switch_size_t) ( arg - value ) && !strncmp( dialer_agent_sources[i].name, value, arg - value ) ) {
+            campaign->predictive.source = &dialer_agent_sources[i];
+            switch_copy_string( campaign->predictive.source_arg, arg + 1, sizeof( campaign->predictive.source_arg ) );
+            switch_atomic_set( &campaign->predictive.static_agents, atoi( arg + 1 ) );
+            return SWITCH_TRUE;
+        }
+    }
+
+    return SWITCH_FALSE;
+}
+
+/*!\brief Starting guesses, replaced by what the campaign measures as calls come and go
+ */
+static void dialer_predictive_init( struct db_campaign_config *campaign )
+{
+    struct dialer_predictive *predictive = &campaign->predictive;
+
+    predictive->answer_rate = 0.5;
+    predictive->ring_time = 10;
+    predictive->talk_time = 60;
+    predictive->abandon_rate = 0;
+    predictive->gain = 1;
+    predictive->samples = 0;
+    predictive->capacity = 0;
+    predictive->next_update = 0;
+    switch_atomic_set( &predictive->answered_done, 0 );
+    switch_atomic_set( &predictive->target, 0 );
+}
+
+/*!\brief Poll the free agents and work out how many originates should be outstanding.
+ *
+ * Every outstanding originate turns into a connected call with probability answer_rate, so we dial
+ * (free agents + agents expected to free up while the new calls ring) / answer_rate. The gain on top is
+ * nudged down while the measured abandon rate is over the target and back up while it is well under it.
+ * Until DIALER_PREDICTIVE_WARMUP calls were answered we dial one call per free agent.
+ */
+static void dialer_predictive_update( struct db_campaign_config *campaign )
+{
+    struct dialer_predictive *predictive = &campaign->predictive;
+    switch_time_t now = switch_micro_time_now();
+    int free_agents, connected, target;
+    double freeing;
+
+    if ( now < predictive->next_update ) {
+        return;
+    }
+    predictive->next_update = now + DIALER_PREDICTIVE_INTERVAL;
+
+    if ( ( free_agents = predictive->source->free_agents( campaign, predictive->source_arg ) ) < 0 ) {
+        /* keep dialing for what we knew last */
+        return;
+    }
+    connected = (int) ( switch_atomic_read( &campaign->stats.answered ) - switch_atomic_read( &predictive->answered_done ) );
+    if ( connected < 0 ) {
+        connected = 0;
+    }
+
+    switch_mutex_lock( campaign->mutex );
+    predictive->capacity = free_agents + connected;
+
+    if ( predictive->samples < DIALER_PREDICTIVE_WARMUP ) {
+        target = free_agents;
+    } else {
+        if ( predictive->abandon_rate > predictive->abandon_target ) {
+            predictive->gain = switch_max( predictive->gain * 0.9, 0.2 );
+        } else if ( predictive->abandon_rate < predictive->abandon_target / 2 ) {
+            predictive->gain = switch_min( predictive->gain * 1.05, 2.0 );
+        }
+        freeing = predictive->talk_time > 0 ? connected * switch_min( predictive->ring_time / predictive->talk_time, 1.0 ) : 0;
+        target = (int) ( ( free_agents + freeing ) * predictive->gain / switch_max( predictive->answer_rate, 0.05 ) + 0.5 );
+    }
+    switch_mutex_unlock( campaign->mutex );
+
+    switch_atomic_set( &predictive->target, target > 0 ? target : 0 );
+
+    if ( globals.debug ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "dialer: campaign %s free agents %d, connected %d, answer rate %.2f, abandon rate %.3f, gain %.2f -> %d outstanding\n",
+                           campaign->name, free_agents, connected, predictive->answer_rate, predictive->abandon_rate, predictive->gain, target );
+    }
+}
+
+/*!\brief An originate came back. An answered call that finds more of our calls connected than there were agents
+ * to take them is counted as abandoned
+ */
+static void dialer_predictive_originated( struct db_campaign_config *campaign, switch_bool_t answered, switch_interval_time_t ring )
+{
+    struct dialer_predictive *predictive = &campaign->predictive;
+    int connected;
+
+    if ( campaign->calling_mode != PREDICTIVE ) {
+        return;
+    }
+
+    switch_mutex_lock( campaign->mutex );
+    predictive->answer_rate += DIALER_PREDICTIVE_ALPHA * ( ( answered ? 1.0 : 0.0 ) - predictive->answer_rate );
+    if ( answered ) {
+        connected = (int) ( switch_atomic_read( &campaign->stats.answered ) - switch_atomic_read( &predictive->answered_done ) );
+        predictive->ring_time += DIALER_PREDICTIVE_ALPHA * ( ring / 1000000.0 - predictive->ring_time );
+        predictive->abandon_rate += DIALER_PREDICTIVE_ALPHA * ( ( connected > predictive->capacity ? 1.0 : 0.0 ) - predictive->abandon_rate );
+        predictive->samples++;
+    }
+    switch_mutex_unlock( campaign->mutex );
+}
+
+/*!\brief An answered call hung up, its agent is free again
+ */
+static void dialer_predictive_hungup( struct db_campaign_config *campaign, int seconds )
+{
+    struct dialer_predictive *predictive = &campaign->predictive;
+
+    switch_atomic_inc( &predictive->answered_done );
+
+    if ( campaign->calling_mode != PREDICTIVE ) {
+        return;
+    }
+
+    switch_mutex_lock( campaign->mutex );
+    predictive->talk_time += DIALER_PREDICTIVE_ALPHA * ( seconds - predictive->talk_time );
+    switch_mutex_unlock( campaign->mutex );
+}
+
+/*!\brief `dialer agents <campaign> <n>`: tell a campaign with a static agent_source how many agents are free
+ */
+static switch_bool_t dialer_set_agents( const char *name_or_uuid, int agents )
+{
+    struct db_campaign_config *campaign = NULL;
+    switch_bool_t set = SWITCH_FALSE;
+
+    if ( !( campaign = dialer_campaign_find( name_or_uuid ) ) ) {
+        return SWITCH_FALSE;
+    }
+
+    if ( campaign->predictive.source && campaign->predictive.source->free_agents == dialer_agents_static ) {
+        switch_atomic_set( &campaign->predictive.static_agents, agents > 0 ? agents : 0 );
+        set = SWITCH_TRUE;
+    }
+
+    dialer_campaign_release( campaign );
+    return set;
+}
+
+/*!\brief Hand a leased destination over to the origination workers, to be dialed through `route`
+ */
+static switch_bool_t dialer_dial_destination( struct db_campaign_config *campaign, const struct dialer_destination *destination, struct dialer_route *route )
+{
+    struct dialer_dial_job *dial_job = NULL;
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: queueing number %s for campaign %s\n", destination->number, campaign->name );
+
+    if ( !( dial_job = dialer_call_alloc() ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: out of memory for call records\n" );
+        return SWITCH_FALSE;
+    }
+    dial_job->campaign = campaign;
+    dial_job->destination = *destination;
+    dial_job->route = route;
+    dial_job->state = DIALER_CALL_QUEUED;
+    dial_job->queued = switch_micro_time_now();
+
+    dialer_stats_write_begin( campaign );
+    switch_atomic_inc( &campaign->stats.calls_made );
+    switch_atomic_inc( &campaign->stats.current_calls );
+    dialer_stats_write_end( campaign );
+    switch_atomic_inc( &route->outstanding );
+    dialer_inflight_add( campaign, route );
+
+    /* Blocks while the workers are saturated, which is the backpressure we want */
+    if ( switch_queue_push( globals.dial_queue, dial_job ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't queue number %s\n", destination->number );
+        dialer_stats_write_begin( campaign );
+        switch_atomic_dec( &campaign->stats.calls_made );
+        switch_atomic_dec( &campaign->stats.current_calls );
+        dialer_stats_write_end( campaign );
+        switch_atomic_dec( &route->outstanding );
+        dialer_inflight_done( campaign, route );
+        dialer_call_free( dial_job );
+        return SWITCH_FALSE;
+    }
+
+    return SWITCH_TRUE;
+}
+
+/*!\brief Render the parts of the campaign's dial string that don't change from call to call
+ */
+static void dialer_dial_template_init( struct db_campaign_config *campaign )
+{
+    const char *custom_header = "";
+
+    if ( !zstr( campaign->custom_header_name ) && !zstr( campaign->custom_header_value ) ) {
+        custom_header = switch_core_sprintf( campaign->pool, "%s=%s,", campaign->custom_header_name, campaign->custom_header_value );
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: added custom header: %s -> %s\n", campaign->custom_header_name, campaign->custom_header_value );
+    }
+
+    campaign->dial_head = switch_core_sprintf( campaign->pool, "{%soriginate_timeout=%d,campaign_id=%s,absolute_codec_string='%s',", custom_header,
+                                               campaign->originate_timeout, campaign->uuid_str, campaign->codec_list );
+}
+
+/*!\brief Build the dial string for a queued number into the worker's `dial_string`, originate it and transfer the answered leg.
+ * Runs on an origination worker, no global lock is held while the call is being set up.
+ */
+static void dialer_originate_job( struct dialer_dial_job *dial_job, char *dial_string, switch_size_t dial_string_len )
+{
+    struct db_campaign_config *campaign = dial_job->campaign;
+    /* once the call is up the job belongs to the channel (which may even send it through another gateway), keep our own copies */
+    struct dialer_route *route = dial_job->route;
+    char number[ sizeof( dial_job->destination.number ) ];
+    char call_uuid[ sizeof( dial_job->uuid ) ];
+    int duration_in_table = dial_job->destination.duration;
+    char sched_duration[64] = "";
+    int rnd_number = 0;
+    char *exten, *cid_name, *cid_num;
+
+    switch_core_session_t *caller_session = NULL;
+    switch_call_cause_t *ccause = SWITCH_CAUSE_NONE;
+    uint32_t timeout = 60;
+
+    switch_call_cause_t cause = SWITCH_CAUSE_NORMAL_CLEARING;
+    struct randnorm_state rs;
+    switch_time_t originated;
+
+    //ORIGINATE_SYNTAX "<call url> <exten>|&<application_name>(<app_args>) [<dialplan>] [<context>] [<cid_name>] [<cid_num>] [<timeout_sec>]"
+
+    switch_copy_string( number, dial_job->destination.number, sizeof( number ) );
+
+    if ( campaign->stop == SWITCH_TRUE ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s is stopping, not dialing %s\n", campaign->name, number );
+        goto abort;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Originating call...\n" );
+
+    /* set vars from campaign globals */
+    exten = campaign->action_on_anwser;
+
+    /*
+        If cancel_ratio > 0 then we just set the sched_hangup for 1 second, else
+        If gaussian is disabled, duration in table is 0 and max and min_call_duration is 0, we set no time limit
+    */
+
+    rnd_number = ( rand() % ( 100 + 1 - 0 ) + 0 );
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: Random Number: %d - cancel_ratio: %d\n", rnd_number, campaign->cancel_ratio );
+
+    if ( campaign->cancel_ratio > 0 && rnd_number < campaign->cancel_ratio ) {
+        switch_copy_string( sched_duration, "execute_on_pre_answer='sched_api +1 normal_clearing bleg'", sizeof( sched_duration ) );
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: ------------------>>>>>>> Random Number: %d - cancel_ratio: %d\n", rnd_number, campaign->cancel_ratio );
+    } else {
+        if ( campaign->gaussian_distribution == 0 ) {
+            if ( duration_in_table == 0 ) {
+                if ( campaign->call_max_duration != 0 || campaign->call_min_duration != 0 ) {
+                    switch_snprintf( sched_duration, sizeof( sched_duration ), "execute_on_answer='sched_hangup +%d alloted_timeout'", rand() % ( campaign->call_max_duration + 1 - campaign->call_min_duration) + campaign->call_min_duration );
+                }
+            } else {
+                switch_snprintf( sched_duration, sizeof( sched_duration ), "execute_on_answer='sched_hangup +%d alloted_timeout'", duration_in_table);
+            }
+        } else if ( campaign->gaussian_distribution_mean > 0 && campaign->gaussian_distribution_stdv > 0 ) {
+            randnorm_init(&rs, time(NULL));
+            switch_snprintf( sched_duration, sizeof( sched_duration ), "execute_on_answer='sched_hangup +%d alloted_timeout'", (int)randnorm_r(&rs, campaign->gaussian_distribution_mean, campaign->gaussian_distribution_stdv) );
+        } else {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: gaussian distribution is enabled, but there's no 'mean' or 'stdv', please set them or disable it!\n");
+            goto abort;
+        }
+    }
+
+    switch_uuid_str( call_uuid, sizeof( call_uuid ) );
+    switch_copy_string( dial_job->uuid, call_uuid, sizeof( dial_job->uuid ) );
+
+    /* only the number, the call's uuid and its duration are filled in per call */
+    if ( switch_snprintf( dial_string, dial_string_len, "%sorigination_uuid=%s,origination_caller_id_name=%s,origination_caller_id_number=%s,%s%s%s",
+                          campaign->dial_head, call_uuid, number, number, sched_duration, route->dial_tail, number ) >= (int) dial_string_len - 1 ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: the dial string for %s doesn't fit in %d bytes, not dialing it\n", number, (int) dial_string_len );
+        goto abort;
+    }
+
+    if ( zstr( dial_job->destination.callerid ) ) {
+        cid_name = campaign->global_caller_id;
+        cid_num = campaign->global_caller_id;
+    } else {
+        cid_name = dial_job->destination.callerid;
+        cid_num = dial_job->destination.callerid;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: dial_string: %s -> %s\n", dial_string, exten );
+
+    dial_job->state = DIALER_CALL_ORIGINATING;
+    dial_job->originated = originated = switch_micro_time_now();
+
+    /* From here on the job may be finished (and freed) by dialer_on_reporting on the channel's thread */
+    dialer_call_register( dial_job );
+
+    switch_atomic_inc( &campaign->metrics.shards[ dialer_metrics_shard() ].attempts );
+    switch_atomic_inc( &route->gateway->metrics.shards[ dialer_metrics_shard() ].attempts );
+
+    if (switch_ivr_originate(NULL, &caller_session, &cause, dial_string, timeout, &dialer_state_handlers, cid_name, cid_num, NULL, NULL, 0, ccause, NULL) != SWITCH_STATUS_SUCCESS || !caller_session ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: something went wrong when sending the call, skipping\n");
+        dialer_histogram_observe( &campaign->originate_latency, dialer_latency_bounds, switch_micro_time_now() - originated );
+        dialer_metrics_failure( &campaign->metrics, cause );
+        dialer_metrics_failure( &route->gateway->metrics, cause );
+        dialer_gateway_outcome( route->gateway, cause, SWITCH_FALSE );
+        /* If a channel got far enough to report, it already cleaned up after itself */
+        if ( ( dial_job = dialer_call_claim( call_uuid ) ) ) {
+            dial_job->hangup_cause = cause;
+            dialer_call_finished( dial_job, 0, cause );
+        }
+        dialer_predictive_originated( campaign, SWITCH_FALSE, 0 );
+        dialer_inflight_done( campaign, route );
+        return;
+    }
+
+    /* originate only returns with a session once the call was answered */
+    dialer_stats_write_begin( campaign );
+    switch_atomic_inc( &campaign->stats.answered );
+    dialer_stats_write_end( campaign );
+    dialer_predictive_originated( campaign, SWITCH_TRUE, switch_micro_time_now() - originated );
+    dialer_histogram_observe( &campaign->originate_latency, dialer_latency_bounds, switch_micro_time_now() - originated );
+    switch_atomic_inc( &campaign->metrics.shards[ dialer_metrics_shard() ].answers );
+    switch_atomic_inc( &route->gateway->metrics.shards[ dialer_metrics_shard() ].answers );
+    dialer_gateway_outcome( route->gateway, SWITCH_CAUSE_NONE, SWITCH_TRUE );
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: call sent, with transfer: exten:%s, dialplan_type:%s, context: %s\n", campaign->transfer_on_answer , campaign->dialplan_type, campaign->context);
+    switch_ivr_session_transfer(caller_session, campaign->transfer_on_answer , campaign->dialplan_type, campaign->context);
+
+    switch_core_session_rwunlock(caller_session);
+    /* last thing we do with the campaign, it may be freed as soon as nothing is in flight */
+    dialer_inflight_done( campaign, route );
+    return;
+
+abort:
+    /* The call never left, give back the slot we took when queueing it */
+    dialer_call_finished( dial_job, 0, SWITCH_CAUSE_NONE );
+    dialer_inflight_done( campaign, route );
+}
+
+/*!\brief Take a call record from the slab, carving a new chunk out of the heap when it is empty
+ */
+static struct dialer_dial_job *dialer_call_alloc( void )
+{
+    struct dialer_call_chunk *chunk = NULL;
+    struct dialer_dial_job *dial_job = NULL;
+
+    switch_mutex_lock( globals.calls_mutex );
+    if ( !globals.call_free && ( chunk = calloc( 1, sizeof( struct dialer_call_chunk ) ) ) ) {
+        for ( int i = DIALER_CALL_SLAB_SIZE - 1; i >= 0; i-- ) {
+            chunk->records[i].next_free = globals.call_free;
+            globals.call_free = &chunk->records[i];
+        }
+        chunk->next = globals.call_chunks;
+        globals.call_chunks = chunk;
+    }
+    if ( ( dial_job = globals.call_free ) ) {
+        globals.call_free = dial_job->next_free;
+    }
+    switch_mutex_unlock( globals.calls_mutex );
+
+    if ( dial_job ) {
+        memset( dial_job, 0, sizeof( *dial_job ) );
+    }
+    return dial_job;
+}
+
+/*!\brief Give a call record back to the slab
+ */
+static void dialer_call_free( struct dialer_dial_job *dial_job )
+{
+    dial_job->state = DIALER_CALL_FREE;
+
+    switch_mutex_lock( globals.calls_mutex );
+    dial_job->next_free = globals.call_free;
+    globals.call_free = dial_job;
+    switch_mutex_unlock( globals.calls_mutex );
+}
+
+/*!\brief Free the slab's chunks once no call can be in progress anymore
+ */
+static void dialer_call_slab_destroy( void )
+{
+    struct dialer_call_chunk *chunk;
+
+    while ( ( chunk = globals.call_chunks ) ) {
+        globals.call_chunks = chunk->next;
+        free( chunk );
+    }
+    globals.call_free = NULL;
+}
+
+/*!\brief Start tracking a call by the uuid its channel is going to get
+ */
+static void dialer_call_register( struct dialer_dial_job *dial_job )
+{
+    switch_mutex_lock( globals.calls_mutex );
+    switch_core_hash_insert( globals.calls, dial_job->uuid, dial_job );
+    switch_mutex_unlock( globals.calls_mutex );
+}
+
+/*!\brief Stop tracking a call and take ownership of its job. Whoever claims the job (the channel's reporting hook or
+ * the worker on a failed originate) finishes it, the other side gets NULL
+ */
+static struct dialer_dial_job *dialer_call_claim( const char *uuid )
+{
+    struct dialer_dial_job *dial_job = NULL;
+
+    switch_mutex_lock( globals.calls_mutex );
+    if ( ( dial_job = (struct dialer_dial_job *) switch_core_hash_find( globals.calls, uuid ) ) ) {
+        switch_core_hash_delete( globals.calls, uuid );
+    }
+    switch_mutex_unlock( globals.calls_mutex );
+
+    return dial_job;
+}
+
+/*!\brief Account for a call that is over (or never happened): free its concurrency slot, add its talk time and
+ * either schedule the number's next attempt or release it
+ */
+static void dialer_call_finished( struct dialer_dial_job *dial_job, int seconds, switch_call_cause_t cause )
+{
+    struct db_campaign_config *campaign = dial_job->campaign;
+    struct dialer_dial_job attempt;
+    switch_bool_t sent;
+
+    if ( dial_job->state == DIALER_CALL_FREE ) {
+        /* finishing it twice would give back a concurrency slot somebody else is using */
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: call record for %s finished twice, ignoring\n", dial_job->destination.number );
+        return;
+    }
+
+    if ( ( sent = dial_job->state == DIALER_CALL_ORIGINATING ) ) {
+        attempt = *dial_job;
+    }
+
+    /* a gateway that couldn't take the call doesn't use up an attempt, the call is still in progress through another one */
+    if ( sent && dialer_route_failover( dial_job, cause ) == SWITCH_TRUE ) {
+        /* the job may already be on another worker, journal our copy of the attempt on the gateway it failed on */
+        dialer_journal_append( campaign, &attempt, seconds );
+        return;
+    }
+
+    /* every attempt that was sent uses up one of the number's attempts_per_number, answered or not */
+    if ( sent ) {
+        dial_job->destination.calls++;
+        dialer_db_number_called( campaign, dial_job->destination.id, dial_job->destination.number );
+        dialer_journal_append( campaign, dial_job, seconds );
+    }
+
+    /* before giving the slot back, so that the dial loop never sees neither calls nor retries while one is coming */
+    if ( campaign->stop == SWITCH_FALSE && dial_job->destination.calls < campaign->attempts_per_number && dialer_retry_schedule( campaign, &dial_job->destination ) ) {
+        dialer_db_number_retried( campaign, dial_job->destination.id, dial_job->destination.number );
+    } else {
+        dialer_db_number_released( campaign, dial_job->destination.id, dial_job->destination.number );
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: decrementing current_calls for campaign %s\n", campaign->campaign_requested );
+    dialer_stats_write_begin( campaign );
+    switch_atomic_dec( &campaign->stats.current_calls );
+    switch_atomic_add( &campaign->stats.total_seconds, seconds );
+    dialer_stats_write_end( campaign );
+    if ( dial_job->route ) {
+        switch_atomic_dec( &dial_job->route->outstanding );
+    }
+
+    dialer_call_free( dial_job );
+}
+
+/*!\brief CS_REPORTING hook of the channels we originate, the equivalent of their CHANNEL_HANGUP_COMPLETE
+ */
+static switch_status_t dialer_on_reporting(switch_core_session_t *session)
+{
+    switch_channel_t *channel = switch_core_session_get_channel( session );
+    switch_channel_timetable_t *times = NULL;
+    struct dialer_dial_job *dial_job = NULL;
+    switch_call_cause_t cause = SWITCH_CAUSE_NONE;
+    int seconds = 0;
+
+    if ( !( dial_job = dialer_call_claim( switch_core_session_get_uuid( session ) ) ) ) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    if ( ( times = switch_channel_get_timetable( channel ) ) && times->answered && times->hungup > times->answered ) {
+        seconds = (int) ( ( times->hungup - times->answered ) / 1000000 );
+    }
+    if ( times ) {
+        switch_time_t progress = times->progress && ( !times->progress_media || times->progress < times->progress_media ) ? times->progress : times->progress_media;
+
+        if ( progress && times->created ) {
+            dial_job->post_dial_delay = progress - times->created;
+            dialer_histogram_observe( &dial_job->campaign->post_dial_delay, dialer_latency_bounds, dial_job->post_dial_delay );
+        }
+        if ( times->answered && times->hungup > times->answered ) {
+            dialer_histogram_observe( &dial_job->campaign->call_duration, dialer_duration_bounds, times->hungup - times->answered );
+        }
+    }
+    dial_job->hangup_cause = switch_channel_get_cause( channel );
+    if ( times && times->answered ) {
+        dial_job->answered = SWITCH_TRUE;
+        dialer_predictive_hungup( dial_job->campaign, seconds );
+    } else {
+        /* only a call that never got through may be tried on another gateway */
+        cause = dial_job->hangup_cause;
+    }
+
+    dialer_call_finished( dial_job, seconds, cause );
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static void *SWITCH_THREAD_FUNC dialer_originate_worker(switch_thread_t *thread, void *obj)
+{
+    int worker_id = (intptr_t) obj;
+    void *pop = NULL;
+    /* reused for every call this worker sends */
+    char dial_string[DIALER_DIAL_STRING_SIZE];
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: origination worker %d started\n", worker_id );
+
+    while ( globals.running == SWITCH_TRUE ) {
+        if ( switch_queue_pop_timeout( globals.dial_queue, &pop, 500000 ) != SWITCH_STATUS_SUCCESS || !pop ) {
+            continue;
+        }
+        /* the job is freed once the call is over */
+        dialer_originate_job( (struct dialer_dial_job *) pop, dial_string, sizeof( dial_string ) );
+        pop = NULL;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: origination worker %d exiting\n", worker_id );
+    return NULL;
+}
+
+/*!\brief Create the shared dial queue and spawn `originate-workers` threads draining it
+ */
+static switch_bool_t dialer_start_originate_workers(void)
+{
+    switch_threadattr_t *thd_attr = NULL;
+
+    if ( switch_queue_create( &globals.dial_queue, globals.originate_queue_size, globals.pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Couldn't create the originate queue\n" );
+        return SWITCH_FALSE;
+    }
+
+    switch_threadattr_create( &thd_attr, globals.pool );
+    switch_threadattr_stacksize_set( thd_attr, SWITCH_THREAD_STACKSIZE );
+
+    for ( int i=0; i<globals.originate_workers; i++ ) {
+        if ( switch_thread_create( &globals.workers[i], thd_attr, dialer_originate_worker, (void *) (intptr_t) i, globals.pool ) != SWITCH_STATUS_SUCCESS ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Couldn't start origination worker %d\n", i );
+            globals.workers[i] = NULL;
+            return SWITCH_FALSE;
+        }
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: started %d origination workers, queue size %d\n", globals.originate_workers, globals.originate_queue_size );
+    return SWITCH_TRUE;
+}
+
+/*!\brief Tell the origination workers to finish, wait for them and finish whatever is left in the queue as never sent
+ */
+static void dialer_stop_originate_workers(void)
+{
+    switch_status_t st;
+    void *pop = NULL;
+
+    globals.running = SWITCH_FALSE;
+
+    for ( int i=0; i<MAX_ORIGINATE_WORKERS; i++ ) {
+        if ( globals.workers[i] ) {
+            switch_thread_join( &st, globals.workers[i] );
+            globals.workers[i] = NULL;
+        }
+    }
+
+    if ( globals.dial_queue ) {
+        while ( switch_queue_trypop( globals.dial_queue, &pop ) == SWITCH_STATUS_SUCCESS ) {
+            struct dialer_dial_job *dial_job = (struct dialer_dial_job *) pop;
+            struct db_campaign_config *campaign = dial_job->campaign;
+            struct dialer_route *route = dial_job->route;
+
+            /* the record belongs to the slab: give back its slots and its number the way a worker does for a call it didn't send */
+            dialer_call_finished( dial_job, 0, SWITCH_CAUSE_NONE );
+            dialer_inflight_done( campaign, route );
+        }
+    }
+}
+
+/*!\brief Build "<head> ('n1','n2',...)" for `count` numbers laid out `stride` bytes apart, quotes are doubled
+ * return a malloc'ed string the caller must free
+ */
+static char *dialer_sql_in_list( const char *head, const char *numbers, switch_size_t stride, int count )
+{
+    char *sql = NULL;
+    switch_size_t len, pos;
+
+    /* every number may need its quotes doubled, plus the surrounding quotes and comma */
+    len = strlen( head ) + 8 + count * ( DIALER_NUMBER_SIZE * 2 + 3 );
+    switch_zmalloc( sql, len );
+    pos = snprintf( sql, len, "%s (", head );
+
+    for ( int i=0; i<count; i++ ) {
+        sql[ pos++ ] = '\'';
+        for ( const char *c = numbers + i * stride; *c; c++ ) {
+            if ( *c == '\'' ) {
+                sql[ pos++ ] = '\'';
+            }
+            sql[ pos++ ] = *c;
+        }
+        sql[ pos++ ] = '\'';
+        sql[ pos++ ] = ( i == count - 1 ) ? ')' : ',';
+    }
+    sql[ pos ] = '\0';
+
+    return sql;
+}
+
+static switch_bool_t dialer_execute_sql( char *sql )
+{
+    char *errmsg = NULL;
+    switch_cache_db_handle_t *dbh = NULL;
+    switch_bool_t ret = SWITCH_FALSE;
+
+    if (!(dbh = dialer_get_db_handle())) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Error Opening DB\n");
+        goto end;
+    }
+
+    switch_cache_db_execute_sql( dbh, sql, &errmsg );
+
+    if (errmsg) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: SQL ERR: [%s] %s\n", sql, errmsg);
+        free(errmsg);
+    } else {
+        ret = SWITCH_TRUE;
+    }
+
+end:
+
+    switch_cache_db_release_db_handle(&dbh);
+    return ret;
+}
+
+/*!\brief Give a whole set of leased numbers back with a single UPDATE. Only rows this campaign run still owns are touched,
+ * an expired lease may already have been claimed by another node
+ */
+static switch_bool_t dialer_release_numbers( struct db_campaign_config *campaign, const struct dialer_destination *destinations, int count )
+{
+    char head[256];
+    char *sql_update = NULL;
+    switch_bool_t ret;
+
+    if ( count <= 0 ) {
+        return SWITCH_TRUE;
+    }
+
+    if ( campaign->file ) {
+        dialer_file_release( campaign, destinations, count );
+        return SWITCH_TRUE;
+    }
+
+    snprintf( head, sizeof( head ), "update %s set in_use = 0, lease_owner = NULL, lease_expires = NULL where lease_owner = '%s' and number in", campaign->destination_list, campaign->uuid_str );
+    sql_update = dialer_sql_in_list( head, destinations->number, sizeof( struct dialer_destination ), count );
+    ret = dialer_execute_sql( sql_update );
+    switch_safe_free( sql_update );
+
+    return ret;
+}
+
+/*!\brief Find the destination_list of campaign `name` in the campaign definitions
+ */
+static switch_bool_t dialer_config_destination_list( const char *name, char *table, switch_size_t len )
+{
+    struct dialer_campaign_def *def;
+    const char *value;
+    switch_bool_t found = SWITCH_FALSE;
+
+    switch_mutex_lock( globals.definitions_mutex );
+    if ( globals.definitions && ( def = switch_core_hash_find( globals.definitions, name ) ) &&
+         !zstr( value = def->values[ dialer_param_find( "destination_list" ) ] ) ) {
+        switch_copy_string( table, value, len );
+        found = SWITCH_TRUE;
+    }
+    switch_mutex_unlock( globals.definitions_mutex );
+
+    return found;
+}
+
+/*!\brief Normalize a phone number: separators and quotes are dropped, a leading + is kept
+ * return SWITCH_FALSE if anything else is in the way or there are fewer than 3 digits
+ */
+static switch_bool_t dialer_load_number( const char *in, char *out, switch_size_t len )
+{
+    switch_size_t n = 0, digits = 0;
+
+    for ( ; *in; in++ ) {
+        if ( isdigit( (unsigned char) *in ) || ( *in == '+' && n == 0 ) ) {
+            if ( n + 1 >= len ) {
+                return SWITCH_FALSE;
+            }
+            digits += *in != '+';
+            out[ n++ ] = *in;
+        } else if ( !strchr( " \t\r\n\"'-.()/", *in ) ) {
+            return SWITCH_FALSE;
+        }
+    }
+    out[n] = '\0';
+
+    return digits >= 3 ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*!\brief Parse one line of a load file: number[,callerid[,duration]], separated by commas, semicolons or tabs.
+ * A callerid that isn't a number is dropped, a missing or negative duration is 0
+ */
+static switch_bool_t dialer_load_parse( char *line, struct dialer_destination *destination )
+{
+    char *fields[3] = { line, NULL, NULL };
+    int count = 1;
+
+    for ( char *p = line; *p && count < 3; p++ ) {
+        if ( *p == ',' || *p == ';' || *p == '\t' ) {
+            *p = '\0';
+            fields[ count++ ] = p + 1;
+        }
+    }
+
+    if ( !dialer_load_number( fields[0], destination->number, sizeof( destination->number ) ) ) {
+        return SWITCH_FALSE;
+    }
+    if ( !fields[1] || !dialer_load_number( fields[1], destination->callerid, sizeof( destination->callerid ) ) ) {
+        destination->callerid[0] = '\0';
+    }
+    destination->duration = fields[2] ? atoi( fields[2] ) : 0;
+    if ( destination->duration < 0 ) {
+        destination->duration = 0;
+    }
+    return SWITCH_TRUE;
+}
+
+/*!\brief Let the campaigns dialing `table` know it has new rows, in case they already ran out of numbers
+ */
+static void dialer_load_notify( const char *table )
+{
+    struct db_campaign_config **campaigns = NULL;
+    struct db_campaign_config *campaign;
+    int count = 0, i;
+
+    switch_mutex_lock( globals.mutex );
+    if ( globals.campaign_count > 0 && ( campaigns = malloc( sizeof( *campaigns ) * globals.campaign_count ) ) ) {
+        for ( campaign = globals.campaign_list; campaign; campaign = campaign->next ) {
+            if ( campaign->running == SWITCH_TRUE && campaign->queue_mutex && !strcmp( campaign->destination_list, table ) ) {
+                campaign->refs++;
+                campaigns[ count++ ] = campaign;
+            }
+        }
+    }
+    switch_mutex_unlock( globals.mutex );
+
+    for ( i = 0; i < count; i++ ) {
+        switch_mutex_lock( campaigns[i]->queue_mutex );
+        campaigns[i]->queue_exhausted = SWITCH_FALSE;
+        switch_thread_cond_signal( campaigns[i]->queue_refill_cond );
+        switch_mutex_unlock( campaigns[i]->queue_mutex );
+        dialer_campaign_release( campaigns[i] );
+    }
+    switch_safe_free( campaigns );
+}
+
+/*!\brief Is a load into `table` in progress? A campaign dialing it isn't done when it runs out of numbers
+ */
+static switch_bool_t dialer_load_running( const char *table )
+{
+    struct dialer_load *load;
+    switch_bool_t running = SWITCH_FALSE;
+
+    switch_mutex_lock( globals.loads_mutex );
+    for ( load = globals.load_list; load && !running; load = load->next ) {
+        running = !strcmp( load->table, table ) ? SWITCH_TRUE : SWITCH_FALSE;
+    }
+    switch_mutex_unlock( globals.loads_mutex );
+
+    return running;
+}
+
+/*!\brief Write out a batch of rows in one multi-row INSERT and its own transaction
+ */
+static switch_bool_t dialer_load_flush( struct dialer_load *load, switch_cache_db_handle_t *dbh, char *sql, switch_size_t len, switch_size_t size, int rows )
+{
+    switch_snprintf( sql + len, size - len, "%s", globals.dialect->insert_ignore_tail );
+    if ( switch_cache_db_persistant_execute_trans( dbh, sql, 1 ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: loading %s into %s failed at line %u\n", load->path, load->table, switch_atomic_read( &load->lines ) );
+        return SWITCH_FALSE;
+    }
+    switch_atomic_add( &load->loaded, rows );
+    dialer_load_notify( load->table );
+    return SWITCH_TRUE;
+}
+
+/*!\brief Stream a number file into a destination_list, DIALER_LOAD_BATCH rows at a time. Numbers already in the table
+ * are left alone, so a file can be loaded again after an interruption
+ */
+static void *SWITCH_THREAD_FUNC dialer_load_thread(switch_thread_t *thread, void *obj)
+{
+    struct dialer_load *load = (struct dialer_load *) obj;
+    struct dialer_load **link;
+    struct dialer_destination destination;
+    switch_cache_db_handle_t *dbh = NULL;
+    switch_memory_pool_t *pool = load->pool;
+    switch_size_t size, len, head_len;
+    char line[512];
+    char *sql = NULL;
+    char *buffer = NULL;
+    FILE *fp = NULL;
+    int rows = 0, truncated = 0;
+    uint32_t lines;
+
+    if ( dialer_check_destinations_table( load->table ) == SWITCH_FALSE ) {
+        goto end;
+    }
+    if ( !( fp = fopen( load->path, "r" ) ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't open %s\n", load->path );
+        goto end;
+    }
+    if ( ( buffer = malloc( DIALER_LOAD_BUFFER ) ) ) {
+        setvbuf( fp, buffer, _IOFBF, DIALER_LOAD_BUFFER );
+    }
+    if ( !( dbh = dialer_get_db_handle() ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Error Opening DB\n" );
+        goto end;
+    }
+
+    /* a row is at most ('<30>','<25>',<int>,0,0), */
+    size = 256 + (switch_size_t) DIALER_LOAD_BATCH * 96;
+    if ( !( sql = malloc( size ) ) ) {
+        goto end;
+    }
+    head_len = switch_snprintf( sql, size, "%s %s (number, callerid, duration, calls, in_use) values ", globals.dialect->insert_ignore, load->table );
+    len = head_len;
+
+    while ( load->stop == SWITCH_FALSE && fgets( line, sizeof( line ), fp ) ) {
+        /* the tail of a line longer than the buffer is part of the same invalid line */
+        if ( truncated ) {
+            truncated = !strchr( line, '\n' ) && !feof( fp );
+            continue;
+        }
+        truncated = !strchr( line, '\n' ) && !feof( fp );
+
+        switch_atomic_inc( &load->lines );
+        lines = switch_atomic_read( &load->lines );
+        if ( lines % DIALER_LOAD_PROGRESS == 0 ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: loading %s into %s: %u lines, %u rows, %u invalid\n", load->path, load->table, lines,
+                               switch_atomic_read( &load->loaded ), switch_atomic_read( &load->invalid ) );
+        }
+
+        if ( truncated || dialer_load_parse( line, &destination ) == SWITCH_FALSE ) {
+            /* the first line may well be a header */
+            if ( lines > 1 || truncated ) {
+                switch_atomic_inc( &load->invalid );
+            }
+            continue;
+        }
+
+        if ( zstr( destination.callerid ) ) {
+            len += switch_snprintf( sql + len, size - len, "%s('%s',NULL,%d,0,0)", rows ? "," : "", destination.number, destination.duration );
+        } else {
+            len += switch_snprintf( sql + len, size - len, "%s('%s','%s',%d,0,0)", rows ? "," : "", destination.number, destination.callerid, destination.duration );
+        }
+
+        if ( ++rows == DIALER_LOAD_BATCH ) {
+            if ( dialer_load_flush( load, dbh, sql, len, size, rows ) == SWITCH_FALSE ) {
+                goto end;
+            }
+            rows = 0;
+            len = head_len;
+        }
+    }
+
+    if ( rows > 0 && dialer_load_flush( load, dbh, sql, len, size, rows ) == SWITCH_FALSE ) {
+        goto end;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "dialer: %s %s into %s: %u lines, %u rows, %u invalid in %.1f seconds\n", load->stop ? "stopped loading" : "loaded",
+                       load->path, load->table, switch_atomic_read( &load->lines ), switch_atomic_read( &load->loaded ), switch_atomic_read( &load->invalid ),
+                       ( switch_micro_time_now() - load->started ) / 1000000.0 );
+
+end:
+    if ( dbh ) {
+        switch_cache_db_release_db_handle( &dbh );
+    }
+    if ( fp ) {
+        fclose( fp );
+    }
+    switch_safe_free( buffer );
+    switch_safe_free( sql );
+
+    switch_mutex_lock( globals.loads_mutex );
+    for ( link = &globals.load_list; *link; link = &(*link)->next ) {
+        if ( *link == load ) {
+            *link = load->next;
+            break;
+        }
+    }
+    switch_mutex_unlock( globals.loads_mutex );
+
+    /* campaigns that ran out while we were loading can finish now */
+    dialer_load_notify( load->table );
+
+    switch_core_destroy_memory_pool( &pool );
+    return NULL;
+}
+
+/*!\brief `dialer load <campaign> <file>`: load a number file into the campaign's destination_list on a thread of its own.
+ * The campaign may be running, it dials the new rows as they are committed
+ */
+static switch_bool_t dialer_load_start( const char *campaign, const char *path, switch_stream_handle_t *stream )
+{
+    struct dialer_load *load = NULL;
+    switch_memory_pool_t *pool = NULL;
+    switch_threadattr_t *thd_attr = NULL;
+    switch_thread_t *thread = NULL;
+    char table[50];
+
+    if ( dialer_config_destination_list( campaign, table, sizeof( table ) ) == SWITCH_FALSE ) {
+        stream->write_function( stream, "-ERR campaign %s not found\n", campaign );
+        return SWITCH_FALSE;
+    }
+    if ( access( path, R_OK ) ) {
+        stream->write_function( stream, "-ERR can't read %s\n", path );
+        return SWITCH_FALSE;
+    }
+    if ( dialer_load_running( table ) == SWITCH_TRUE ) {
+        stream->write_function( stream, "-ERR %s is already being loaded\n", table );
+        return SWITCH_FALSE;
+    }
+
+    if ( switch_core_new_memory_pool( &pool ) != SWITCH_STATUS_SUCCESS ) {
+        stream->write_function( stream, "-ERR out of memory\n" );
+        return SWITCH_FALSE;
+    }
+    load = switch_core_alloc( pool, sizeof( struct dialer_load ) );
+    load->pool = pool;
+    switch_copy_string( load->campaign, campaign, sizeof( load->campaign ) );
+    switch_copy_string( load->table, table, sizeof( load->table ) );
+    switch_copy_string( load->path, path, sizeof( load->path ) );
+    load->started = switch_micro_time_now();
+
+    switch_mutex_lock( globals.loads_mutex );
+    load->next = globals.load_list;
+    globals.load_list = load;
+    switch_mutex_unlock( globals.loads_mutex );
+
+    switch_threadattr_create( &thd_attr, pool );
+    switch_threadattr_detach_set( thd_attr, 1 );
+    switch_threadattr_stacksize_set( thd_attr, SWITCH_THREAD_STACKSIZE );
+
+    if ( switch_thread_create( &thread, thd_attr, dialer_load_thread, load, pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_mutex_lock( globals.loads_mutex );
+        globals.load_list = load->next;
+        switch_mutex_unlock( globals.loads_mutex );
+        switch_core_destroy_memory_pool( &pool );
+        stream->write_function( stream, "-ERR couldn't start the load\n" );
+        return SWITCH_FALSE;
+    }
+
+    stream->write_function( stream, "+OK loading %s into %s\n", path, table );
+    return SWITCH_TRUE;
+}
+
+/*!\brief `dialer load`: one line per load in progress
+ */
+static void dialer_load_list( switch_stream_handle_t *stream )
+{
+    struct dialer_load *load;
+
+    switch_mutex_lock( globals.loads_mutex );
+    for ( load = globals.load_list; load; load = load->next ) {
+        stream->write_function( stream, "%s %s %s lines=%u loaded=%u invalid=%u elapsed=%.1f\n", load->campaign, load->table, load->path,
+                                switch_atomic_read( &load->lines ), switch_atomic_read( &load->loaded ), switch_atomic_read( &load->invalid ),
+                                ( switch_micro_time_now() - load->started ) / 1000000.0 );
+    }
+    if ( !globals.load_list ) {
+        stream->write_function( stream, "no loads in progress\n" );
+    }
+    switch_mutex_unlock( globals.loads_mutex );
+}
+
+/*!\brief Copy row `row` of a file source into `buf`, without its line ending
+ */
+static void dialer_file_line( struct dialer_file_source *file, uint32_t row, char *buf, switch_size_t len )
+{
+    const char *p = file->data + file->rows[ row ].offset, *end = file->data + file->size;
+    switch_size_t n = 0;
+
+    while ( p < end && *p != '\n' && n + 1 < len ) {
+        buf[ n++ ] = *p++;
+    }
+    while ( n > 0 && buf[ n - 1 ] == '\r' ) {
+        n--;
+    }
+    buf[n] = '\0';
+}
+
+/*!\brief Is the line from `p` up to `eol` only blanks? The mapping isn't NUL-terminated, nothing past `eol` is read
+ */
+static switch_bool_t dialer_file_blank( const char *p, const char *eol )
+{
+    while ( p < eol && ( *p == ' ' || *p == '\t' || *p == '\r' ) ) {
+        p++;
+    }
+    return p == eol ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*!\brief Index the number file into a fresh sidecar: one row per non-blank line, the ones that don't parse are marked invalid
+ */
+static switch_bool_t dialer_file_index( struct dialer_file_source *file, struct stat *st )
+{
+    struct dialer_destination destination;
+    char line[256];
+    const char *p, *end = file->data + file->size, *eol;
+    uint32_t rows = 0, row = 0, invalid = 0;
+
+    for ( p = file->data; p < end; p = eol + 1 ) {
+        if ( !( eol = memchr( p, '\n', end - p ) ) ) {
+            eol = end;
+        }
+        rows += dialer_file_blank( p, eol ) == SWITCH_FALSE;
+    }
+
+    file->state_size = sizeof( struct dialer_file_header ) + (switch_size_t) rows * sizeof( struct dialer_file_row );
+    if ( ftruncate( file->state_fd, 0 ) || ftruncate( file->state_fd, file->state_size ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't size %s.state: %s\n", file->path, strerror( errno ) );
+        return SWITCH_FALSE;
+    }
+    if ( ( file->header = mmap( NULL, file->state_size, PROT_READ | PROT_WRITE, MAP_SHARED, file->state_fd, 0 ) ) == MAP_FAILED ) {
+        file->header = NULL;
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't map %s.state: %s\n", file->path, strerror( errno ) );
+        return SWITCH_FALSE;
+    }
+    file->rows = (struct dialer_file_row *) ( file->header + 1 );
+
+    for ( p = file->data; p < end && row < rows; p = eol + 1 ) {
+        if ( !( eol = memchr( p, '\n', end - p ) ) ) {
+            eol = end;
+        }
+        if ( dialer_file_blank( p, eol ) == SWITCH_TRUE ) {
+            continue;
+        }
+        file->rows[ row ].offset = p - file->data;
+        dialer_file_line( file, row, line, sizeof( line ) );
+        if ( dialer_load_parse( line, &destination ) == SWITCH_FALSE ) {
+            file->rows[ row ].flags = DIALER_FILE_ROW_INVALID;
+            invalid++;
+        }
+        row++;
+    }
+
+    file->header->rows = rows;
+    file->header->file_size = file->size;
+    file->header->file_mtime = (int64_t) st->st_mtime;
+    file->header->cursor = 0;
+    /* last, a sidecar cut short while indexing won't pass for a valid one */
+    file->header->magic = DIALER_FILE_MAGIC;
+    msync( file->header, file->state_size, MS_SYNC );
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: indexed %s: %u numbers, %u invalid lines\n", file->path, rows - invalid, invalid );
+    return SWITCH_TRUE;
+}
+
+/*!\brief Map a campaign's number file and its sidecar. A sidecar that still matches the file's size and mtime is picked up as
+ * it was left, anything else is rebuilt from the file
+ */
+static switch_bool_t dialer_file_open( struct db_campaign_config *campaign )
+{
+    struct dialer_file_source *file = campaign->file;
+    struct dialer_file_header header;
+    struct stat st, state_st;
+    char state_path[ sizeof( file->path ) + 8 ];
+    uint32_t leased = 0;
+
+    switch_mutex_init( &file->mutex, SWITCH_MUTEX_NESTED, campaign->pool );
+
+    if ( ( file->fd = open( file->path, O_RDONLY ) ) < 0 || fstat( file->fd, &st ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't open %s: %s\n", file->path, strerror( errno ) );
+        return SWITCH_FALSE;
+    }
+    if ( st.st_size == 0 ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: %s is empty\n", file->path );
+        return SWITCH_FALSE;
+    }
+    file->size = st.st_size;
+    if ( ( file->data = mmap( NULL, file->size, PROT_READ, MAP_SHARED, file->fd, 0 ) ) == MAP_FAILED ) {
+        file->data = NULL;
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't map %s: %s\n", file->path, strerror( errno ) );
+        return SWITCH_FALSE;
+    }
+
+    switch_snprintf( state_path, sizeof( state_path ), "%s.state", file->path );
+    if ( ( file->state_fd = open( state_path, O_RDWR | O_CREAT, 0644 ) ) < 0 || fstat( file->state_fd, &state_st ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't open %s: %s\n", state_path, strerror( errno ) );
+        return SWITCH_FALSE;
+    }
+
+    if ( state_st.st_size < (off_t) sizeof( header ) || pread( file->state_fd, &header, sizeof( header ), 0 ) != sizeof( header ) ||
+         header.magic != DIALER_FILE_MAGIC || header.file_size != file->size || header.file_mtime != (int64_t) st.st_mtime ||
+         state_st.st_size != (off_t) ( sizeof( header ) + (switch_size_t) header.rows * sizeof( struct dialer_file_row ) ) ) {
+        return dialer_file_index( file, &st );
+    }
+
+    file->state_size = state_st.st_size;
+    if ( ( file->header = mmap( NULL, file->state_size, PROT_READ | PROT_WRITE, MAP_SHARED, file->state_fd, 0 ) ) == MAP_FAILED ) {
+        file->header = NULL;
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: Couldn't map %s: %s\n", state_path, strerror( errno ) );
+        return SWITCH_FALSE;
+    }
+    file->rows = (struct dialer_file_row *) ( file->header + 1 );
+
+    /* whatever the last run had leased was never finished, it is eligible again */
+    for ( uint32_t row = 0; row < file->header->rows; row++ ) {
+        if ( file->rows[ row ].flags & DIALER_FILE_ROW_LEASED ) {
+            file->rows[ row ].flags &= ~DIALER_FILE_ROW_LEASED;
+            leased++;
+        }
+    }
+    if ( file->header->cursor >= file->header->rows ) {
+        file->header->cursor = 0;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s resumes %s at row %u of %u, %u leases given back\n", campaign->name, file->path,
+                       file->header->cursor, file->header->rows, leased );
+    return SWITCH_TRUE;
+}
+
+static void dialer_file_close( struct dialer_file_source *file )
+{
+    if ( file->header ) {
+        msync( file->header, file->state_size, MS_SYNC );
+        munmap( file->header, file->state_size );
+        file->header = NULL;
+        file->rows = NULL;
+    }
+    if ( file->data ) {
+        munmap( (void *) file->data, file->size );
+        file->data = NULL;
+    }
+    if ( file->state_fd >= 0 ) {
+        close( file->state_fd );
+        file->state_fd = -1;
+    }
+    if ( file->fd >= 0 ) {
+        close( file->fd );
+        file->fd = -1;
+    }
+}
+
+/*!\brief Lease up to `max` eligible rows of a file source. SEQUENTIAL follows the file from the sidecar's cursor, RANDOM walks
+ * the campaign's permutation of the rows. A call looks at every row at most once, so 0 means nothing is eligible right now
+ */
+static int dialer_file_lease( struct db_campaign_config *campaign, struct dialer_destination *destinations, int max )
+{
+    struct dialer_file_source *file = campaign->file;
+    struct dialer_file_row *entry;
+    uint32_t now = (uint32_t) ( switch_micro_time_now() / 1000000 );
+    uint32_t rows = file->header->rows, row, scanned;
+    char line[256];
+    int count = 0;
+    switch_time_t started = switch_micro_time_now();
+
+    switch_mutex_lock( file->mutex );
+    for ( scanned = 0; count < max && scanned < rows; scanned++ ) {
+        if ( campaign->calling_strategy == SEQUENTIAL ) {
+            row = file->header->cursor;
+            file->header->cursor = ( row + 1 ) % rows;
+        } else {
+            if ( campaign->perm_pos >= campaign->perm.size ) {
+                dialer_perm_init( &campaign->perm, campaign->perm.seed, rows );
+                campaign->perm_pos = 0;
+            }
+            row = dialer_perm_forward( &campaign->perm, campaign->perm_pos++ );
+        }
+
+        entry = &file->rows[ row ];
+        if ( ( entry->flags & ( DIALER_FILE_ROW_INVALID | DIALER_FILE_ROW_LEASED ) ) || entry->calls >= campaign->attempts_per_number ||
+             ( entry->lastcall && entry->lastcall + campaign->time_between_retries >= now ) ) {
+            continue;
+        }
+
+        memset( &destinations[ count ], 0, sizeof( struct dialer_destination ) );
+        dialer_file_line( file, row, line, sizeof( line ) );
+        if ( dialer_load_parse( line, &destinations[ count ] ) == SWITCH_FALSE ) {
+            entry->flags |= DIALER_FILE_ROW_INVALID;
+            continue;
+        }
+        destinations[ count ].id = row + 1;
+        destinations[ count ].calls = entry->calls;
+        entry->flags |= DIALER_FILE_ROW_LEASED;
+        count++;
+    }
+    switch_mutex_unlock( file->mutex );
+
+    dialer_histogram_observe( &campaign->pick_latency, dialer_latency_bounds, switch_micro_time_now() - started );
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: leased %d numbers for campaign %s from %s\n", count, campaign->name, file->path );
+    return count;
+}
+
+/*!\brief The file source's side of dialer_db_number_called/released/retried, straight into the sidecar
+ */
+static void dialer_file_update( struct db_campaign_config *campaign, uint32_t id, dialer_db_op_type_t type )
+{
+    struct dialer_file_source *file = campaign->file;
+    struct dialer_file_row *entry;
+
+    switch_mutex_lock( file->mutex );
+    if ( file->header && id > 0 && id <= file->header->rows ) {
+        entry = &file->rows[ id - 1 ];
+        if ( type == DIALER_DB_OP_CALLED ) {
+            entry->calls++;
+        } else {
+            entry->lastcall = (uint32_t) ( switch_micro_time_now() / 1000000 );
+            if ( type == DIALER_DB_OP_RELEASED ) {
+                entry->flags &= ~DIALER_FILE_ROW_LEASED;
+            }
+        }
+    }
+    switch_mutex_unlock( file->mutex );
+}
+
+/*!\brief Give back leased rows of a file source that were never dialed, their lastcall stays as it was
+ */
+static void dialer_file_release( struct db_campaign_config *campaign, const struct dialer_destination *destinations, int count )
+{
+    struct dialer_file_source *file = campaign->file;
+
+    switch_mutex_lock( file->mutex );
+    for ( int i=0; file->header && i<count; i++ ) {
+        if ( destinations[i].id > 0 && destinations[i].id <= file->header->rows ) {
+            file->rows[ destinations[i].id - 1 ].flags &= ~DIALER_FILE_ROW_LEASED;
+        }
+    }
+    switch_mutex_unlock( file->mutex );
+}
+
+/*!\brief Queue a row update for the DB writer. Blocks while the writer's queue is full, so that a database that
+ * falls behind slows the callers down instead of growing the backlog without bounds
+ */
+static void dialer_db_push( dialer_db_op_type_t type, struct db_campaign_config *campaign, const char *number )
+{
+    struct dialer_db_op *op = NULL;
+
+    switch_zmalloc( op, sizeof( struct dialer_db_op ) );
+    op->type = type;
+    op->campaign = campaign;
+    if ( number ) {
+        switch_copy_string( op->number, number, sizeof( op->number ) );
+    }
+
+    if ( switch_queue_trypush( globals.db_queue, op ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: DB writer queue is full, waiting for the database\n" );
+        switch_queue_push( globals.db_queue, op );
+    }
+}
+
+/*!\brief An attempt on `number` is over, answered or not: calls = calls + 1
+ */
+static void dialer_db_number_called( struct db_campaign_config *campaign, uint32_t id, const char *number )
+{
+    if ( campaign->file ) {
+        dialer_file_update( campaign, id, DIALER_DB_OP_CALLED );
+        return;
+    }
+    dialer_db_push( DIALER_DB_OP_CALLED, campaign, number );
+}
+
+/*!\brief A call to `number` is over: lastcall = NOW(), in_use = 0
+ */
+static void dialer_db_number_released( struct db_campaign_config *campaign, uint32_t id, const char *number )
+{
+    if ( campaign->file ) {
+        dialer_file_update( campaign, id, DIALER_DB_OP_RELEASED );
+        return;
+    }
+    dialer_db_push( DIALER_DB_OP_RELEASED, campaign, number );
+}
+
+/*!\brief A call to `number` is over but it will be retried, we keep the lease: lastcall = NOW()
+ */
+static void dialer_db_number_retried( struct db_campaign_config *campaign, uint32_t id, const char *number )
+{
+    if ( campaign->file ) {
+        dialer_file_update( campaign, id, DIALER_DB_OP_RETRIED );
+        return;
+    }
+    dialer_db_push( DIALER_DB_OP_RETRIED, campaign, number );
+}
+
+static int dialer_db_pending_count( struct dialer_db_pending *pending )
+{
+    return pending->called_count + pending->released_count + pending->retried_count;
+}
+
+/*!\brief Wait until every update queued so far for `campaign` has been written
+ */
+static void dialer_db_flush( struct db_campaign_config *campaign )
+{
+    switch_atomic_t done = 0;
+    struct dialer_db_op *op = NULL;
+
+    if ( campaign->file ) {
+        /* nothing of a file campaign goes through the DB writer */
+        if ( campaign->file->header ) {
+            msync( campaign->file->header, campaign->file->state_size, MS_ASYNC );
+        }
+        return;
+    }
+
+    if ( !globals.db_queue ) {
+        return;
+    }
+
+    switch_zmalloc( op, sizeof( struct dialer_db_op ) );
+    op->type = DIALER_DB_OP_FLUSH;
+    op->campaign = campaign;
+    op->done = &done;
+    switch_queue_push( globals.db_queue, op );
+
+    while ( !switch_atomic_read( &done ) ) {
+        switch_yield( 10000 );
+    }
+}
+
+/*!\brief Write out everything pending for one campaign (DB writer thread only), the calls increments go first so that a released number is
+ * never seen with a stale calls count
+ */
+static void dialer_db_flush_campaign( struct db_campaign_config *campaign )
+{
+    struct dialer_db_pending *pending = &campaign->db_pending;
+    char head[256];
+    char *sql = NULL;
+
+    if ( pending->called_count > 0 ) {
+        snprintf( head, sizeof( head ), "update %s set calls = calls + 1 where number in", campaign->destination_list );
+        sql = dialer_sql_in_list( head, pending->called[0], DIALER_NUMBER_SIZE, pending->called_count );
+        dialer_execute_sql( sql );
+        switch_safe_free( sql );
+    }
+
+    if ( pending->retried_count > 0 ) {
+        snprintf( head, sizeof( head ), "update %s set lastcall = %s where lease_owner = '%s' and number in", campaign->destination_list, globals.dialect->now, campaign->uuid_str );
+        sql = dialer_sql_in_list( head, pending->retried[0], DIALER_NUMBER_SIZE, pending->retried_count );
+        dialer_execute_sql( sql );
+        switch_safe_free( sql );
+    }
+
+    if ( pending->released_count > 0 ) {
+        snprintf( head, sizeof( head ), "update %s set lastcall = %s, in_use = 0, lease_owner = NULL, lease_expires = NULL where lease_owner = '%s' and number in",
+                  campaign->destination_list, globals.dialect->now, campaign->uuid_str );
+        sql = dialer_sql_in_list( head, pending->released[0], DIALER_NUMBER_SIZE, pending->released_count );
+        dialer_execute_sql( sql );
+        switch_safe_free( sql );
+    }
+
+    switch_safe_free( pending->called );
+    switch_safe_free( pending->released );
+    switch_safe_free( pending->retried );
+    pending->called_count = 0;
+    pending->released_count = 0;
+    pending->retried_count = 0;
+}
+
+/*!\brief Coalesce queued row updates into one multi-row UPDATE per campaign and kind, written every
+ * `db-flush-interval-ms` or as soon as `db-flush-batch` changes are pending
+ */
+static void *SWITCH_THREAD_FUNC dialer_db_writer_thread(switch_thread_t *thread, void *obj)
+{
+    struct db_campaign_config **dirty = NULL;
+    int dirty_count = 0, dirty_size = 0, pending_total = 0;
+    switch_time_t next_flush = switch_micro_time_now() + globals.db_flush_interval * 1000;
+    switch_interval_time_t wait;
+    void *pop = NULL;
+
+    while ( globals.db_writer_running == SWITCH_TRUE || switch_queue_size( globals.db_queue ) > 0 ) {
+        struct dialer_db_op *op = NULL;
+
+        wait = next_flush - switch_micro_time_now();
+        if ( wait < 1000 ) {
+            wait = 1000;
+        }
+
+        if ( switch_queue_pop_timeout( globals.db_queue, &pop, wait ) == SWITCH_STATUS_SUCCESS && pop ) {
+            struct db_campaign_config *campaign;
+            struct dialer_db_pending *pending;
+
+            op = (struct dialer_db_op *) pop;
+            campaign = op->campaign;
+            pending = &campaign->db_pending;
+
+            if ( op->type == DIALER_DB_OP_FLUSH ) {
+                pending_total -= dialer_db_pending_count( pending );
+                dialer_db_flush_campaign( campaign );
+                /* the campaign may be freed as soon as its flush is done, forget about it */
+                if ( pending->listed == SWITCH_TRUE ) {
+                    for ( int i=0; i<dirty_count; i++ ) {
+                        if ( dirty[i] == campaign ) {
+                            dirty[i] = dirty[ --dirty_count ];
+                            break;
+                        }
+                    }
+                    pending->listed = SWITCH_FALSE;
+                }
+                switch_atomic_set( op->done, 1 );
+                free( op );
+                continue;
+            }
+
+            if ( pending->listed == SWITCH_FALSE ) {
+                if ( dirty_count == dirty_size ) {
+                    dirty_size = dirty_size ? dirty_size * 2 : 16;
+                    dirty = realloc( dirty, dirty_size * sizeof( *dirty ) );
+                }
+                dirty[ dirty_count++ ] = campaign;
+                pending->listed = SWITCH_TRUE;
+            }
+
+            if ( op->type == DIALER_DB_OP_CALLED ) {
+                /* a number called twice within one window would only be counted once by the IN list */
+                for ( int i=0; i<pending->called_count; i++ ) {
+                    if ( !strcmp( pending->called[i], op->number ) ) {
+                        pending_total -= dialer_db_pending_count( pending );
+                        dialer_db_flush_campaign( campaign );
+                        break;
+                    }
+                }
+                if ( !pending->called ) {
+                    switch_zmalloc( pending->called, DIALER_NUMBER_SIZE * globals.db_flush_batch );
+                }
+                switch_copy_string( pending->called[ pending->called_count++ ], op->number, DIALER_NUMBER_SIZE );
+            } else if ( op->type == DIALER_DB_OP_RETRIED ) {
+                if ( !pending->retried ) {
+                    switch_zmalloc( pending->retried, DIALER_NUMBER_SIZE * globals.db_flush_batch );
+                }
+                switch_copy_string( pending->retried[ pending->retried_count++ ], op->number, DIALER_NUMBER_SIZE );
+            } else {
+                if ( !pending->released ) {
+                    switch_zmalloc( pending->released, DIALER_NUMBER_SIZE * globals.db_flush_batch );
+                }
+                switch_copy_string( pending->released[ pending->released_count++ ], op->number, DIALER_NUMBER_SIZE );
+            }
+            pending_total++;
+            free( op );
+
+            /* never overflow the campaign's arrays */
+            if ( pending->called_count == globals.db_flush_batch || pending->released_count == globals.db_flush_batch || pending->retried_count == globals.db_flush_batch ) {
+                pending_total -= dialer_db_pending_count( pending );
+                dialer_db_flush_campaign( campaign );
+            }
+        }
+
+        if ( pending_total >= globals.db_flush_batch || switch_micro_time_now() >= next_flush ) {
+            for ( int i=0; i<dirty_count; i++ ) {
+                dialer_db_flush_campaign( dirty[i] );
+                dirty[i]->db_pending.listed = SWITCH_FALSE;
+            }
+            dirty_count = 0;
+            pending_total = 0;
+            next_flush = switch_micro_time_now() + globals.db_flush_interval * 1000;
+        }
+    }
+
+    for ( int i=0; i<dirty_count; i++ ) {
+        dialer_db_flush_campaign( dirty[i] );
+        dirty[i]->db_pending.listed = SWITCH_FALSE;
+    }
+    switch_safe_free( dirty );
+
+    return NULL;
+}
+
+/*!\brief Start the DB writer thread, it owns every campaign's `db_pending`
+ */
+static switch_bool_t dialer_start_db_writer(void)
+{
+    switch_threadattr_t *thd_attr = NULL;
+
+    if ( switch_queue_create( &globals.db_queue, globals.db_queue_size, globals.pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Couldn't create the DB writer queue\n" );
+        return SWITCH_FALSE;
+    }
+
+    globals.db_writer_running = SWITCH_TRUE;
+    switch_threadattr_create( &thd_attr, globals.pool );
+    switch_threadattr_stacksize_set( thd_attr, SWITCH_THREAD_STACKSIZE );
+
+    if ( switch_thread_create( &globals.db_writer, thd_attr, dialer_db_writer_thread, NULL, globals.pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Couldn't start the DB writer\n" );
+        globals.db_writer = NULL;
+        globals.db_writer_running = SWITCH_FALSE;
+        return SWITCH_FALSE;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: DB writer started, flushing every %d ms or %d changes, queue size %d\n", globals.db_flush_interval, globals.db_flush_batch, globals.db_queue_size );
+    return SWITCH_TRUE;
+}
+
+/*!\brief Let the DB writer drain its queue, write out what is pending and exit
+ */
+static void dialer_stop_db_writer(void)
+{
+    switch_status_t st;
+
+    globals.db_writer_running = SWITCH_FALSE;
+    if ( globals.db_writer ) {
+        switch_thread_join( &st, globals.db_writer );
+        globals.db_writer = NULL;
+    }
+}
+
+static void dialer_journal_path( const char *name, char *path, switch_size_t len )
+{
+    switch_snprintf( path, len, "%s%sdialer_%s.journal", SWITCH_GLOBAL_dirs.db_dir, SWITCH_PATH_SEPARATOR, name );
+}
+
+/*!\brief Write all `len` bytes of `data` at `offset`, or at the file's position with an offset of -1
+ */
+static switch_bool_t dialer_journal_write( int fd, const void *data, switch_size_t len, off_t offset )
+{
+    const char *left = data;
+    ssize_t wrote;
+
+    while ( len > 0 ) {
+        if ( ( wrote = offset < 0 ? write( fd, left, len ) : pwrite( fd, left, len, offset ) ) < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return SWITCH_FALSE;
+        }
+        left += wrote;
+        len -= wrote;
+        if ( offset >= 0 ) {
+            offset += wrote;
+        }
+    }
+    return SWITCH_TRUE;
+}
+
+/*!\brief Queue the result of an attempt for the campaign's journal. Never takes a lock: the slot is claimed with a
+ * compare-and-swap, and only waits (like dialer_db_push() does for the database) when the writer has fallen a whole
+ * ring behind
+ */
+static void dialer_journal_append( struct db_campaign_config *campaign, const struct dialer_dial_job *dial_job, int seconds )
+{
+    struct dialer_journal *journal = campaign->journal;
+    struct dialer_journal_slot *slot;
+    struct dialer_journal_record *record;
+    switch_bool_t warned = SWITCH_FALSE;
+    uint32_t pos;
+    int32_t diff;
+
+    if ( !journal ) {
+        return;
+    }
+
+    for ( ;; ) {
+        pos = journal->head;
+        slot = &journal->slots[ pos & ( journal->size - 1 ) ];
+        diff = (int32_t) ( slot->sequence - pos );
+        if ( diff == 0 ) {
+            if ( dialer_atomic_cas32( &journal->head, pos, pos + 1 ) ) {
+                break;
+            }
+        } else if ( diff < 0 ) {
+            if ( !warned ) {
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: journal of campaign %s is full, waiting for the disk\n", campaign->name );
+                warned = SWITCH_TRUE;
+            }
+            switch_yield( 1000 );
+        }
+        /* otherwise another call took the slot first, look at the next one */
+    }
+
+    record = &slot->record;
+    memset( record, 0, sizeof( *record ) );
+    record->ended = (int64_t) switch_micro_time_now();
+    record->id = dial_job->destination.id;
+    record->cause = (uint32_t) dial_job->hangup_cause;
+    record->seconds = (uint32_t) ( seconds > 0 ? seconds : 0 );
+    record->post_dial_delay = (uint32_t) ( dial_job->post_dial_delay / 1000 );
+    record->calls = (uint16_t) dial_job->destination.calls;
+    record->flags = dial_job->answered ? DIALER_JOURNAL_ANSWERED : 0;
+    switch_copy_string( record->number, dial_job->destination.number, sizeof( record->number ) );
+    if ( dial_job->route ) {
+        switch_copy_string( record->gateway, dial_job->route->gateway->name, sizeof( record->gateway ) );
+    }
+
+    /* the writer may take it once the sequence says so, not before the record is all there */
+    dialer_memory_barrier();
+    slot->sequence = pos + 1;
+}
+
+/*!\brief Take up to `max` queued records off the ring, in the order their slots were claimed (journal thread only)
+ */
+static int dialer_journal_take( struct dialer_journal *journal, struct dialer_journal_record *records, int max )
+{
+    struct dialer_journal_slot *slot;
+    int count = 0;
+
+    while ( count < max ) {
+        slot = &journal->slots[ journal->tail & ( journal->size - 1 ) ];
+        if ( slot->sequence != journal->tail + 1 ) {
+            /* empty, or claimed by a call that hasn't filled it in yet */
+            break;
+        }
+        dialer_memory_barrier();
+        records[ count++ ] = slot->record;
+        dialer_memory_barrier();
+        /* free for whoever claims it a lap later */
+        slot->sequence = journal->tail + journal->size;
+        journal->tail++;
+    }
+
+    return count;
+}
+
+struct dialer_journal_result {
+    char number[DIALER_NUMBER_SIZE];
+    const char *result;
+    int order;
+};
+
+static int dialer_journal_by_number( const void *a, const void *b )
+{
+    const struct dialer_journal_result *x = a, *y = b;
+    int diff = strcmp( x->number, y->number );
+
+    return diff ? diff : x->order - y->order;
+}
+
+static int dialer_journal_by_result( const void *a, const void *b )
+{
+    return strcmp( ( (const struct dialer_journal_result *) a )->result, ( (const struct dialer_journal_result *) b )->result );
+}
+
+/*!\brief Push the records journaled since the last compaction into the destination table, db-flush-batch of them at a
+ * time: the last result of each number (ANSWERED, or the cause of the failure) goes to its lastresult column, with one
+ * UPDATE per distinct result. Once all of them made it to the table the file is cut back to its header. Never runs
+ * while another thread writes the journal
+ */
+static void dialer_journal_compact( struct db_campaign_config *campaign )
+{
+    struct dialer_journal *journal = campaign->journal;
+    struct dialer_journal_record *records = NULL;
+    struct dialer_journal_result *results = NULL;
+    int batch = globals.db_flush_batch > 0 ? globals.db_flush_batch : DEFAULT_DB_FLUSH_BATCH;
+    int count, unique, i, j;
+    switch_bool_t written = SWITCH_TRUE;
+    char head[256];
+    char *sql = NULL;
+
+    if ( journal->compacted >= journal->records ) {
+        return;
+    }
+
+    /* a number file has no lastresult to keep up to date, the journal is all there is */
+    if ( !campaign->file ) {
+        records = malloc( sizeof( struct dialer_journal_record ) * batch );
+        results = malloc( sizeof( struct dialer_journal_result ) * batch );
+    }
+
+    while ( journal->compacted < journal->records ) {
+        count = (int) switch_min( (uint64_t) batch, journal->records - journal->compacted );
+
+        if ( !campaign->file ) {
+            if ( !records || !results || pread( journal->fd, records, sizeof( struct dialer_journal_record ) * count,
+                                                sizeof( struct dialer_journal_header ) + journal->compacted * sizeof( struct dialer_journal_record ) ) !=
+                 (ssize_t) ( sizeof( struct dialer_journal_record ) * count ) ) {
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't read journal %s back: %s\n", journal->path, strerror( errno ) );
+                break;
+            }
+
+            for ( i=0; i<count; i++ ) {
+                switch_copy_string( results[i].number, records[i].number, sizeof( results[i].number ) );
+                results[i].result = records[i].flags & DIALER_JOURNAL_ANSWERED ? "ANSWERED" : switch_channel_cause2str( (switch_call_cause_t) records[i].cause );
+                results[i].order = i;
+            }
+
+            /* the last attempt of each number wins */
+            qsort( results, count, sizeof( struct dialer_journal_result ), dialer_journal_by_number );
+            for ( i=0, unique=0; i<count; i++ ) {
+                if ( unique > 0 && !strcmp( results[ unique - 1 ].number, results[i].number ) ) {
+                    results[ unique - 1 ] = results[i];
+                } else {
+                    results[ unique++ ] = results[i];
+                }
+            }
+
+            qsort( results, unique, sizeof( struct dialer_journal_result ), dialer_journal_by_result );
+            for ( i=0; i<unique; i=j ) {
+                for ( j=i+1; j<unique && !strcmp( results[j].result, results[i].result ); j++ );
+                snprintf( head, sizeof( head ), "update %s set lastresult = '%s' where number in", campaign->destination_list, results[i].result );
+                sql = dialer_sql_in_list( head, results[i].number, sizeof( struct dialer_journal_result ), j - i );
+                if ( dialer_execute_sql( sql ) == SWITCH_FALSE ) {
+                    written = SWITCH_FALSE;
+                }
+                switch_safe_free( sql );
+            }
+        }
+
+        journal->compacted += count;
+    }
+
+    /* every record is summarized in the table, the journal would otherwise grow with every run. A number file has
+     * nothing else to keep its results in, its journal is never cut */
+    if ( !campaign->file && written == SWITCH_TRUE && journal->compacted == journal->records ) {
+        if ( ftruncate( journal->fd, sizeof( struct dialer_journal_header ) ) == 0 &&
+             lseek( journal->fd, sizeof( struct dialer_journal_header ), SEEK_SET ) == (off_t) sizeof( struct dialer_journal_header ) ) {
+            journal->records = 0;
+            journal->compacted = 0;
+        } else {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: couldn't truncate journal %s: %s\n", journal->path, strerror( errno ) );
+        }
+    }
+
+    /* compacting the same records twice after a crash does no harm, the updates are idempotent */
+    if ( dialer_journal_write( journal->fd, &journal->compacted, sizeof( journal->compacted ), offsetof( struct dialer_journal_header, compacted ) ) == SWITCH_FALSE ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "dialer: couldn't update journal %s: %s\n", journal->path, strerror( errno ) );
+    }
+
+    switch_safe_free( records );
+    switch_safe_free( results );
+}
+
+/*!\brief Group commit of a campaign's journal: append whatever calls queued with one write() (up to DIALER_JOURNAL_BATCH
+ * records), sync the file once every db-flush-interval-ms for all the records written since, compact every
+ * journal-compact-interval seconds
+ */
+static void *SWITCH_THREAD_FUNC dialer_journal_thread(switch_thread_t *thread, void *obj)
+{
+    struct db_campaign_config *campaign = (struct db_campaign_config *) obj;
+    struct dialer_journal *journal = campaign->journal;
+    struct dialer_journal_record *batch = malloc( sizeof( struct dialer_journal_record ) * DIALER_JOURNAL_BATCH );
+    switch_time_t now = switch_micro_time_now(), next_sync = now, next_compact = now + (switch_time_t) globals.journal_compact_interval * 1000000;
+    switch_bool_t unsynced = SWITCH_FALSE, stopping;
+    int count;
+
+    if ( !batch ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: no memory for the journal of campaign %s\n", campaign->name );
+        return NULL;
+    }
+
+    for ( ;; ) {
+        /* looked at before taking: once it is off every call has queued its record, an empty take means we are done */
+        stopping = journal->running == SWITCH_FALSE ? SWITCH_TRUE : SWITCH_FALSE;
+        dialer_memory_barrier();
+        if ( ( count = dialer_journal_take( journal, batch, DIALER_JOURNAL_BATCH ) ) > 0 ) {
+            if ( dialer_journal_write( journal->fd, batch, sizeof( struct dialer_journal_record ) * count, -1 ) == SWITCH_TRUE ) {
+                journal->records += count;
+                unsynced = SWITCH_TRUE;
+            } else {
+                switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't append %d records to journal %s: %s\n", count, journal->path, strerror( errno ) );
+                /* drop what made it to the file of them, the next records go right after the last whole one */
+                if ( ftruncate( journal->fd, sizeof( struct dialer_journal_header ) + journal->records * sizeof( struct dialer_journal_record ) ) == 0 ) {
+                    lseek( journal->fd, 0, SEEK_END );
+                }
+            }
+        }
+
+        now = switch_micro_time_now();
+        if ( unsynced && count < DIALER_JOURNAL_BATCH && now >= next_sync ) {
+            fdatasync( journal->fd );
+            unsynced = SWITCH_FALSE;
+            next_sync = now + globals.db_flush_interval * 1000;
+        }
+        if ( globals.journal_compact_interval > 0 && now >= next_compact ) {
+            dialer_journal_compact( campaign );
+            next_compact = switch_micro_time_now() + (switch_time_t) globals.journal_compact_interval * 1000000;
+        }
+
+        if ( count == 0 ) {
+            if ( stopping ) {
+                break;
+            }
+            switch_yield( globals.db_flush_interval * 1000 );
+        }
+    }
+
+    if ( unsynced ) {
+        fdatasync( journal->fd );
+    }
+    free( batch );
+    return NULL;
+}
+
+/*!\brief Open (or create) the campaign's journal and start its thread. A campaign whose journal can't be opened runs
+ * without one
+ */
+static void dialer_journal_open( struct db_campaign_config *campaign )
+{
+    struct dialer_journal *journal = NULL;
+    struct dialer_journal_header header;
+    switch_threadattr_t *thd_attr = NULL;
+    off_t end;
+    struct stat st;
+    uint32_t size = 1;
+
+    if ( !globals.journal || zstr( SWITCH_GLOBAL_dirs.db_dir ) ) {
+        return;
+    }
+
+    journal = switch_core_alloc( campaign->pool, sizeof( struct dialer_journal ) );
+    dialer_journal_path( campaign->name, journal->path, sizeof( journal->path ) );
+    if ( ( journal->fd = open( journal->path, O_RDWR | O_CREAT, 0644 ) ) < 0 || fstat( journal->fd, &st ) < 0 ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't open journal %s, campaign %s runs without one: %s\n", journal->path, campaign->name, strerror( errno ) );
+        goto fail;
+    }
+
+    if ( st.st_size < (off_t) sizeof( header ) ) {
+        memset( &header, 0, sizeof( header ) );
+        header.magic = DIALER_JOURNAL_MAGIC;
+        header.record_size = sizeof( struct dialer_journal_record );
+        if ( ftruncate( journal->fd, 0 ) || dialer_journal_write( journal->fd, &header, sizeof( header ), 0 ) == SWITCH_FALSE ) {
+            switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't write journal %s, campaign %s runs without one: %s\n", journal->path, campaign->name, strerror( errno ) );
+            goto fail;
+        }
+        st.st_size = sizeof( header );
+    } else if ( pread( journal->fd, &header, sizeof( header ), 0 ) != (ssize_t) sizeof( header ) || header.magic != DIALER_JOURNAL_MAGIC ||
+                header.record_size != sizeof( struct dialer_journal_record ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: %s isn't a journal this version can append to, move it away; campaign %s runs without one\n",
+                           journal->path, campaign->name );
+        goto fail;
+    }
+
+    /* a record cut short by a crash is dropped, the next one goes right after the last whole one */
+    journal->records = ( st.st_size - sizeof( header ) ) / sizeof( struct dialer_journal_record );
+    end = sizeof( header ) + journal->records * sizeof( struct dialer_journal_record );
+    if ( ( end != st.st_size && ftruncate( journal->fd, end ) ) || lseek( journal->fd, end, SEEK_SET ) != end ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't repair journal %s, campaign %s runs without one: %s\n", journal->path, campaign->name, strerror( errno ) );
+        goto fail;
+    }
+    journal->compacted = switch_min( header.compacted, journal->records );
+
+    while ( size < (uint32_t) globals.journal_queue_size ) {
+        size <<= 1;
+    }
+    if ( !( journal->slots = malloc( sizeof( struct dialer_journal_slot ) * size ) ) ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: no memory for the journal of campaign %s, it runs without one\n", campaign->name );
+        goto fail;
+    }
+    for ( uint32_t i=0; i<size; i++ ) {
+        journal->slots[i].sequence = i;
+    }
+    journal->size = size;
+    journal->running = SWITCH_TRUE;
+
+    campaign->journal = journal;
+    switch_threadattr_create( &thd_attr, campaign->pool );
+    switch_threadattr_stacksize_set( thd_attr, SWITCH_THREAD_STACKSIZE );
+    if ( switch_thread_create( &journal->thread, thd_attr, dialer_journal_thread, campaign, campaign->pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "dialer: couldn't start the journal of campaign %s, it runs without one\n", campaign->name );
+        campaign->journal = NULL;
+        switch_safe_free( journal->slots );
+        goto fail;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: campaign %s journals to %s (%" SWITCH_UINT64_T_FMT " records so far)\n", campaign->name, journal->path,
+                       (uint64_t) journal->records );
+    return;
+
+fail:
+    if ( journal->fd >= 0 ) {
+        close( journal->fd );
+    }
+}
+
+/*!\brief Once every call of the campaign is over: let the journal thread write out the rest, compact it all and close it
+ */
+static void dialer_journal_close( struct db_campaign_config *campaign )
+{
+    struct dialer_journal *journal = campaign->journal;
+    switch_status_t st;
+
+    if ( !journal ) {
+        return;
+    }
+
+    journal->running = SWITCH_FALSE;
+    switch_thread_join( &st, journal->thread );
+    dialer_journal_compact( campaign );
+
+    close( journal->fd );
+    switch_safe_free( journal->slots );
+    campaign->journal = NULL;
+}
+
+struct dialer_lease_holder {
+    char destination_list[50];
+    char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
+};
+
+/*!\brief Renew the leases of every running campaign, then reclaim the rows whose lease expired (a node that died
+ * or lost its database connection) in every destination_list in use
+ */
+static void dialer_lease_renew_and_sweep(void)
+{
+    struct dialer_lease_holder *holders = NULL;
+    struct db_campaign_config *campaign;
+    int count = 0, i, j;
+    char *sql = NULL;
+    char lease_expires[64];
+
+    switch_mutex_lock( globals.mutex );
+    if ( globals.campaign_count > 0 && ( holders = malloc( sizeof( struct dialer_lease_holder ) * globals.campaign_count ) ) ) {
+        for ( campaign = globals.campaign_list; campaign; campaign = campaign->next ) {
+            if ( campaign->running == SWITCH_TRUE && !campaign->file && !zstr( campaign->destination_list ) ) {
+                switch_copy_string( holders[count].destination_list, campaign->destination_list, sizeof( holders[count].destination_list ) );
+                switch_copy_string( holders[count].uuid_str, campaign->uuid_str, sizeof( holders[count].uuid_str ) );
+                count++;
+            }
+        }
+    }
+    switch_mutex_unlock( globals.mutex );
+
+    for ( i = 0; i < count; i++ ) {
+        sql = switch_mprintf( "update %s set lease_expires = %s where lease_owner = '%q' and in_use <> 0", holders[i].destination_list,
+                              dialer_sql_time( lease_expires, sizeof( lease_expires ), globals.lease_seconds ), holders[i].uuid_str );
+        dialer_execute_sql( sql );
+        switch_safe_free( sql );
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        for ( j = 0; j < i && strcmp( holders[j].destination_list, holders[i].destination_list ); j++ );
+        if ( j < i ) {
+            continue;
+        }
+        sql = switch_mprintf( "update %s set in_use = 0, lease_owner = NULL, lease_expires = NULL where in_use <> 0 and lease_expires < %s", holders[i].destination_list, globals.dialect->now );
+        dialer_execute_sql( sql );
+        switch_safe_free( sql );
+    }
+
+    switch_safe_free( holders );
+}
+
+static void *SWITCH_THREAD_FUNC dialer_lease_thread(switch_thread_t *thread, void *obj)
+{
+    switch_time_t next_run = 0;
+
+    while ( globals.lease_running == SWITCH_TRUE ) {
+        if ( switch_micro_time_now() >= next_run ) {
+            dialer_lease_renew_and_sweep();
+            next_run = switch_micro_time_now() + (switch_time_t) globals.lease_renew_interval * 1000000;
+        }
+        switch_yield( 500000 );
+    }
+
+    return NULL;
+}
+
+/*!\brief Start the thread that keeps this node's row leases alive and reclaims expired ones
+ */
+static switch_bool_t dialer_start_lease_thread(void)
+{
+    switch_threadattr_t *thd_attr = NULL;
+
+    globals.lease_running = SWITCH_TRUE;
+    switch_threadattr_create( &thd_attr, globals.pool );
+    switch_threadattr_stacksize_set( thd_attr, SWITCH_THREAD_STACKSIZE );
+
+    if ( switch_thread_create( &globals.lease_thread, thd_attr, dialer_lease_thread, NULL, globals.pool ) != SWITCH_STATUS_SUCCESS ) {
+        switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "dialer: Couldn't start the lease thread\n" );
+        globals.lease_thread = NULL;
+        globals.lease_running = SWITCH_FALSE;
+        return SWITCH_FALSE;
+    }
+
+    switch_log_printf( SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "dialer: lease thread started, leases last %d seconds and are renewed every %d seconds\n", globals.lease_seconds, globals.lease_renew_interval );
+    return SWITCH_TRUE;
+}
+
+static void dialer_stop_lease_thread(void)
+{
+    switch_status_t st;
+
+    globals.lease_running = SWITCH_FALSE;
+    if ( globals.lease_thread ) {
+        switch_thread_join( &st, globals.lease_thread );
+        globals.lease_thread = NULL;
+    }
+}
 
 // This generates a random number using Gaussian distribution using the provided
 // mean and standard-deviation